@@ -25,6 +25,7 @@
 #define MRH_ServerCommunication_h
 
 // C
+#include <stddef.h>
 
 // External
 
@@ -38,6 +39,91 @@ extern "C"
 {
 #endif
     
+    //*************************************************************************************
+    // Types
+    //*************************************************************************************
+    
+    typedef void (*MRH_Srv_ConnectCallback)(MRH_Srv_Server* p_Server, int i_Result, void* p_User); // i_Result is 0 if connected, -1 if not
+    
+    typedef void (*MRH_Srv_WritableCallback)(MRH_Srv_Server* p_Server, void* p_User); // Called by a MsQuic worker thread, must not block
+    
+    typedef int (*MRH_Srv_ReconnectCallback)(MRH_Srv_Server* p_Server, void* p_User); // Return 0 to replay kept messages, -1 to drop them
+    typedef void (*MRH_Srv_AuthCallback)(MRH_Srv_Server* p_Server, int i_Result, void* p_User); // i_Result is 0 if the proof was valid, -1 if not. Called by a auth worker thread
+    
+    typedef struct MRH_Srv_ReconnectPolicy_t
+    {
+        int i_DelayMinMS; // First reconnect delay
+        int i_DelayMaxMS; // Delay limit, the delay doubles after each failed attempt
+        int i_AttemptMax; // Attempts before giving up, -1 for no limit
+        
+        MRH_Srv_ReconnectCallback p_Callback; // Called after reconnecting and before replaying, used for authentication. Can be NULL.
+        void* p_User; // User data given to the callback
+        
+    }MRH_Srv_ReconnectPolicy;
+    
+    typedef struct MRH_Srv_AuthProof_t
+    {
+        char p_Password[MRH_SRV_SIZE_ACCOUNT_PASSWORD]; // The stored account password
+        char p_Salt[MRH_SRV_SIZE_ACCOUNT_PASSWORD_SALT]; // The salt sent with the challenge
+        uint8_t u8_HashType; // The hash type sent with the challenge
+        uint32_t u32_Nonce; // The nonce sent with the challenge
+        uint8_t p_NonceHash[MRH_SRV_SIZE_NONCE_HASH]; // The nonce hash recieved with the proof
+        
+    }MRH_Srv_AuthProof;
+    
+    typedef struct MRH_Srv_ConnectEntry_t
+    {
+        MRH_Srv_Server* p_Server; // The server to connect to
+        const char* p_Address; // The server address, of size MRH_SRV_SIZE_SERVER_ADDRESS
+        int i_Port; // The server port
+        
+        int i_Result; // 0 if connected, -1 if not
+        
+    }MRH_Srv_ConnectEntry;
+    
+    typedef struct MRH_Srv_SendEntry_t
+    {
+        MRH_Srv_NetMessage e_Message; // The type of net message to send
+        const void* p_Data; // The net message data to send (if any)
+        
+    }MRH_Srv_SendEntry;
+    
+    typedef struct MRH_Srv_SendCapacity_t
+    {
+        uint64_t u64_IdealBytes; // Bytes MsQuic wants queued to keep the connection busy
+        uint64_t u64_InFlightBytes; // Bytes handed to MsQuic and not yet send completed (copied with send buffering)
+        uint64_t u64_AvailableBytes; // Bytes which can be queued until the ideal size is reached
+        size_t us_MessageCount; // Messages which can be queued until the send limit is reached
+        
+    }MRH_Srv_SendCapacity;
+    
+    typedef struct MRH_Srv_RecieveEntry_t
+    {
+        uint8_t* p_Buffer; // The buffer to write the message, of size MRH_SRV_SIZE_MESSAGE_BUFFER_MAX
+        size_t us_Size; // The recieved message size in bytes
+        MRH_Srv_NetMessage e_Message; // The recieved net message type
+        
+    }MRH_Srv_RecieveEntry;
+    
+    typedef struct MRH_Srv_MessageView_t
+    {
+        const uint8_t* p_Buffer; // The message bytes, starting with the net message id
+        size_t us_Size; // The message size in bytes
+        MRH_Srv_NetMessage e_Message; // The recieved net message type
+        
+        void* p_Handle; // Internal, used for releasing
+        
+    }MRH_Srv_MessageView;
+    
+    typedef struct MRH_Srv_SequenceGaps_t
+    {
+        uint64_t u64_GapCount; // Gaps skipped after the gap timeout
+        uint64_t u64_MissingCount; // Sequence numbers never delivered in order
+        uint32_t u32_LastMissing; // First missing sequence number of the last gap
+        size_t us_HeldCount; // Messages currently held for reordering
+        
+    }MRH_Srv_SequenceGaps;
+    
     //*************************************************************************************
     // Connection
     //*************************************************************************************
@@ -58,6 +144,54 @@ extern "C"
     
     extern int MRH_SRV_Connect(MRH_Srv_Context* p_Context, MRH_Srv_Server* p_Server, const char* p_Address, int i_Port, int i_WaitS);
     
+    /**
+     *  Start connecting to a server without waiting. The callback is called once
+     *  from a MsQuic worker thread when the connection was established or failed.
+     *
+     *  \param p_Context The library context to use for connecting.
+     *  \param p_Server The server to connect to.
+     *  \param p_Address The server address. The buffer has to be of size
+     *                   MRH_SRV_SIZE_SERVER_ADDRESS.
+     *  \param i_Port The server port.
+     *  \param p_Callback The callback to inform about the result. Can be NULL.
+     *  \param p_User User data given to the callback.
+     *
+     *  \return 0 if the connection was started, -1 on failure. The callback is
+     *          not called on failure.
+     */
+    
+    extern int MRH_SRV_ConnectAsync(MRH_Srv_Context* p_Context, MRH_Srv_Server* p_Server, const char* p_Address, int i_Port, MRH_Srv_ConnectCallback p_Callback, void* p_User);
+    
+    /**
+     *  Connect to multiple servers at once and wait for all of them.
+     *
+     *  \param p_Context The library context to use for connecting.
+     *  \param p_Entry The servers to connect to. The result is set for each entry.
+     *  \param us_Count The number of entries.
+     *  \param i_WaitS The maximum time to wait for all connections. -1 waits
+     *                 until every connection was established or failed.
+     *
+     *  \return 0 if all servers are connected, -1 on failure.
+     */
+    
+    extern int MRH_SRV_ConnectAll(MRH_Srv_Context* p_Context, MRH_Srv_ConnectEntry* p_Entry, size_t us_Count, int i_WaitS);
+    
+    /**
+     *  Set the reconnect policy for a server. Lost connections are restored with
+     *  exponential backoff and jitter. Messages sent while disconnected and
+     *  messages cancelled by the connection loss are kept and sent again after
+     *  reconnecting, which might deliver a message twice. Can't be called from
+     *  the reconnect callback.
+     *
+     *  \param p_Context The context to reconnect with.
+     *  \param p_Server The server to set the policy for.
+     *  \param p_Policy The reconnect policy to use. NULL disables reconnecting.
+     *
+     *  \return 0 on success, -1 on failure.
+     */
+    
+    extern int MRH_SRV_SetReconnect(MRH_Srv_Context* p_Context, MRH_Srv_Server* p_Server, const MRH_Srv_ReconnectPolicy* p_Policy);
+    
     /**
      *  Create a password hash with a provided salt.
      *
@@ -74,6 +208,26 @@ extern "C"
     
     extern int MRH_SRV_CreatePasswordHash(uint8_t* p_Buffer, const char* p_Password, const char* p_Salt, uint8_t u8_HashType);
     
+    /**
+     *  Create a password hash with a provided salt, using the key cache of the
+     *  context. The hash is only created if no key for the account, salt and
+     *  hash type was cached.
+     *
+     *  \param p_Context The context with the key cache to use.
+     *  \param p_Buffer The password hash buffer. The buffer has to be of size
+     *                  MRH_SRV_SIZE_ACCOUNT_PASSWORD.
+     *  \param p_Account The account mail the password belongs to.
+     *  \param p_Password The account password to hash with. The buffer has to be of size
+     *                    MRH_SRV_SIZE_ACCOUNT_PASSWORD.
+     *  \param p_Salt The password hash salt to use. The buffer has to be of size
+     *                MRH_SRV_SIZE_ACCOUNT_PASSWORD_SALT.
+     *  \param u8_HashType The type of hash to use for the password.
+     *
+     *  \return 0 on success, -1 on failure.
+     */
+    
+    extern int MRH_SRV_CreatePasswordHashCached(MRH_Srv_Context* p_Context, uint8_t* p_Buffer, const char* p_Account, const char* p_Password, const char* p_Salt, uint8_t u8_HashType);
+    
     /**
      *  Encrypt a nonce with a given password password.
      *
@@ -122,6 +276,76 @@ extern "C"
     
     extern int MRH_SRV_IsConnected(MRH_Srv_Server* p_Server);
     
+    //*************************************************************************************
+    // Auth
+    //*************************************************************************************
+    
+    /**
+     *  Create a pool of threads verifying client auth proofs. Each verification
+     *  hashes the account password with MRH_SRV_SIZE_PASSWORD_HASH_MEMORY bytes,
+     *  the number of workers is limited by the available memory.
+     *
+     *  \param i_WorkerMax The maximum number of workers. 0 or less uses one
+     *                     worker per core.
+     *  \param us_QueueMax The number of proofs which can wait for a worker.
+     *  \param p_Callback The callback to inform about each verification result.
+     *                    Can be NULL.
+     *  \param p_User User data given to the callback.
+     *
+     *  \return The auth pool on success, NULL on failure.
+     */
+    
+    extern MRH_Srv_AuthPool* MRH_SRV_CreateAuthPool(int i_WorkerMax, size_t us_QueueMax, MRH_Srv_AuthCallback p_Callback, void* p_User);
+    
+    /**
+     *  Destroy a auth pool. Waiting proofs are dropped without a result.
+     *
+     *  \param p_Pool The auth pool to destroy.
+     *
+     *  \return Always NULL.
+     */
+    
+    extern MRH_Srv_AuthPool* MRH_SRV_DestroyAuthPool(MRH_Srv_AuthPool* p_Pool);
+    
+    /**
+     *  Queue a recieved auth proof for verification. A worker sends the
+     *  MRH_SRV_MSG_AUTH_RESULT message to the client. The client is answered
+     *  with MRH_SRV_NET_MESSAGE_ERR_SA_MAINTENANCE if the queue is full or the
+     *  password could not be hashed, MRH_SRV_NET_MESSAGE_ERR_SA_ACCOUNT if the
+     *  nonce did not match.
+     *
+     *  \param p_Pool The auth pool to use.
+     *  \param p_Server The client which sent the proof.
+     *  \param p_Proof The proof to verify. The password is cleared by the pool
+     *                 after use.
+     *
+     *  \return 0 if the proof was queued, -1 on failure.
+     */
+    
+    extern int MRH_SRV_VerifyAuth(MRH_Srv_AuthPool* p_Pool, MRH_Srv_Server* p_Server, const MRH_Srv_AuthProof* p_Proof);
+    
+    /**
+     *  Check if the auth queue is full. Used to answer auth requests with
+     *  MRH_SRV_NET_MESSAGE_ERR_SA_MAINTENANCE before sending a challenge.
+     *
+     *  \param p_Pool The auth pool to check.
+     *
+     *  \return 0 if the queue is full, -1 if not.
+     */
+    
+    extern int MRH_SRV_IsAuthSaturated(MRH_Srv_AuthPool* p_Pool);
+    
+    /**
+     *  Remove all waiting proofs of a client and wait for a running
+     *  verification to finish. Has to be called before destroying a client
+     *  with queued proofs.
+     *
+     *  \param p_Pool The auth pool to use.
+     *  \param p_Server The client to cancel.
+     */
+    
+    extern void MRH_SRV_CancelAuth(MRH_Srv_AuthPool* p_Pool, MRH_Srv_Server* p_Server);
+    
     //*************************************************************************************
     // Recieve
     //*************************************************************************************
@@ -133,9 +357,9 @@ extern "C"
      *  \param p_Server The server to check.
      *  \param p_Buffer The buffer to write the message. The buffer has to be of size
      *                  MRH_SRV_SIZE_MESSAGE_BUFFER_MAX.
-     *  \param p_Password The password to use for message data decryption. NULL skips
-     *                    decryption. The buffer has to be of size
-     *                    MRH_SRV_SIZE_DEVICE_PASSWORD.
+     *  \param p_Password The password to use for message data decryption. NULL uses
+     *                    the session key of the server. The buffer has to be
+     *                    of size MRH_SRV_SIZE_DEVICE_PASSWORD.
      *
      *  \return The recieved net message type on success, MRH_SRV_CS_MSG_UNK if nothing
      *          was recieved.
@@ -143,6 +367,24 @@ extern "C"
     
     extern MRH_Srv_NetMessage MRH_SRV_RecieveMessage(MRH_Srv_Server* p_Server, uint8_t* p_Buffer, const char* p_Password);
     
+    /**
+     *  Recieve all available messages up to a given count. Only the message bytes
+     *  and a terminating null byte are written to each buffer.
+     *
+     *  \param p_Server The server to check.
+     *  \param p_Entry The entries to write the messages to. The entry buffers have
+     *                 to be of size MRH_SRV_SIZE_MESSAGE_BUFFER_MAX.
+     *  \param us_Count The number of entries.
+     *  \param p_Password The password to use for message data decryption. NULL uses
+     *                    the session key of the server. The buffer has to be
+     *                    of size MRH_SRV_SIZE_DEVICE_PASSWORD.
+     *
+     *  \return The number of recieved messages. Failed decryptions are recieved as
+     *          MRH_SRV_MSG_UNK.
+     */
+    
+    extern size_t MRH_SRV_RecieveMessages(MRH_Srv_Server* p_Server, MRH_Srv_RecieveEntry* p_Entry, size_t us_Count, const char* p_Password);
+    
     /**
      *  Set the data of a recieved message with a message buffer.
      *
@@ -155,6 +397,45 @@ extern "C"
     
     int MRH_SRV_SetNetMessage(void* p_Message, const uint8_t* p_Buffer);
     
+    /**
+     *  Borrow the next recieved message without copying it. Encrypted messages are
+     *  decrypted directly into the given buffer, other messages are viewed in place.
+     *  Every borrowed message has to be released with MRH_SRV_ReleaseMessage().
+     *
+     *  \param p_Server The server to check.
+     *  \param p_View The view to set.
+     *  \param p_Buffer The buffer used for decrypted messages. The buffer has to be
+     *                  of size MRH_SRV_SIZE_MESSAGE_BUFFER_MAX.
+     *  \param p_Password The password to use for message data decryption. NULL uses
+     *                    the session key of the server. The buffer has to be
+     *                    of size MRH_SRV_SIZE_DEVICE_PASSWORD.
+     *
+     *  \return 0 if a message was borrowed, -1 if nothing was recieved.
+     */
+    
+    extern int MRH_SRV_BorrowMessage(MRH_Srv_Server* p_Server, MRH_Srv_MessageView* p_View, uint8_t* p_Buffer, const char* p_Password);
+    
+    /**
+     *  Release a borrowed message. The view bytes are invalid afterwards.
+     *
+     *  \param p_Server The server the message was borrowed from.
+     *  \param p_View The view to release.
+     */
+    
+    extern void MRH_SRV_ReleaseMessage(MRH_Srv_Server* p_Server, MRH_Srv_MessageView* p_View);
+    
+    /**
+     *  Get the sequence gaps skipped while delivering recieved messages in order.
+     *  Has to be called by the thread recieving messages.
+     *
+     *  \param p_Server The server to check.
+     *  \param p_Gaps The sequence gaps to fill.
+     *
+     *  \return 0 on success, -1 on failure.
+     */
+    
+    extern int MRH_SRV_GetSequenceGaps(MRH_Srv_Server* p_Server, MRH_Srv_SequenceGaps* p_Gaps);
+    
     //*************************************************************************************
     // Send
     //*************************************************************************************
@@ -165,15 +446,206 @@ extern "C"
      *  \param p_Server The server to send to.
      *  \param e_Message The type of net message to send.
      *  \param p_Data The net message data to send (if any).
-     *  \param p_Password The password to use for message data encryption. NULL skips
-     *                    encryption. The buffer has to be of size
-     *                    MRH_SRV_SIZE_DEVICE_PASSWORD.
+     *  \param p_Password The password to use for message data encryption. NULL uses
+     *                    the session key of the server. The buffer has to be
+     *                    of size MRH_SRV_SIZE_DEVICE_PASSWORD.
      *
      *  \return 0 if the message was sent, -1 on failure.
      */
     
     extern int MRH_SRV_SendMessage(MRH_Srv_Server* p_Server, MRH_Srv_NetMessage e_Message, const void* p_Data, const char* p_Password);
     
+    /**
+     *  Send a message to a server. Waits for a send buffer if the send limit of
+     *  the server was reached.
+     *
+     *  \param p_Server The server to send to.
+     *  \param e_Message The type of net message to send.
+     *  \param p_Data The net message data to send (if any).
+     *  \param p_Password The password to use for message data encryption. NULL uses
+     *                    the session key of the server. The buffer has to be
+     *                    of size MRH_SRV_SIZE_DEVICE_PASSWORD.
+     *  \param i_TimeoutMS The maximum time to wait for a send buffer in
+     *                     milliseconds. Negative values wait without a timeout.
+     *
+     *  \return 0 if the message was sent, -1 on failure.
+     */
+    
+    extern int MRH_SRV_SendMessageWait(MRH_Srv_Server* p_Server, MRH_Srv_NetMessage e_Message, const void* p_Data, const char* p_Password, int i_TimeoutMS);
+    
+    /**
+     *  Send a message to a server with a stream priority other than the one set
+     *  for the net message. Prioritized messages do not share framed streams.
+     *
+     *  \param p_Server The server to send to.
+     *  \param e_Message The type of net message to send.
+     *  \param p_Data The net message data to send (if any).
+     *  \param p_Password The password to use for message data encryption. NULL uses
+     *                    the session key of the server. The buffer has to be
+     *                    of size MRH_SRV_SIZE_DEVICE_PASSWORD.
+     *  \param u16_Priority The stream priority, from MRH_SRV_PRIORITY_LOWEST to
+     *                      MRH_SRV_PRIORITY_HIGHEST.
+     *
+     *  \return 0 if the message was sent, -1 on failure.
+     */
+    
+    extern int MRH_SRV_SendMessagePriority(MRH_Srv_Server* p_Server, MRH_Srv_NetMessage e_Message, const void* p_Data, const char* p_Password, uint16_t u16_Priority);
+    
+    /**
+     *  Send multiple messages to a server. Framed servers recieve all messages with a
+     *  single stream send, otherwise every message uses its own stream. Messages
+     *  set to use datagrams are sent on streams like the other messages.
+     *
+     *  \param p_Server The server to send to.
+     *  \param p_Entry The messages to send.
+     *  \param us_Count The number of messages to send, at most
+     *                  MRH_SRV_SIZE_SEND_BATCH_MAX.
+     *  \param p_Password The password to use for message data encryption. NULL uses
+     *                    the session key of the server. The buffer has to be
+     *                    of size MRH_SRV_SIZE_DEVICE_PASSWORD.
+     *
+     *  \return 0 if all messages were sent, -1 on failure. Invalid messages cause no
+     *          message to be sent, a failed stream send only stops the remaining
+     *          messages.
+     */
+    
+    extern int MRH_SRV_SendMessages(MRH_Srv_Server* p_Server, const MRH_Srv_SendEntry* p_Entry, size_t us_Count, const char* p_Password);
+    
+    /**
+     *  Send the same message to multiple servers of a context. The message is
+     *  built and encrypted once, all servers send the same message data.
+     *  Encrypted messages always use MRH_SRV_CIPHER_SECRETBOX with the given
+     *  password, servers with a session key or a different cipher are skipped
+     *  for them.
+     *
+     *  \param p_Context The context the servers were created with. Servers of
+     *                   other contexts are skipped.
+     *  \param p_Server The servers to send to.
+     *  \param us_Count The number of servers.
+     *  \param e_Message The type of net message to send.
+     *  \param p_Data The net message data to send (if any).
+     *  \param p_Password The password to use for message data encryption. Session
+     *                    keys are not used, all servers share the encryption.
+     *                    The buffer has to be of size MRH_SRV_SIZE_DEVICE_PASSWORD.
+     *
+     *  \return The number of servers the message was sent to.
+     */
+    
+    extern size_t MRH_SRV_Broadcast(MRH_Srv_Context* p_Context, MRH_Srv_Server* const* p_Server, size_t us_Count, MRH_Srv_NetMessage e_Message, const void* p_Data, const char* p_Password);
+    
+    /**
+     *  Get how much can be sent to a server without queueing more than MsQuic
+     *  can send in a round trip.
+     *
+     *  \param p_Server The server to check.
+     *  \param p_Capacity The send capacity to fill.
+     *
+     *  \return 0 on success, -1 on failure.
+     */
+    
+    extern int MRH_SRV_GetSendCapacity(MRH_Srv_Server* p_Server, MRH_Srv_SendCapacity* p_Capacity);
+    
+    /**
+     *  Set the callback to inform once the bytes in flight dropped below the
+     *  ideal send buffer size. With MsQuic send buffering enabled bytes stop
+     *  being in flight once MsQuic copied them, not once the peer
+     *  acknowledged them.
+     *
+     *  \param p_Server The server to set the callback for.
+     *  \param p_Callback The callback to use. NULL removes the callback.
+     *  \param p_User The user data given to the callback.
+     *
+     *  \return 0 on success, -1 on failure.
+     */
+    
+    extern int MRH_SRV_SetWritableCallback(MRH_Srv_Server* p_Server, MRH_Srv_WritableCallback p_Callback, void* p_User);
+    
+    //*************************************************************************************
+    // Stream
+    //*************************************************************************************
+    
+    /**
+     *  Begin sending a single large payload to a server. The payload is sent on
+     *  its own stream and encrypted in chunks of up to
+     *  MRH_SRV_SIZE_STREAM_CHUNK_MAX bytes.
+     *
+     *  \param p_Server The server to send to.
+     *  \param p_Password The password to use for encryption. NULL uses the session
+     *                    key of the server. The buffer has to be of size
+     *                    MRH_SRV_SIZE_DEVICE_PASSWORD.
+     *
+     *  \return The send stream on success, NULL on failure.
+     */
+    
+    extern MRH_Srv_Stream* MRH_SRV_StreamBegin(MRH_Srv_Server* p_Server, const char* p_Password);
+    
+    /**
+     *  Write payload bytes to a send stream. Waits while more than the ideal send
+     *  buffer size is in flight.
+     *
+     *  \param p_Stream The stream to write to.
+     *  \param p_Data The bytes to write.
+     *  \param us_Size The number of bytes to write.
+     *  \param i_TimeoutMS The maximum time to wait until the write can start in
+     *                     milliseconds. Negative values wait without a timeout.
+     *                     Once started the whole write is sent.
+     *
+     *  \return 0 on success, -1 on failure. After a timeout
+     *          (MRH_SERVER_ERROR_STREAM_TIMEOUT) nothing was written and the
+     *          stream can still be used, otherwise it can only be closed.
+     */
+    
+    extern int MRH_SRV_StreamWrite(MRH_Srv_Stream* p_Stream, const uint8_t* p_Data, size_t us_Size, int i_TimeoutMS);
+    
+    /**
+     *  Finish sending a payload. The stream is destroyed.
+     *
+     *  \param p_Stream The stream to finish.
+     *
+     *  \return 0 if the end of the payload was sent, -1 on failure.
+     */
+    
+    extern int MRH_SRV_StreamEnd(MRH_Srv_Stream* p_Stream);
+    
+    /**
+     *  Accept the oldest payload stream recieved from a server.
+     *
+     *  \param p_Server The server to accept from.
+     *  \param p_Password The password to use for decryption. NULL uses the session
+     *                    key of the server. The buffer has to be of size
+     *                    MRH_SRV_SIZE_DEVICE_PASSWORD.
+     *
+     *  \return The recieve stream on success, NULL if no stream was recieved.
+     */
+    
+    extern MRH_Srv_Stream* MRH_SRV_StreamAccept(MRH_Srv_Server* p_Server, const char* p_Password);
+    
+    /**
+     *  Read decrypted payload bytes from a recieve stream.
+     *
+     *  \param p_Stream The stream to read from.
+     *  \param p_Buffer The buffer to write to.
+     *  \param us_Size The size of the buffer in bytes.
+     *  \param p_Read The number of bytes read.
+     *  \param i_TimeoutMS The maximum time to wait for bytes in milliseconds.
+     *                     Negative values wait without a timeout.
+     *
+     *  \return 0 if the payload continues, 1 if the payload was read completely,
+     *          -1 on failure.
+     */
+    
+    extern int MRH_SRV_StreamRead(MRH_Srv_Stream* p_Stream, uint8_t* p_Buffer, size_t us_Size, size_t* p_Read, int i_TimeoutMS);
+    
+    /**
+     *  Close a stream. Unfinished streams are aborted.
+     *
+     *  \param p_Stream The stream to close.
+     *
+     *  \return Always NULL.
+     */
+    
+    extern MRH_Srv_Stream* MRH_SRV_StreamClose(MRH_Srv_Stream* p_Stream);
+    
 #ifdef __cplusplus
 }
 #endif
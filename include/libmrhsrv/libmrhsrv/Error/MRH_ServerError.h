@@ -77,9 +77,35 @@ extern "C"
         MRH_SERVER_ERROR_SEND_STREAM_CREATE,
         MRH_SERVER_ERROR_SEND_STREAM_START,
         MRH_SERVER_ERROR_SEND_STREAM_SEND,
+        MRH_SERVER_ERROR_SEND_DATAGRAM,
+        
+        // Stream
+        MRH_SERVER_ERROR_STREAM_OPEN,
+        MRH_SERVER_ERROR_STREAM_CLOSED,
+        
+        // MsQuic
+        MRH_SERVER_ERROR_MSQUIC_EXECUTION,
+        
+        // Listen
+        MRH_SERVER_ERROR_LISTEN_START,
+        
+        // Auth
+        MRH_SERVER_ERROR_AUTH_POOL_START,
+        MRH_SERVER_ERROR_AUTH_POOL_FULL,
+        
+        // Ticket
+        MRH_SERVER_ERROR_TICKET_SAVE,
+        
+        // Encryption
+        MRH_SERVER_ERROR_ENCRYPTION_REPLAY,
+        
+        // Stream
+        MRH_SERVER_ERROR_STREAM_TIMEOUT,
+        
+        // @NOTE: Apps store these values, new codes are only appended above
         
         // Bounds
-        MRH_SERVER_ERROR_TYPE_MAX = MRH_SERVER_ERROR_SEND_DISCONNECTED,
+        MRH_SERVER_ERROR_TYPE_MAX = MRH_SERVER_ERROR_STREAM_TIMEOUT,
 
         MRH_SERVER_ERROR_TYPE_COUNT = MRH_SERVER_ERROR_TYPE_MAX + 1
 
@@ -90,7 +116,7 @@ extern "C"
     //*************************************************************************************
 
     /**
-     *  Reset last error.
+     *  Reset last error of the calling thread.
      */
 
     extern void MRH_ERR_ServerReset(void);
@@ -100,9 +126,9 @@ extern "C"
     //*************************************************************************************
 
     /**
-     *  Get library error.
+     *  Get library error. Errors are kept per thread.
      *
-     *  \return The current library error.
+     *  \return The current library error of the calling thread.
      */
 
      extern MRH_Server_Error_Type MRH_ERR_GetServerError(void);
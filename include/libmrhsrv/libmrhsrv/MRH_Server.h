@@ -30,6 +30,7 @@
 // External
 
 // Project
+#include "./Communication/MRH_NetMessage.h"
 #include "./MRH_ServerTypes.h"
 #include "./MRH_ServerSizes.h"
 
@@ -63,6 +64,27 @@ extern "C"
     
     extern MRH_Srv_Context* MRH_SRV_Init(MRH_Srv_Actor e_Client, int i_MaxServerCount, int i_TimeoutMS);
     
+    /**
+     *  Initialize the server connection object to use with the given options.
+     *
+     *  \param p_Options The init options to use.
+     *
+     *  \return The connection object on success, NULL on failure.
+     */
+    
+    extern MRH_Srv_Context* MRH_SRV_InitEx(const MRH_Srv_InitOptions* p_Options);
+    
+    /**
+     *  Get the default init options. MRH_SRV_Init() uses these options.
+     *
+     *  \param p_Options The init options to set.
+     *  \param e_Client The client type.
+     *  \param i_MaxServerCount The maximum number of servers creatable.
+     *  \param i_TimeoutMS The connection timeout in milliseconds.
+     */
+    
+    extern void MRH_SRV_GetDefaultInitOptions(MRH_Srv_InitOptions* p_Options, MRH_Srv_Actor e_Client, int i_MaxServerCount, int i_TimeoutMS);
+    
     /**
      *  Destroy a library context object.
      *
@@ -73,6 +95,52 @@ extern "C"
     
     extern MRH_Srv_Context* MRH_SRV_Destroy(MRH_Srv_Context* p_Context);
     
+    /**
+     *  Set a file to keep QUIC resumption tickets between runs. Tickets are always
+     *  cached in memory per server address and port, the file only adds
+     *  persistence. Existing tickets in the file are loaded.
+     *
+     *  \param p_Context The context to set the ticket store for.
+     *  \param p_FilePath The full path to the ticket file. NULL stops storing.
+     *
+     *  \return 0 on success, -1 on failure.
+     */
+    
+    extern int MRH_SRV_SetTicketStore(MRH_Srv_Context* p_Context, const char* p_FilePath);
+    
+    /**
+     *  Write recieved resumption tickets to the ticket store file. Tickets are
+     *  also saved when connecting and when the context is destroyed.
+     *
+     *  \param p_Context The context to save the tickets for.
+     *
+     *  \return 0 on success, -1 on failure.
+     */
+    
+    extern int MRH_SRV_SaveTickets(MRH_Srv_Context* p_Context);
+    
+    /**
+     *  Keep keys derived by MRH_SRV_CreatePasswordHashCached in guarded memory.
+     *  Setting a new cache wipes all cached keys. Not thread safe with
+     *  MRH_SRV_CreatePasswordHashCached.
+     *
+     *  \param p_Context The context to set the key cache for.
+     *  \param us_Count The number of keys to keep. 0 disables the cache.
+     *  \param u32_ExpireS The time in seconds a key is kept after it was derived.
+     *
+     *  \return 0 on success, -1 on failure.
+     */
+    
+    extern int MRH_SRV_SetKeyCache(MRH_Srv_Context* p_Context, size_t us_Count, uint32_t u32_ExpireS);
+    
+    /**
+     *  Wipe all cached derived keys.
+     *
+     *  \param p_Context The context to clear the key cache for.
+     */
+    
+    extern void MRH_SRV_ClearKeyCache(MRH_Srv_Context* p_Context);
+    
     //*************************************************************************************
     // Server
     //*************************************************************************************
@@ -89,15 +157,251 @@ extern "C"
     
     /**
      *  Destroy a server object. The server will disconnect before destruction.
+     *  Servers can't be destroyed from their own reconnect callback.
      *
      *  \param p_Context The context to use.
      *  \param p_Server The server to destroy.
      *
-     *  \return Always NULL.
+     *  \return NULL on success, the server if it was not destroyed.
      */
     
     extern MRH_Srv_Server* MRH_SRV_DestroyServer(MRH_Srv_Context* p_Context, MRH_Srv_Server* p_Server);
     
+    /**
+     *  Set the MsQuic partition a server connects on. All callbacks for the
+     *  connection run on the worker of that partition. The partition is assigned
+     *  on server creation with the context partition mapping and used by the
+     *  next connect.
+     *
+     *  \param p_Context The context the server was created with.
+     *  \param p_Server The server to set the partition for.
+     *  \param i_Partition The partition index, -1 to let MsQuic choose.
+     *
+     *  \return 0 on success, -1 on failure.
+     */
+    
+    extern int MRH_SRV_SetPartition(MRH_Srv_Context* p_Context, MRH_Srv_Server* p_Server, int i_Partition);
+    
+    /**
+     *  Get the number of MsQuic partitions usable by servers.
+     *
+     *  \param p_Context The context to get the partition count for.
+     *
+     *  \return The partition count on success, -1 on failure.
+     */
+    
+    extern int MRH_SRV_GetPartitionCount(MRH_Srv_Context* p_Context);
+    
+    /**
+     *  Set the transport used to send messages to a server. Recieving handles
+     *  all transports regardless of this setting.
+     *
+     *  \param p_Server The server to set the transport for.
+     *  \param e_Transport The transport to use. Defaults to
+     *                     MRH_SRV_TRANSPORT_STREAM_PER_MESSAGE.
+     *
+     *  \return 0 on success, -1 on failure.
+     */
+    
+    extern int MRH_SRV_SetTransport(MRH_Srv_Server* p_Server, MRH_Srv_Transport e_Transport);
+    
+    /**
+     *  Set if a net message should be sent as a unreliable datagram. Messages are
+     *  sent on a stream if the server did not enable datagrams or the message is
+     *  too large for a datagram.
+     *
+     *  \param p_Server The server to set the datagram usage for.
+     *  \param e_Message The net message to set. Only MRH_SRV_MSG_LOCATION and
+     *                   MRH_SRV_MSG_CUSTOM are allowed.
+     *  \param i_Enabled 0 to send as datagram, -1 to send on a stream.
+     *
+     *  \return 0 on success, -1 on failure.
+     */
+    
+    extern int MRH_SRV_SetDatagram(MRH_Srv_Server* p_Server, MRH_Srv_NetMessage e_Message, int i_Enabled);
+    
+    /**
+     *  Set the stream priority used to send a net message. Streams with a higher
+     *  priority are sent first. Auth messages default to MRH_SRV_PRIORITY_HIGHEST,
+     *  control messages to MRH_SRV_PRIORITY_HIGH and custom messages to
+     *  MRH_SRV_PRIORITY_LOW.
+     *
+     *  \param p_Server The server to set the priority for.
+     *  \param e_Message The net message to set.
+     *  \param u16_Priority The stream priority, from MRH_SRV_PRIORITY_LOWEST to
+     *                      MRH_SRV_PRIORITY_HIGHEST.
+     *
+     *  \return 0 on success, -1 on failure.
+     */
+    
+    extern int MRH_SRV_SetMessagePriority(MRH_Srv_Server* p_Server, MRH_Srv_NetMessage e_Message, uint16_t u16_Priority);
+    
+    /**
+     *  Set if single message streams keep their recieved bytes inside MsQuic until
+     *  the message was read. Borrowed messages are not copied before reading and
+     *  block a disconnect until released.
+     *
+     *  \param p_Server The server to set zero copy recieving for.
+     *  \param i_Enabled 0 to enable, -1 to disable.
+     *
+     *  \return 0 on success, -1 on failure.
+     */
+    
+    extern int MRH_SRV_SetZeroCopyRecieve(MRH_Srv_Server* p_Server, int i_Enabled);
+    
+    /**
+     *  Set if messages sent on streams carry a sequence number. Sequence numbers
+     *  restart with each connection, datagrams are never sequenced.
+     *
+     *  \param p_Server The server to set sequencing for.
+     *  \param i_Enabled 0 to enable, -1 to disable.
+     *
+     *  \return 0 on success, -1 on failure.
+     */
+    
+    extern int MRH_SRV_SetSequence(MRH_Srv_Server* p_Server, int i_Enabled);
+    
+    /**
+     *  Set if recieved messages with a sequence number are delivered in order.
+     *  Messages are held until all previous sequence numbers were recieved or the
+     *  gap timeout passed. Messages without a sequence number are not held.
+     *
+     *  \param p_Server The server to set ordering for.
+     *  \param i_Enabled 0 to enable, -1 to disable.
+     *  \param i_GapTimeoutMS The time to wait for a missing sequence number in
+     *                        milliseconds.
+     *
+     *  \return 0 on success, -1 on failure.
+     */
+    
+    extern int MRH_SRV_SetRecieveOrder(MRH_Srv_Server* p_Server, int i_Enabled, int i_GapTimeoutMS);
+    
+    /**
+     *  Set the number of messages which can be sent to a server at the same time.
+     *  Send buffers are created as needed until the limit is reached. Messages
+     *  count until MsQuic completed sending them.
+     *
+     *  \param p_Server The server to set the send limit for.
+     *  \param us_Count The message count limit, from 1 to
+     *                  MRH_SRV_SIZE_SEND_MESSAGE_MAX.
+     *
+     *  \return 0 on success, -1 on failure.
+     */
+    
+    extern int MRH_SRV_SetSendLimit(MRH_Srv_Server* p_Server, size_t us_Count);
+    
+    /**
+     *  Set the key used to encrypt and decrypt message data if no password is
+     *  given. The key is kept in guarded memory until replaced or the server
+     *  is destroyed. Not thread safe with sending and recieving.
+     *
+     *  \param p_Server The server to set the session key for.
+     *  \param p_Key The session key. The buffer has to be of size
+     *               MRH_SRV_SIZE_DEVICE_PASSWORD. NULL removes the key.
+     *
+     *  \return 0 on success, -1 on failure.
+     */
+    
+    extern int MRH_SRV_SetSessionKey(MRH_Srv_Server* p_Server, const uint8_t* p_Key);
+    
+    /**
+     *  Derive and set a session key from the device password and a nonce
+     *  known to both sides of the connection.
+     *
+     *  \param p_Server The server to set the session key for.
+     *  \param p_Password The device password to derive from. The buffer has to
+     *                    be of size MRH_SRV_SIZE_DEVICE_PASSWORD.
+     *  \param u64_Nonce The nonce of the connection.
+     *
+     *  \return 0 on success, -1 on failure.
+     */
+    
+    extern int MRH_SRV_DeriveSessionKey(MRH_Srv_Server* p_Server, const char* p_Password, uint64_t u64_Nonce);
+    
+    /**
+     *  Set the cipher used to encrypt sent message data. Recieved messages are
+     *  flagged with the cipher they were sent with and decrypted accordingly.
+     *  Short nonces can only be recieved once the prefix of the other side is
+     *  set. Messages with counter nonces under the known prefix are checked for
+     *  replays; repeated counters and counters more than twice
+     *  MRH_SRV_SIZE_SEND_MESSAGE_MAX below the highest recieved one are
+     *  rejected with MRH_SERVER_ERROR_ENCRYPTION_REPLAY. Full nonces with
+     *  another prefix are not checked. Not thread safe with sending and
+     *  recieving.
+     *
+     *  \param p_Server The server to set the cipher for.
+     *  \param e_Cipher The cipher to use.
+     *  \param p_RecievePrefix The nonce prefix of the other side, required for
+     *                         MRH_SRV_CIPHER_XCHACHA20_SHORT. The buffer has to
+     *                         be of size MRH_SRV_SIZE_CIPHER_PREFIX.
+     *
+     *  \return 0 on success, -1 on failure.
+     */
+    
+    extern int MRH_SRV_SetCipher(MRH_Srv_Server* p_Server, MRH_Srv_Cipher e_Cipher, const uint8_t* p_RecievePrefix);
+    
+    /**
+     *  Get the random nonce prefix used for sent messages. The other side
+     *  needs this prefix for MRH_SRV_CIPHER_XCHACHA20_SHORT.
+     *
+     *  \param p_Server The server to get the prefix for.
+     *  \param p_Prefix The prefix buffer. The buffer has to be of size
+     *                  MRH_SRV_SIZE_CIPHER_PREFIX.
+     *
+     *  \return 0 on success, -1 on failure.
+     */
+    
+    extern int MRH_SRV_GetCipherPrefix(MRH_Srv_Server* p_Server, uint8_t* p_Prefix);
+    
+    //*************************************************************************************
+    // Listener
+    //*************************************************************************************
+    
+    /**
+     *  Start listening for client connections. The context has to be created
+     *  for MRH_SRV_SERVER with a certificate.
+     *
+     *  \param p_Context The context to listen with.
+     *  \param p_Address The local address to listen on. NULL listens on all
+     *                   addresses.
+     *  \param i_Port The port to listen on.
+     *  \param us_Backlog The number of connections which can be in the handshake
+     *                    or wait for MRH_SRV_Accept() at the same time. Further
+     *                    connections are refused.
+     *
+     *  \return The listener on success, NULL on failure.
+     */
+    
+    extern MRH_Srv_Listener* MRH_SRV_Listen(MRH_Srv_Context* p_Context, const char* p_Address, int i_Port, size_t us_Backlog);
+    
+    /**
+     *  Accept the oldest connected client. The client is returned as a server
+     *  object and uses the same send and recieve functions. Accepted servers
+     *  count against the maximum server count and have to be destroyed with
+     *  MRH_SRV_DestroyServer().
+     *
+     *  \param p_Context The context the listener was started with.
+     *  \param p_Listener The listener to accept from.
+     *  \param i_TimeoutMS The maximum time to wait for a client in milliseconds.
+     *                     0 returns immediately, negative values wait without a
+     *                     timeout.
+     *
+     *  \return The connected client on success, NULL if no client was accepted.
+     */
+    
+    extern MRH_Srv_Server* MRH_SRV_Accept(MRH_Srv_Context* p_Context, MRH_Srv_Listener* p_Listener, int i_TimeoutMS);
+    
+    /**
+     *  Stop listening. Waits for clients in the handshake, clients which were not
+     *  accepted are disconnected. Accepted clients stay connected.
+     *
+     *  \param p_Listener The listener to stop.
+     *
+     *  \return Always NULL.
+     */
+    
+    extern MRH_Srv_Listener* MRH_SRV_StopListen(MRH_Srv_Listener* p_Listener);
+    
 #ifdef __cplusplus
 }
 #endif
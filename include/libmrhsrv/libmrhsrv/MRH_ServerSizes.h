@@ -37,12 +37,17 @@
 #define MRH_SRV_SIZE_ACCOUNT_PASSWORD 32 // Max key length, equals crypto_secretbox_KEYBYTES and crypto_box_SEEDBYTES
 #define MRH_SRV_SIZE_ACCOUNT_PASSWORD_SALT 16 // Salt used for pw hash (crypto_pwhash_SALTBYTES)
 
+#define MRH_SRV_SIZE_PASSWORD_HASH_MEMORY (128 * 1024 * 1024) // Memory used by one password hash
+#define MRH_SRV_SIZE_CIPHER_PREFIX 16 // Nonce prefix for counter nonces (crypto_aead_xchacha20poly1305_ietf_NPUBBYTES - 8)
 #define MRH_SRV_SIZE_NONCE_HASH 24 + 16 + sizeof(uint32_t) // Hashed nonce bytes (crypto_secretbox_NONCEBYTES + crypto_secretbox_MACBYTES + 4)
 
 #define MRH_SRV_SIZE_DEVICE_KEY 25
 #define MRH_SRV_SIZE_DEVICE_PASSWORD MRH_SRV_SIZE_ACCOUNT_PASSWORD // Uses same size for sodium
 
 #define MRH_SRV_SIZE_MESSAGE_BUFFER_MAX 1024 // Recieve / send size
+#define MRH_SRV_SIZE_SEND_MESSAGE_MAX 2048 // Max send messages per server in flight
+#define MRH_SRV_SIZE_SEND_BATCH_MAX 32 // Max messages sent together with MRH_SRV_SendMessages
+#define MRH_SRV_SIZE_STREAM_CHUNK_MAX 65536 // Max bytes encrypted together on a transfer stream
 
 #define MRH_SRV_SIZE_TEXT_STRING MRH_SRV_SIZE_MESSAGE_BUFFER_MAX - 9 // Type and time stamp
 #define MRH_SRV_SIZE_CUSTOM_BUFFER MRH_SRV_SIZE_MESSAGE_BUFFER_MAX - 1
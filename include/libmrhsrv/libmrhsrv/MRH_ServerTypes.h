@@ -25,6 +25,7 @@
 #define MRH_ServerConnection_h
 
 // C
+#include <stdint.h>
 
 // External
 
@@ -47,6 +48,15 @@ extern "C"
     struct MRH_Srv_Server_t;
     typedef struct MRH_Srv_Server_t MRH_Srv_Server;
     
+    struct MRH_Srv_Stream_t;
+    typedef struct MRH_Srv_Stream_t MRH_Srv_Stream;
+    
+    struct MRH_Srv_Listener_t;
+    typedef struct MRH_Srv_Listener_t MRH_Srv_Listener;
+    
+    struct MRH_Srv_AuthPool_t;
+    typedef struct MRH_Srv_AuthPool_t MRH_Srv_AuthPool;
+    
     //*************************************************************************************
     // Actors
     //*************************************************************************************
@@ -63,6 +73,115 @@ extern "C"
         MRH_SRV_ACTOR_COUNT = MRH_SRV_ACTOR_MAX + 1
         
     }MRH_Srv_Actor;
+    
+    //*************************************************************************************
+    // Transport
+    //*************************************************************************************
+    
+    typedef enum
+    {
+        MRH_SRV_TRANSPORT_STREAM_PER_MESSAGE = 0, // One stream for each message
+        MRH_SRV_TRANSPORT_FRAMED = 1, // Long-lived streams with length prefixed messages
+        
+        MRH_SRV_TRANSPORT_MAX = MRH_SRV_TRANSPORT_FRAMED,
+        
+        MRH_SRV_TRANSPORT_COUNT = MRH_SRV_TRANSPORT_MAX + 1
+        
+    }MRH_Srv_Transport;
+    
+    //*************************************************************************************
+    // Priority
+    //*************************************************************************************
+    
+    // @NOTE: Stream priorities, streams with a higher priority are sent first
+    #define MRH_SRV_PRIORITY_LOWEST 0x0000
+    #define MRH_SRV_PRIORITY_LOW 0x3FFF // Bulk data
+    #define MRH_SRV_PRIORITY_DEFAULT 0x7FFF // MsQuic default
+    #define MRH_SRV_PRIORITY_HIGH 0xBFFF // Control messages
+    #define MRH_SRV_PRIORITY_HIGHEST 0xFFFF // Authentication
+    
+    //*************************************************************************************
+    // Options
+    //*************************************************************************************
+    
+    typedef enum
+    {
+        MRH_SRV_PROFILE_LOW_LATENCY = 0, // Interactive clients
+        MRH_SRV_PROFILE_MAX_THROUGHPUT = 1, // Batch uploads
+        MRH_SRV_PROFILE_SCAVENGER = 2, // Background traffic, lowest priority
+        MRH_SRV_PROFILE_REAL_TIME = 3, // Dedicated threads, highest priority
+        
+        MRH_SRV_PROFILE_MAX = MRH_SRV_PROFILE_REAL_TIME,
+        
+        MRH_SRV_PROFILE_COUNT = MRH_SRV_PROFILE_MAX + 1
+        
+    }MRH_Srv_Profile;
+    
+    typedef enum
+    {
+        MRH_SRV_CONGESTION_CUBIC = 0,
+        MRH_SRV_CONGESTION_BBR = 1,
+        
+        MRH_SRV_CONGESTION_MAX = MRH_SRV_CONGESTION_BBR,
+        
+        MRH_SRV_CONGESTION_COUNT = MRH_SRV_CONGESTION_MAX + 1
+        
+    }MRH_Srv_Congestion;
+    
+    typedef enum
+    {
+        MRH_SRV_PARTITION_AUTO = 0, // MsQuic picks the partition for each connection
+        MRH_SRV_PARTITION_ROUND_ROBIN = 1, // Servers are spread over all partitions in creation order
+        
+        MRH_SRV_PARTITION_MAX = MRH_SRV_PARTITION_ROUND_ROBIN,
+        
+        MRH_SRV_PARTITION_COUNT = MRH_SRV_PARTITION_MAX + 1
+        
+    }MRH_Srv_Partition;
+    
+    typedef enum
+    {
+        MRH_SRV_CIPHER_SECRETBOX = 0, // Random nonce for each message
+        MRH_SRV_CIPHER_XCHACHA20 = 1, // XChaCha20-Poly1305 with a prefix and counter nonce
+        MRH_SRV_CIPHER_XCHACHA20_SHORT = 2, // Same as MRH_SRV_CIPHER_XCHACHA20, only the counter is sent
+        
+        MRH_SRV_CIPHER_MAX = MRH_SRV_CIPHER_XCHACHA20_SHORT,
+        
+        MRH_SRV_CIPHER_COUNT = MRH_SRV_CIPHER_MAX + 1
+        
+    }MRH_Srv_Cipher;
+    
+    typedef struct MRH_Srv_InitOptions_t
+    {
+        // Client
+        MRH_Srv_Actor e_Client; // The client type
+        int i_MaxServerCount; // The maximum number of servers creatable
+        int i_TimeoutMS; // The connection idle timeout in milliseconds
+        
+        // Registration
+        const char* p_RegistrationName; // The MsQuic registration name
+        const char* p_Alpn; // The application protocol, has to match the server
+        MRH_Srv_Profile e_Profile; // The MsQuic execution profile
+        
+        // Server
+        const char* p_CertificateFile; // The certificate file, required for MRH_SRV_SERVER
+        const char* p_PrivateKeyFile; // The private key file, required for MRH_SRV_SERVER
+        
+        // Transport
+        MRH_Srv_Congestion e_Congestion; // The congestion control algorithm
+        uint32_t u32_StreamRecvWindow; // Initial stream recieve window in bytes, 0 for the MsQuic default
+        uint32_t u32_ConnFlowControlWindow; // Connection flow control window in bytes, 0 for the MsQuic default
+        int i_SendBuffering; // 0 to buffer sends inside MsQuic, -1 to send from the message buffers
+        int i_Pacing; // 0 to pace sends, -1 to send in bursts
+        uint32_t u32_KeepAliveIntervalMS; // Keep alive interval in milliseconds, 0 to disable
+        uint32_t u32_HandshakeIdleTimeoutMS; // Handshake idle timeout in milliseconds, 0 for the MsQuic default
+        
+        // Execution
+        const uint16_t* p_ProcessorList; // The cores to run the MsQuic workers on, NULL to use all cores
+        uint32_t u32_ProcessorCount; // The number of cores in the list, each core is one partition
+        MRH_Srv_Partition e_Partition; // How new servers are mapped to partitions
+        
+    }MRH_Srv_InitOptions;
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,406 @@
+/**
+ *  libmrhsrv
+ *  Copyright (C) 2021 - 2022 Jens Brörken
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty.  In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any source distribution.
+ */
+
+
+// C
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+// External
+#include <sodium.h>
+
+// Project
+#include "../../../include/libmrhsrv/libmrhsrv/Communication/MRH_ServerCommunication.h"
+#include "../Error/MRH_ServerErrorInternal.h"
+#include "../MRH_ServerTypesInternal.h"
+
+
+//*************************************************************************************
+// Pool
+//*************************************************************************************
+
+typedef struct MRH_Srv_AuthJob_t
+{
+    MRH_Srv_Server* p_Server;
+    MRH_Srv_AuthProof c_Proof;
+    
+}MRH_Srv_AuthJob;
+
+typedef struct MRH_Srv_AuthWorker_t
+{
+    pthread_t p_Thread;
+    MRH_Srv_AuthPool* p_Pool;
+    MRH_Srv_Server* p_Running; // The client currently verified, NULL if idle
+    
+}MRH_Srv_AuthWorker;
+
+struct MRH_Srv_AuthPool_t
+{
+    pthread_mutex_t p_Mutex;
+    pthread_cond_t p_JobCond; // Signaled on new jobs and on stop
+    pthread_cond_t p_DoneCond; // Signaled on finished jobs
+    
+    // Waiting proofs, in recieve order
+    MRH_Srv_AuthJob* p_Job; // Guarded, proofs hold passwords
+    size_t us_JobHead;
+    size_t us_JobCount;
+    size_t us_JobMax;
+    
+    MRH_Srv_AuthWorker* p_Worker;
+    int i_WorkerCount;
+    
+    MRH_Srv_AuthCallback p_Callback;
+    void* p_User;
+    
+    int i_Stopped; // 0 once stopping
+};
+
+static int MRH_SRV_GetAuthWorkerMax(int i_WorkerMax)
+{
+    // Each running hash allocates the full hash memory, never run more
+    // hashes than the currently available memory allows
+    long l_PageSize = sysconf(_SC_PAGESIZE);
+    long l_PageCount = sysconf(_SC_AVPHYS_PAGES);
+    int i_MemoryMax = 1;
+    
+    if (l_PageSize > 0 && l_PageCount > 0)
+    {
+        unsigned long long ull_Count = ((unsigned long long)l_PageSize * (unsigned long long)l_PageCount) / MRH_SRV_SIZE_PASSWORD_HASH_MEMORY;
+        
+        if (ull_Count > 1)
+        {
+            i_MemoryMax = ull_Count > INT32_MAX ? INT32_MAX : (int)ull_Count;
+        }
+    }
+    
+    if (i_WorkerMax <= 0)
+    {
+        long l_Processors = sysconf(_SC_NPROCESSORS_ONLN);
+        
+        i_WorkerMax = l_Processors > 0 ? (int)l_Processors : 1;
+    }
+    
+    return i_WorkerMax < i_MemoryMax ? i_WorkerMax : i_MemoryMax;
+}
+
+static uint8_t MRH_SRV_VerifyAuthProof(const MRH_Srv_AuthProof* p_Proof)
+{
+    uint8_t p_Key[MRH_SRV_SIZE_ACCOUNT_PASSWORD];
+    uint32_t u32_Nonce;
+    
+    // A failed hash is our problem (mostly memory), not a wrong password
+    if (MRH_SRV_CreatePasswordHash(p_Key, p_Proof->p_Password, p_Proof->p_Salt, p_Proof->u8_HashType) != 0)
+    {
+        return MRH_SRV_NET_MESSAGE_ERR_SA_MAINTENANCE;
+    }
+    
+    uint8_t u8_Result = MRH_SRV_NET_MESSAGE_ERR_SA_ACCOUNT;
+    
+    if (MRH_SRV_DecryptNonce(&u32_Nonce, p_Proof->p_NonceHash, p_Key) == 0 &&
+        u32_Nonce == p_Proof->u32_Nonce)
+    {
+        u8_Result = MRH_SRV_NET_MESSAGE_ERR_NONE;
+    }
+    
+    sodium_memzero(p_Key, sizeof(p_Key));
+    
+    return u8_Result;
+}
+
+static void* MRH_SRV_AuthWorker(void* p_Context)
+{
+    MRH_Srv_AuthWorker* p_Worker = (MRH_Srv_AuthWorker*)p_Context;
+    MRH_Srv_AuthPool* p_Pool = p_Worker->p_Pool;
+    MRH_Srv_AuthJob c_Job;
+    
+    pthread_mutex_lock(&(p_Pool->p_Mutex));
+    
+    while (p_Pool->i_Stopped != 0)
+    {
+        if (p_Pool->us_JobCount == 0)
+        {
+            pthread_cond_wait(&(p_Pool->p_JobCond), &(p_Pool->p_Mutex));
+            continue;
+        }
+        
+        // Take the oldest proof, the slot is cleared once copied
+        MRH_Srv_AuthJob* p_Job = &(p_Pool->p_Job[p_Pool->us_JobHead]);
+        
+        c_Job = *p_Job;
+        sodium_memzero(p_Job, sizeof(MRH_Srv_AuthJob));
+        
+        p_Pool->us_JobHead = (p_Pool->us_JobHead + 1) % p_Pool->us_JobMax;
+        p_Pool->us_JobCount -= 1;
+        p_Worker->p_Running = c_Job.p_Server;
+        
+        pthread_mutex_unlock(&(p_Pool->p_Mutex));
+        
+        // Hash without the lock, this takes a while
+        MRH_SRV_MSG_AUTH_RESULT_DATA c_Data;
+        c_Data.u8_Result = MRH_SRV_VerifyAuthProof(&(c_Job.c_Proof));
+        sodium_memzero(&(c_Job.c_Proof), sizeof(MRH_Srv_AuthProof));
+        
+        MRH_SRV_SendMessage(c_Job.p_Server, MRH_SRV_MSG_AUTH_RESULT, &c_Data, NULL);
+        
+        if (p_Pool->p_Callback != NULL)
+        {
+            p_Pool->p_Callback(c_Job.p_Server, (c_Data.u8_Result == MRH_SRV_NET_MESSAGE_ERR_NONE) ? 0 : -1, p_Pool->p_User);
+        }
+        
+        pthread_mutex_lock(&(p_Pool->p_Mutex));
+        
+        p_Worker->p_Running = NULL;
+        pthread_cond_broadcast(&(p_Pool->p_DoneCond));
+    }
+    
+    pthread_mutex_unlock(&(p_Pool->p_Mutex));
+    
+    return NULL;
+}
+
+MRH_Srv_AuthPool* MRH_SRV_CreateAuthPool(int i_WorkerMax, size_t us_QueueMax, MRH_Srv_AuthCallback p_Callback, void* p_User)
+{
+    if (us_QueueMax == 0)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return NULL;
+    }
+    
+    MRH_Srv_AuthPool* p_Pool = (MRH_Srv_AuthPool*)malloc(sizeof(MRH_Srv_AuthPool));
+    int i_WorkerCount = MRH_SRV_GetAuthWorkerMax(i_WorkerMax);
+    
+    if (p_Pool == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_MALLOC);
+        return NULL;
+    }
+    else if ((p_Pool->p_Job = (MRH_Srv_AuthJob*)sodium_allocarray(us_QueueMax, sizeof(MRH_Srv_AuthJob))) == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_MALLOC);
+        free(p_Pool);
+        return NULL;
+    }
+    else if ((p_Pool->p_Worker = (MRH_Srv_AuthWorker*)malloc(sizeof(MRH_Srv_AuthWorker) * i_WorkerCount)) == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_MALLOC);
+        sodium_free(p_Pool->p_Job);
+        free(p_Pool);
+        return NULL;
+    }
+    
+    if (pthread_mutex_init(&(p_Pool->p_Mutex), NULL) != 0)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_AUTH_POOL_START);
+        free(p_Pool->p_Worker);
+        sodium_free(p_Pool->p_Job);
+        free(p_Pool);
+        return NULL;
+    }
+    else if (pthread_cond_init(&(p_Pool->p_JobCond), NULL) != 0)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_AUTH_POOL_START);
+        pthread_mutex_destroy(&(p_Pool->p_Mutex));
+        free(p_Pool->p_Worker);
+        sodium_free(p_Pool->p_Job);
+        free(p_Pool);
+        return NULL;
+    }
+    else if (pthread_cond_init(&(p_Pool->p_DoneCond), NULL) != 0)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_AUTH_POOL_START);
+        pthread_cond_destroy(&(p_Pool->p_JobCond));
+        pthread_mutex_destroy(&(p_Pool->p_Mutex));
+        free(p_Pool->p_Worker);
+        sodium_free(p_Pool->p_Job);
+        free(p_Pool);
+        return NULL;
+    }
+    
+    sodium_memzero(p_Pool->p_Job, us_QueueMax * sizeof(MRH_Srv_AuthJob));
+    
+    p_Pool->us_JobHead = 0;
+    p_Pool->us_JobCount = 0;
+    p_Pool->us_JobMax = us_QueueMax;
+    p_Pool->i_WorkerCount = 0;
+    p_Pool->p_Callback = p_Callback;
+    p_Pool->p_User = p_User;
+    p_Pool->i_Stopped = -1;
+    
+    for (int i = 0; i < i_WorkerCount; ++i)
+    {
+        MRH_Srv_AuthWorker* p_Worker = &(p_Pool->p_Worker[i]);
+        
+        p_Worker->p_Pool = p_Pool;
+        p_Worker->p_Running = NULL;
+        
+        if (pthread_create(&(p_Worker->p_Thread), NULL, MRH_SRV_AuthWorker, p_Worker) != 0)
+        {
+            MRH_ERR_SetServerError(MRH_SERVER_ERROR_AUTH_POOL_START);
+            return MRH_SRV_DestroyAuthPool(p_Pool);
+        }
+        
+        p_Pool->i_WorkerCount += 1;
+    }
+    
+    return p_Pool;
+}
+
+MRH_Srv_AuthPool* MRH_SRV_DestroyAuthPool(MRH_Srv_AuthPool* p_Pool)
+{
+    if (p_Pool == NULL)
+    {
+        return NULL;
+    }
+    
+    pthread_mutex_lock(&(p_Pool->p_Mutex));
+    
+    p_Pool->i_Stopped = 0;
+    pthread_cond_broadcast(&(p_Pool->p_JobCond));
+    
+    pthread_mutex_unlock(&(p_Pool->p_Mutex));
+    
+    // Running verifications are finished first
+    for (int i = 0; i < p_Pool->i_WorkerCount; ++i)
+    {
+        pthread_join(p_Pool->p_Worker[i].p_Thread, NULL);
+    }
+    
+    pthread_cond_destroy(&(p_Pool->p_DoneCond));
+    pthread_cond_destroy(&(p_Pool->p_JobCond));
+    pthread_mutex_destroy(&(p_Pool->p_Mutex));
+    
+    // Waiting proofs still hold passwords, freeing wipes them
+    free(p_Pool->p_Worker);
+    sodium_free(p_Pool->p_Job);
+    free(p_Pool);
+    
+    return NULL;
+}
+
+//*************************************************************************************
+// Verify
+//*************************************************************************************
+
+int MRH_SRV_VerifyAuth(MRH_Srv_AuthPool* p_Pool, MRH_Srv_Server* p_Server, const MRH_Srv_AuthProof* p_Proof)
+{
+    if (p_Pool == NULL || p_Server == NULL || p_Proof == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    
+    pthread_mutex_lock(&(p_Pool->p_Mutex));
+    
+    if (p_Pool->us_JobCount == p_Pool->us_JobMax)
+    {
+        pthread_mutex_unlock(&(p_Pool->p_Mutex));
+        
+        // Tell the client to retry later instead of waiting for a hash
+        MRH_SRV_MSG_AUTH_RESULT_DATA c_Data;
+        c_Data.u8_Result = MRH_SRV_NET_MESSAGE_ERR_SA_MAINTENANCE;
+        
+        MRH_SRV_SendMessage(p_Server, MRH_SRV_MSG_AUTH_RESULT, &c_Data, NULL);
+        
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_AUTH_POOL_FULL);
+        return -1;
+    }
+    
+    MRH_Srv_AuthJob* p_Job = &(p_Pool->p_Job[(p_Pool->us_JobHead + p_Pool->us_JobCount) % p_Pool->us_JobMax]);
+    
+    p_Job->p_Server = p_Server;
+    memcpy(&(p_Job->c_Proof), p_Proof, sizeof(MRH_Srv_AuthProof));
+    
+    p_Pool->us_JobCount += 1;
+    
+    pthread_cond_signal(&(p_Pool->p_JobCond));
+    pthread_mutex_unlock(&(p_Pool->p_Mutex));
+    
+    return 0;
+}
+
+int MRH_SRV_IsAuthSaturated(MRH_Srv_AuthPool* p_Pool)
+{
+    if (p_Pool == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    
+    pthread_mutex_lock(&(p_Pool->p_Mutex));
+    
+    int i_Result = (p_Pool->us_JobCount == p_Pool->us_JobMax ? 0 : -1);
+    
+    pthread_mutex_unlock(&(p_Pool->p_Mutex));
+    
+    return i_Result;
+}
+
+void MRH_SRV_CancelAuth(MRH_Srv_AuthPool* p_Pool, MRH_Srv_Server* p_Server)
+{
+    if (p_Pool == NULL || p_Server == NULL)
+    {
+        return;
+    }
+    
+    pthread_mutex_lock(&(p_Pool->p_Mutex));
+    
+    // Compact the waiting proofs, keeping the order of the other clients
+    size_t us_Kept = 0;
+    
+    for (size_t i = 0; i < p_Pool->us_JobCount; ++i)
+    {
+        MRH_Srv_AuthJob* p_Job = &(p_Pool->p_Job[(p_Pool->us_JobHead + i) % p_Pool->us_JobMax]);
+        
+        if (p_Job->p_Server != p_Server)
+        {
+            MRH_Srv_AuthJob* p_Keep = &(p_Pool->p_Job[(p_Pool->us_JobHead + us_Kept) % p_Pool->us_JobMax]);
+            
+            if (p_Keep != p_Job)
+            {
+                *p_Keep = *p_Job;
+            }
+            
+            us_Kept += 1;
+        }
+    }
+    
+    for (size_t i = us_Kept; i < p_Pool->us_JobCount; ++i)
+    {
+        sodium_memzero(&(p_Pool->p_Job[(p_Pool->us_JobHead + i) % p_Pool->us_JobMax]), sizeof(MRH_Srv_AuthJob));
+    }
+    
+    p_Pool->us_JobCount = us_Kept;
+    
+    // Wait for running verifications of the client
+    for (int i = 0; i < p_Pool->i_WorkerCount; ++i)
+    {
+        while (p_Pool->p_Worker[i].p_Running == p_Server)
+        {
+            pthread_cond_wait(&(p_Pool->p_DoneCond), &(p_Pool->p_Mutex));
+        }
+    }
+    
+    pthread_mutex_unlock(&(p_Pool->p_Mutex));
+}
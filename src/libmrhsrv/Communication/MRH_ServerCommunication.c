@@ -22,6 +22,9 @@
  */
 
 // C
+#include <stdlib.h>
+#include <stdbool.h>
+#include <limits.h>
 #include <time.h>
 #include <string.h>
 
@@ -36,6 +39,10 @@
 #include "./MsQuic/MRH_MsQuic.h"
 
 // Pre-defined
+#define MRH_SRV_CIPHER_FLAG 0x40 // Set on the message id if the data uses the AEAD cipher
+#define MRH_SRV_CIPHER_SHORT_FLAG 0x20 // Set with MRH_SRV_CIPHER_FLAG if only the nonce counter is sent
+#define MRH_SRV_CIPHER_MASK (MRH_SRV_CIPHER_FLAG | MRH_SRV_CIPHER_SHORT_FLAG)
+#define MRH_SRV_CIPHER_COUNTER_SIZE 8 // Counter nonces are [Prefix][Counter (uint64_t, LE)]
 /*
 #if crypto_box_SEEDBYTES != crypto_box_KEYBYTES // Warn, code relies on this
     #error "Seed bytes not equal key bytes, encryption / decryption will fail!"
@@ -47,9 +54,43 @@
 // Connection
 //*************************************************************************************
 
-int MRH_SRV_Connect(MRH_Srv_Context* p_Context, MRH_Srv_Server* p_Server, const char* p_Address, int i_Port, int i_WaitS)
+static inline int MRH_SRV_GetWaitMS(int i_WaitS)
+{
+    // Long waits are capped instead of overflowing
+    return (i_WaitS > INT_MAX / 1000) ? INT_MAX : i_WaitS * 1000;
+}
+
+typedef struct MRH_SRV_ConnectBarrier_t
+{
+    pthread_mutex_t p_Mutex;
+    pthread_cond_t p_Cond;
+    
+    size_t us_Pending;
+    _Atomic(size_t) us_Reference; // Waiting caller and every pending connection
+    
+}MRH_SRV_ConnectBarrier;
+
+static void MRH_SRV_ConnectComplete(void* p_Context, int i_Result)
+{
+    MRH_Srv_Server* p_Server = (MRH_Srv_Server*)p_Context;
+    MRH_Srv_ConnectCallback p_Callback = p_Server->p_ConnectCallback;
+    
+    if (p_Callback != NULL)
+    {
+        p_Callback(p_Server, i_Result, p_Server->p_ConnectUser);
+    }
+}
+
+static inline int MRH_SRV_IsReconnectThread(MRH_Srv_Server* p_Server)
+{
+    return (p_Server->i_ReconnectRun == 0 && pthread_equal(pthread_self(), p_Server->p_ReconnectThread)) ? 0 : -1;
+}
+
+static int MRH_SRV_StartConnection(MRH_Srv_Context* p_Context, MRH_Srv_Server* p_Server, const char* p_Address, int i_Port, MRH_Srv_ConnectCallback p_Callback, void* p_User, int i_Reconnect)
 {
-    if (p_Server == NULL || p_Address == NULL || i_Port <= 0)
+    // @NOTE: Server contexts only accept connections
+    if (p_Context == NULL || p_Server == NULL || p_Address == NULL || i_Port <= 0 ||
+        p_Context->u8_DeviceType == MRH_SRV_SERVER)
     {
         MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
         return -1;
@@ -63,25 +104,108 @@ int MRH_SRV_Connect(MRH_Srv_Context* p_Context, MRH_Srv_Server* p_Server, const
     MRH_MsQuicConnection* p_MsQuic = p_Server->p_MsQuic;
     HQUIC p_NewConnection;
     
-    if (QUIC_FAILED(p_MsQuic->p_MsQuicAPI->ConnectionOpen(p_Context->p_MsQuicRegistration,
+    p_Server->p_ConnectCallback = p_Callback;
+    p_Server->p_ConnectUser = p_User;
+    
+    p_MsQuic->p_ConnectContext = p_Server;
+    p_MsQuic->p_ConnectCallback = (p_Callback != NULL) ? MRH_SRV_ConnectComplete : NULL;
+    
+    // Lost connections are restored if a reconnect policy is set, reconnects
+    // keep the flag to not undo a wanted disconnect
+    if (i_Reconnect != 0)
+    {
+        pthread_mutex_lock(&(p_MsQuic->p_StateMutex));
+        p_MsQuic->i_Replay = p_Server->i_ReconnectRun;
+        pthread_mutex_unlock(&(p_MsQuic->p_StateMutex));
+    }
+    
+    p_MsQuic->p_Tickets = p_Context->p_MsQuicTickets;
+    p_MsQuic->p_TicketAddress = p_Server->p_Address;
+    p_MsQuic->i_TicketPort = p_Server->i_Port;
+    
+    // Keep tickets recieved by earlier connections, failing only loses resumption
+    MRH_MsQuicSaveTickets(p_Context->p_MsQuicTickets);
+    
+    QUIC_STATUS ui_Status;
+    
+    if (p_Server->i_Partition < 0)
+    {
+        ui_Status = p_MsQuic->p_MsQuicAPI->ConnectionOpen(p_Context->p_MsQuicRegistration,
                                                           (void*)MRH_MsQuicConnectionCallback,
                                                           p_MsQuic,
-                                                          &p_NewConnection)))
+                                                          &p_NewConnection);
+    }
+    else
     {
+        ui_Status = p_MsQuic->p_MsQuicAPI->ConnectionOpenInPartition(p_Context->p_MsQuicRegistration,
+                                                                     (uint16_t)p_Server->i_Partition,
+                                                                     (void*)MRH_MsQuicConnectionCallback,
+                                                                     p_MsQuic,
+                                                                     &p_NewConnection);
+    }
+    
+    if (QUIC_FAILED(ui_Status))
+    {
+        p_MsQuic->p_ConnectCallback = NULL;
         MRH_ERR_SetServerError(MRH_SERVER_ERROR_AUTH_CONNECTION_CREATE);
         return -1;
     }
-    else if (QUIC_FAILED(p_MsQuic->p_MsQuicAPI->ConnectionStart(p_NewConnection,
-                                                                p_Context->p_MsQuicConfiguration,
-                                                                QUIC_ADDRESS_FAMILY_UNSPEC,
-                                                                p_Server->p_Address,
-                                                                p_Server->i_Port)))
+    
+    // Resume with a known ticket, allows 0-RTT for the first auth request
+    p_MsQuic->i_ZeroRTT = MRH_MsQuicApplyTicket(p_Context->p_MsQuicTickets,
+                                                p_MsQuic->p_MsQuicAPI,
+                                                p_NewConnection,
+                                                p_Server->p_Address,
+                                                p_Server->i_Port);
+    
+    // @NOTE: Set before starting, the callback might complete the shutdown at any time.
+    //        Disconnects only see published handles, so reconnects check for
+    //        them together with publishing.
+    pthread_mutex_lock(&(p_MsQuic->p_StateMutex));
+    
+    int i_Abort = (i_Reconnect == 0 && (p_MsQuic->i_Replay != 0 || p_MsQuic->p_Handle != NULL)) ? -1 : 0;
+    
+    if (i_Abort == 0)
+    {
+        p_MsQuic->p_Handle = p_NewConnection;
+    }
+    
+    pthread_mutex_unlock(&(p_MsQuic->p_StateMutex));
+    
+    if (i_Abort != 0)
+    {
+        p_MsQuic->p_ConnectCallback = NULL;
+        p_MsQuic->i_ZeroRTT = -1;
+        p_Context->p_MsQuicAPI->ConnectionClose(p_NewConnection);
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_AUTH_CONNECTION_START);
+        return -1;
+    }
+    
+    if (QUIC_FAILED(p_MsQuic->p_MsQuicAPI->ConnectionStart(p_NewConnection,
+                                                           p_Context->p_MsQuicConfiguration,
+                                                           QUIC_ADDRESS_FAMILY_UNSPEC,
+                                                           p_Server->p_Address,
+                                                           p_Server->i_Port)))
     {
+        // @NOTE: Closing a connection which never started does not call the callback
+        p_MsQuic->p_ConnectCallback = NULL;
+        p_MsQuic->i_ZeroRTT = -1;
+        p_MsQuic->p_Handle = NULL;
         p_Context->p_MsQuicAPI->ConnectionClose(p_NewConnection);
         MRH_ERR_SetServerError(MRH_SERVER_ERROR_AUTH_CONNECTION_START);
         return -1;
     }
     
+    return 0;
+}
+
+int MRH_SRV_Connect(MRH_Srv_Context* p_Context, MRH_Srv_Server* p_Server, const char* p_Address, int i_Port, int i_WaitS)
+{
+    if (MRH_SRV_StartConnection(p_Context, p_Server, p_Address, i_Port, NULL, NULL, -1) != 0)
+    {
+        return -1;
+    }
+    
     // Should we wait here for connection success?
     if (i_WaitS < 0)
     {
@@ -89,19 +213,136 @@ int MRH_SRV_Connect(MRH_Srv_Context* p_Context, MRH_Srv_Server* p_Server, const
     }
     
     // Wait for the connection to be set
-    time_t u32_EndTimeS = time(NULL) + (i_WaitS);
+    return MRH_MsQuicWaitConnection(p_Server->p_MsQuic, 0, MRH_SRV_GetWaitMS(i_WaitS));
+}
+
+int MRH_SRV_ConnectAsync(MRH_Srv_Context* p_Context, MRH_Srv_Server* p_Server, const char* p_Address, int i_Port, MRH_Srv_ConnectCallback p_Callback, void* p_User)
+{
+    return MRH_SRV_StartConnection(p_Context, p_Server, p_Address, i_Port, p_Callback, p_User, -1);
+}
+
+static void MRH_SRV_ReleaseBarrier(MRH_SRV_ConnectBarrier* p_Barrier)
+{
+    if (atomic_fetch_sub(&(p_Barrier->us_Reference), 1) == 1)
+    {
+        pthread_cond_destroy(&(p_Barrier->p_Cond));
+        pthread_mutex_destroy(&(p_Barrier->p_Mutex));
+        free(p_Barrier);
+    }
+}
+
+static void MRH_SRV_ConnectAllComplete(MRH_Srv_Server* p_Server, int i_Result, void* p_User)
+{
+    MRH_SRV_ConnectBarrier* p_Barrier = (MRH_SRV_ConnectBarrier*)p_User;
+    
+    // @NOTE: Results are read from each server once all completed
+    (void)p_Server;
+    (void)i_Result;
+    
+    pthread_mutex_lock(&(p_Barrier->p_Mutex));
+    
+    if ((p_Barrier->us_Pending -= 1) == 0)
+    {
+        pthread_cond_signal(&(p_Barrier->p_Cond));
+    }
+    
+    pthread_mutex_unlock(&(p_Barrier->p_Mutex));
+    
+    // @NOTE: The caller might have stopped waiting already
+    MRH_SRV_ReleaseBarrier(p_Barrier);
+}
+
+int MRH_SRV_ConnectAll(MRH_Srv_Context* p_Context, MRH_Srv_ConnectEntry* p_Entry, size_t us_Count, int i_WaitS)
+{
+    if (p_Context == NULL || p_Entry == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    
+    // @NOTE: Allocated, callbacks can outlive a timed out wait
+    MRH_SRV_ConnectBarrier* p_Barrier = (MRH_SRV_ConnectBarrier*)malloc(sizeof(MRH_SRV_ConnectBarrier));
+    pthread_condattr_t p_CondAttr;
     
-    while (time(NULL) < u32_EndTimeS)
+    if (p_Barrier == NULL)
     {
-        if (p_MsQuic->p_Connection != NULL)
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_MALLOC);
+        return -1;
+    }
+    else if (pthread_mutex_init(&(p_Barrier->p_Mutex), NULL) != 0)
+    {
+        free(p_Barrier);
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_MALLOC);
+        return -1;
+    }
+    else if (pthread_condattr_init(&p_CondAttr) != 0 ||
+             pthread_condattr_setclock(&p_CondAttr, CLOCK_MONOTONIC) != 0 ||
+             pthread_cond_init(&(p_Barrier->p_Cond), &p_CondAttr) != 0)
+    {
+        pthread_mutex_destroy(&(p_Barrier->p_Mutex));
+        free(p_Barrier);
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_MALLOC);
+        return -1;
+    }
+    
+    pthread_condattr_destroy(&p_CondAttr);
+    
+    p_Barrier->us_Pending = us_Count;
+    atomic_init(&(p_Barrier->us_Reference), us_Count + 1);
+    
+    // Start all connections first
+    for (size_t i = 0; i < us_Count; ++i)
+    {
+        if (MRH_SRV_StartConnection(p_Context,
+                                    p_Entry[i].p_Server,
+                                    p_Entry[i].p_Address,
+                                    p_Entry[i].i_Port,
+                                    MRH_SRV_ConnectAllComplete,
+                                    p_Barrier,
+                                    -1) != 0)
         {
-            return 0;
+            // No callback for this one, complete it here
+            MRH_SRV_ConnectAllComplete(p_Entry[i].p_Server, -1, p_Barrier);
         }
-        
-        sleep(1);
     }
     
-    return -1;
+    // Now wait for all of them together
+    struct timespec s_End;
+    
+    if (i_WaitS >= 0)
+    {
+        MRH_MsQuicGetDeadline(&s_End, MRH_SRV_GetWaitMS(i_WaitS));
+    }
+    
+    pthread_mutex_lock(&(p_Barrier->p_Mutex));
+    
+    while (p_Barrier->us_Pending > 0)
+    {
+        if (i_WaitS < 0)
+        {
+            pthread_cond_wait(&(p_Barrier->p_Cond), &(p_Barrier->p_Mutex));
+        }
+        else if (pthread_cond_timedwait(&(p_Barrier->p_Cond), &(p_Barrier->p_Mutex), &s_End) != 0)
+        {
+            break;
+        }
+    }
+    
+    pthread_mutex_unlock(&(p_Barrier->p_Mutex));
+    MRH_SRV_ReleaseBarrier(p_Barrier);
+    
+    // Set results
+    int i_Result = 0;
+    
+    for (size_t i = 0; i < us_Count; ++i)
+    {
+        if ((p_Entry[i].i_Result = MRH_SRV_IsConnected(p_Entry[i].p_Server)) != 0)
+        {
+            i_Result = -1;
+        }
+    }
+    
+    return i_Result;
 }
 
 int MRH_SRV_CreatePasswordHash(uint8_t* p_Buffer, const char* p_Password, const char* p_Salt, uint8_t u8_HashType)
@@ -126,7 +367,7 @@ int MRH_SRV_CreatePasswordHash(uint8_t* p_Buffer, const char* p_Password, const
     {
         case 0:
             ull_OpsLimit = crypto_pwhash_OPSLIMIT_INTERACTIVE;
-            us_MemLimit = 128 * 1024 * 1024;//crypto_pwhash_argon2id_MEMLIMIT_SENSITIVE;
+            us_MemLimit = MRH_SRV_SIZE_PASSWORD_HASH_MEMORY;//crypto_pwhash_argon2id_MEMLIMIT_SENSITIVE;
             i_Alg = crypto_pwhash_ALG_ARGON2ID13;
             break;
             
@@ -151,6 +392,33 @@ int MRH_SRV_CreatePasswordHash(uint8_t* p_Buffer, const char* p_Password, const
     return 0;
 }
 
+int MRH_SRV_CreatePasswordHashCached(MRH_Srv_Context* p_Context, uint8_t* p_Buffer, const char* p_Account, const char* p_Password, const char* p_Salt, uint8_t u8_HashType)
+{
+    if (p_Context == NULL || p_Buffer == NULL || p_Account == NULL || p_Password == NULL || p_Salt == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    else if (p_Context->p_KeyCache == NULL)
+    {
+        return MRH_SRV_CreatePasswordHash(p_Buffer, p_Password, p_Salt, u8_HashType);
+    }
+    
+    // Same salt as before, skip the hash
+    if (MRH_SRV_FindCachedKey(p_Context->p_KeyCache, p_Buffer, p_Account, p_Password, p_Salt, u8_HashType) == 0)
+    {
+        return 0;
+    }
+    else if (MRH_SRV_CreatePasswordHash(p_Buffer, p_Password, p_Salt, u8_HashType) != 0)
+    {
+        return -1;
+    }
+    
+    MRH_SRV_StoreCachedKey(p_Context->p_KeyCache, p_Buffer, p_Account, p_Password, p_Salt, u8_HashType);
+    
+    return 0;
+}
+
 int MRH_SRV_EncryptNonce(uint8_t* p_Buffer, uint32_t u32_Nonce, const uint8_t* p_Password)
 {
     if (p_Buffer == NULL || p_Password == NULL)
@@ -203,13 +471,29 @@ int MRH_SRV_DecryptNonce(uint32_t* p_Nonce, const uint8_t* p_EncryptedNonce, con
 
 void MRH_SRV_Disconnect(MRH_Srv_Server* p_Server, int i_WaitS)
 {
-    if (p_Server == NULL || p_Server->p_MsQuic->p_Connection == NULL)
+    if (p_Server == NULL)
+    {
+        return;
+    }
+    
+    // Wanted disconnect, don't reconnect and drop kept messages
+    // @NOTE: Use the handle, connections still connecting are shut down too.
+    //        Reconnects publish their handle under the same lock.
+    pthread_mutex_lock(&(p_Server->p_MsQuic->p_StateMutex));
+    
+    p_Server->p_MsQuic->i_Replay = -1;
+    HQUIC p_QuicConnection = p_Server->p_MsQuic->p_Handle;
+    
+    pthread_cond_broadcast(&(p_Server->p_MsQuic->p_StateCond));
+    pthread_mutex_unlock(&(p_Server->p_MsQuic->p_StateMutex));
+    
+    if (p_QuicConnection == NULL)
     {
         return;
     }
     
     // Perform connection shutdown
-    p_Server->p_MsQuic->p_MsQuicAPI->ConnectionShutdown(p_Server->p_MsQuic->p_Connection,
+    p_Server->p_MsQuic->p_MsQuicAPI->ConnectionShutdown(p_QuicConnection,
                                                         QUIC_CONNECTION_SHUTDOWN_FLAG_NONE,
                                                         0);
     
@@ -220,17 +504,7 @@ void MRH_SRV_Disconnect(MRH_Srv_Server* p_Server, int i_WaitS)
     }
     
     // Wait for the connection to be disconnected
-    time_t u32_EndTimeS = time(NULL) + (i_WaitS);
-    
-    while (time(NULL) < u32_EndTimeS)
-    {
-        if (p_Server->p_MsQuic->p_Connection == NULL)
-        {
-            return;
-        }
-        
-        sleep(1);
-    }
+    MRH_MsQuicWaitConnection(p_Server->p_MsQuic, -1, MRH_SRV_GetWaitMS(i_WaitS));
 }
 
 int MRH_SRV_IsConnected(MRH_Srv_Server* p_Server)
@@ -247,24 +521,37 @@ int MRH_SRV_IsConnected(MRH_Srv_Server* p_Server)
 // Encryption
 //*************************************************************************************
 
-static inline size_t MRH_SRV_GetEncryptedSize(size_t us_MessageSize)
+static inline size_t MRH_SRV_GetEncryptedSize(MRH_Srv_Cipher e_Cipher, size_t us_MessageSize)
 {
-    // Messages are [Nonce][Encrypted Buffer (MAC + Message Bytes)]
-    return crypto_secretbox_NONCEBYTES +
-           crypto_secretbox_MACBYTES +
-           us_MessageSize;
+    switch (e_Cipher)
+    {
+        // Messages are [Nonce][Encrypted Buffer (Message Bytes + Tag)]
+        case MRH_SRV_CIPHER_XCHACHA20:
+            return crypto_aead_xchacha20poly1305_ietf_NPUBBYTES +
+                   crypto_aead_xchacha20poly1305_ietf_ABYTES +
+                   us_MessageSize;
+            
+        // Messages are [Counter][Encrypted Buffer (Message Bytes + Tag)]
+        case MRH_SRV_CIPHER_XCHACHA20_SHORT:
+            return MRH_SRV_CIPHER_COUNTER_SIZE +
+                   crypto_aead_xchacha20poly1305_ietf_ABYTES +
+                   us_MessageSize;
+            
+        // Messages are [Nonce][Encrypted Buffer (MAC + Message Bytes)]
+        default:
+            return crypto_secretbox_NONCEBYTES +
+                   crypto_secretbox_MACBYTES +
+                   us_MessageSize;
+    }
 }
 
-static int MRH_SRV_Encrypt(uint8_t* p_EncryptedBuffer, const uint8_t* p_MessageBuffer, size_t us_MessageSize, const char* p_Password)
+static int MRH_SRV_Encrypt(uint8_t* p_EncryptedBuffer, const uint8_t* p_MessageBuffer, size_t us_MessageSize, const uint8_t* p_Key)
 {
-    if (p_Password == NULL)
+    if (p_Key == NULL)
     {
         return -1;
     }
     
-    unsigned char p_Key[crypto_secretbox_KEYBYTES] = { '\0' };
-    memcpy(p_Key, p_Password, crypto_secretbox_KEYBYTES);
-    
     unsigned char p_Nonce[crypto_secretbox_NONCEBYTES] = { '\0' };
     randombytes_buf(p_Nonce, crypto_secretbox_NONCEBYTES);
     memcpy(p_EncryptedBuffer, p_Nonce, crypto_secretbox_NONCEBYTES);
@@ -281,16 +568,13 @@ static int MRH_SRV_Encrypt(uint8_t* p_EncryptedBuffer, const uint8_t* p_MessageB
     return 0;
 }
 
-static int MRH_SRV_Decrypt(uint8_t* p_MessageBuffer, const uint8_t* p_EncryptedBuffer, size_t us_EncryptedSize, const char* p_Password)
+static int MRH_SRV_Decrypt(uint8_t* p_MessageBuffer, const uint8_t* p_EncryptedBuffer, size_t us_EncryptedSize, const uint8_t* p_Key)
 {
-    if (p_Password == NULL)
+    if (p_Key == NULL)
     {
         return -1;
     }
     
-    unsigned char p_Key[crypto_secretbox_KEYBYTES] = { '\0' };
-    memcpy(p_Key, p_Password, crypto_secretbox_KEYBYTES);
-    
     unsigned char p_Nonce[crypto_secretbox_NONCEBYTES] = { '\0' };
     memcpy(p_Nonce, p_EncryptedBuffer, crypto_secretbox_NONCEBYTES);
     
@@ -306,166 +590,494 @@ static int MRH_SRV_Decrypt(uint8_t* p_MessageBuffer, const uint8_t* p_EncryptedB
     return 0;
 }
 
-//*************************************************************************************
-// Recieve
-//*************************************************************************************
-
-MRH_Srv_NetMessage MRH_SRV_RecieveMessage(MRH_Srv_Server* p_Server, uint8_t* p_Buffer, const char* p_Password)
+static int MRH_SRV_EncryptAEAD(uint8_t* p_EncryptedBuffer, const uint8_t* p_MessageBuffer, size_t us_MessageSize, uint8_t u8_Message, MRH_Srv_Server* p_Server, const uint8_t* p_Key)
 {
-    if (p_Server == NULL || p_Buffer == NULL)
+    if (p_Key == NULL)
     {
-        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
-        return MRH_SRV_MSG_UNK;
+        return -1;
     }
     
-    MRH_MsQuicConnection* p_MsQuic = p_Server->p_MsQuic;
+    // Counter nonces never repeat for the same prefix, no random bytes needed
+    uint64_t u64_Counter = atomic_fetch_add(&(p_Server->u64_SendCounter), 1);
+    unsigned char p_Nonce[crypto_aead_xchacha20poly1305_ietf_NPUBBYTES];
     
-    memset(p_Buffer, '\0', MRH_SRV_SIZE_MESSAGE_BUFFER_MAX);
+    memcpy(p_Nonce, p_Server->p_SendPrefix, MRH_SRV_SIZE_CIPHER_PREFIX);
+    
+    for (size_t i = 0; i < MRH_SRV_CIPHER_COUNTER_SIZE; ++i)
+    {
+        p_Nonce[MRH_SRV_SIZE_CIPHER_PREFIX + i] = (unsigned char)((u64_Counter >> (i * 8)) & 0xFF);
+    }
+    
+    // Short nonces only send the counter, the prefix is known by the other side
+    size_t us_NonceSize = (p_Server->e_Cipher == MRH_SRV_CIPHER_XCHACHA20_SHORT) ? MRH_SRV_CIPHER_COUNTER_SIZE : crypto_aead_xchacha20poly1305_ietf_NPUBBYTES;
+    memcpy(p_EncryptedBuffer, &(p_Nonce[crypto_aead_xchacha20poly1305_ietf_NPUBBYTES - us_NonceSize]), us_NonceSize);
+    
+    // @NOTE: The message id is authenticated, not encrypted
+    if (crypto_aead_xchacha20poly1305_ietf_encrypt(&(p_EncryptedBuffer[us_NonceSize]),
+                                                   NULL,
+                                                   p_MessageBuffer,
+                                                   us_MessageSize,
+                                                   &u8_Message,
+                                                   1,
+                                                   NULL,
+                                                   p_Nonce,
+                                                   p_Key) != 0)
+    {
+        return -1;
+    }
+    
+    return 0;
+}
+
+static int MRH_SRV_CheckCounter(MRH_Srv_Server* p_Server, const unsigned char* p_Nonce)
+{
+    uint64_t u64_Counter = 0;
+    
+    for (size_t i = 0; i < MRH_SRV_CIPHER_COUNTER_SIZE; ++i)
+    {
+        u64_Counter |= ((uint64_t)(p_Nonce[MRH_SRV_SIZE_CIPHER_PREFIX + i])) << (i * 8);
+    }
+    
+    uint64_t* p_Window = p_Server->p_RecieveWindow;
     
-    for (size_t i = 0; i < MRH_SRV_MESSAGE_BUFFER_COUNT; ++i)
+    // Messages use many streams and priorities, counters arrive out of order within the window
+    if (p_Server->i_RecieveCounter != 0 || u64_Counter > p_Server->u64_RecieveCounter)
     {
-        if (p_MsQuic->p_Recieved[i].i_State != MRH_MSQ_MESSAGE_COMPLETE)
+        // Bits of counters which left the window are reused for the new ones
+        if (p_Server->i_RecieveCounter != 0 || u64_Counter - p_Server->u64_RecieveCounter >= MRH_SRV_CIPHER_REPLAY_WINDOW)
         {
-            continue;
+            memset(p_Window, 0, sizeof(p_Server->p_RecieveWindow));
         }
-        
-        // Needs to be decrypted?
-        switch (p_MsQuic->p_Recieved[i].p_Buffer[0])
+        else
         {
-            case MRH_SRV_MSG_TEXT:
-            case MRH_SRV_MSG_LOCATION:
-            case MRH_SRV_MSG_CUSTOM:
-                // @NOTE: Exclude message id from decryption!
-                if (MRH_SRV_Decrypt(&(p_Buffer[1]),
-                                    &(p_MsQuic->p_Recieved[i].p_Buffer[1]),
-                                    p_MsQuic->p_Recieved[i].us_SizeCur - 1,
-                                    p_Password) < 0)
-                {
-                    MRH_ERR_SetServerError(MRH_SERVER_ERROR_ENCRYPTION_FAILED);
-                    p_Buffer[0] = MRH_SRV_MSG_UNK;
-                }
-                else
-                {
-                    p_Buffer[0] = p_MsQuic->p_Recieved[i].p_Buffer[0];
-                }
-                break;
-                
-            default:
-                // No encprytion, simply copy
-                memcpy(p_Buffer,
-                       &(p_MsQuic->p_Recieved[i].p_Buffer[0]),
-                       p_MsQuic->p_Recieved[i].us_SizeCur);
-                break;
-                
+            for (uint64_t u64_Clear = p_Server->u64_RecieveCounter + 1; u64_Clear <= u64_Counter; ++u64_Clear)
+            {
+                p_Window[(u64_Clear % MRH_SRV_CIPHER_REPLAY_WINDOW) / 64] &= ~(1ULL << (u64_Clear % 64));
+            }
         }
         
-        // Set as read
-        p_MsQuic->p_Recieved[i].i_State = MRH_MSQ_MESSAGE_FREE;
-        
-        // Return net message id
-        return (MRH_Srv_NetMessage)(p_Buffer[0]);
+        p_Server->u64_RecieveCounter = u64_Counter;
+        p_Server->i_RecieveCounter = 0;
     }
-    
-    // Nothing
-    return MRH_SRV_MSG_UNK;
-}
-
-int MRH_SRV_SetNetMessage(void* p_Message, const uint8_t* p_Buffer)
-{
-    if (p_Message == NULL || p_Buffer == NULL)
+    else if (p_Server->u64_RecieveCounter - u64_Counter >= MRH_SRV_CIPHER_REPLAY_WINDOW)
     {
-        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
         return -1;
     }
     
-    switch (p_Buffer[0]) // 0 = Net Message ID
+    size_t us_Word = (u64_Counter % MRH_SRV_CIPHER_REPLAY_WINDOW) / 64;
+    uint64_t u64_Bit = 1ULL << (u64_Counter % 64);
+    
+    if ((p_Window[us_Word] & u64_Bit) != 0)
     {
-        /**
-         *  Net Message Version 1
-         */
-        
-        // Server Auth
-        case MRH_SRV_MSG_AUTH_CHALLENGE:
-            TO_MRH_SRV_MSG_AUTH_CHALLENGE((MRH_SRV_MSG_AUTH_CHALLENGE_DATA*)p_Message,
-                                          &(p_Buffer[1]));
-            break;
-        case MRH_SRV_MSG_AUTH_RESULT:
-            TO_MRH_SRV_MSG_AUTH_RESULT((MRH_SRV_MSG_AUTH_RESULT_DATA*)p_Message,
-                                       &(p_Buffer[1]));
-            break;
-            
-        // Communication
-        case MRH_SRV_MSG_TEXT:
-            TO_MRH_SRV_MSG_TEXT((MRH_SRV_MSG_TEXT_DATA*)p_Message,
-                                &(p_Buffer[1]));
-            break;
-        case MRH_SRV_MSG_LOCATION:
-            TO_MRH_SRV_MSG_LOCATION((MRH_SRV_MSG_LOCATION_DATA*)p_Message,
-                                    &(p_Buffer[1]));
-            break;
-        case MRH_SRV_MSG_CUSTOM:
-            TO_MRH_SRV_MSG_CUSTOM((MRH_SRV_MSG_CUSTOM_DATA*)p_Message,
-                                  &(p_Buffer[1]));
-            break;
-            
-        /**
-         *  Default (No Data, Unknown, Not Readable, etc.)
-         */
-            
-        default:
-            MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
-            return -1;
+        return -1;
     }
     
+    p_Window[us_Word] |= u64_Bit;
     return 0;
 }
 
-//*************************************************************************************
-// Send
-//*************************************************************************************
-
-int MRH_SRV_SendMessage(MRH_Srv_Server* p_Server, MRH_Srv_NetMessage e_Message, const void* p_Data, const char* p_Password)
+static int MRH_SRV_DecryptAEAD(uint8_t* p_MessageBuffer, const uint8_t* p_EncryptedBuffer, size_t us_EncryptedSize, uint8_t u8_Message, MRH_Srv_Cipher e_Cipher, MRH_Srv_Server* p_Server, const uint8_t* p_Key)
 {
-    if (p_Server == NULL)
+    if (p_Key == NULL || (e_Cipher == MRH_SRV_CIPHER_XCHACHA20_SHORT && p_Server->i_RecievePrefix != 0))
     {
-        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
         return -1;
     }
     
-    // Find the server for the channel
-    MRH_MsQuicConnection* p_MsQuic = p_Server->p_MsQuic;
+    unsigned char p_Nonce[crypto_aead_xchacha20poly1305_ietf_NPUBBYTES];
+    size_t us_NonceSize;
     
-    if (p_MsQuic->p_Connection == NULL)
+    if (e_Cipher == MRH_SRV_CIPHER_XCHACHA20_SHORT)
     {
-        MRH_ERR_SetServerError(MRH_SERVER_ERROR_SEND_DISCONNECTED);
-        return -1;
+        memcpy(p_Nonce, p_Server->p_RecievePrefix, MRH_SRV_SIZE_CIPHER_PREFIX);
+        us_NonceSize = MRH_SRV_CIPHER_COUNTER_SIZE;
+    }
+    else
+    {
+        us_NonceSize = crypto_aead_xchacha20poly1305_ietf_NPUBBYTES;
     }
     
-    // Now create send buffer
-    MRH_MsQuicMessage* p_Message = NULL;
+    memcpy(&(p_Nonce[crypto_aead_xchacha20poly1305_ietf_NPUBBYTES - us_NonceSize]), p_EncryptedBuffer, us_NonceSize);
     
-    for (size_t i = 0; i < MRH_SRV_MESSAGE_BUFFER_COUNT; ++i)
+    if (crypto_aead_xchacha20poly1305_ietf_decrypt(p_MessageBuffer,
+                                                   NULL,
+                                                   NULL,
+                                                   &(p_EncryptedBuffer[us_NonceSize]),
+                                                   us_EncryptedSize - us_NonceSize,
+                                                   &u8_Message,
+                                                   1,
+                                                   p_Nonce,
+                                                   p_Key) != 0)
     {
-        if (p_MsQuic->p_Send[i].i_State == MRH_MSQ_MESSAGE_FREE ||
-            p_MsQuic->p_Send[i].i_State == MRH_MSQ_MESSAGE_COMPLETE)
+        return -1;
+    }
+    
+    // Only counters of the known prefix can be tracked, checked once authenticated
+    if (p_Server->i_RecievePrefix == 0 &&
+        sodium_memcmp(p_Nonce, p_Server->p_RecievePrefix, MRH_SRV_SIZE_CIPHER_PREFIX) == 0 &&
+        MRH_SRV_CheckCounter(p_Server, p_Nonce) < 0)
+    {
+        sodium_memzero(p_MessageBuffer, us_EncryptedSize - us_NonceSize - crypto_aead_xchacha20poly1305_ietf_ABYTES);
+        return -2; // Authentic, but replayed
+    }
+    
+    return 0;
+}
+
+static inline const uint8_t* MRH_SRV_GetKey(MRH_Srv_Server* p_Server, const char* p_Password)
+{
+    // @NOTE: Passwords are used as keys directly (KEYBYTES == SIZE_DEVICE_PASSWORD)
+    return (p_Password != NULL) ? (const uint8_t*)p_Password : p_Server->p_SessionKey;
+}
+
+//*************************************************************************************
+// Recieve
+//*************************************************************************************
+
+static inline int MRH_SRV_IsEncrypted(uint8_t u8_Message)
+{
+    switch (u8_Message)
+    {
+        case MRH_SRV_MSG_TEXT:
+        case MRH_SRV_MSG_LOCATION:
+        case MRH_SRV_MSG_CUSTOM:
+            return 0;
+            
+        default:
+            return -1;
+    }
+}
+
+static size_t MRH_SRV_ReadMessage(uint8_t* p_Buffer, const uint8_t* p_Recieved, size_t us_Size, MRH_Srv_Server* p_Server, const uint8_t* p_Key)
+{
+    uint8_t u8_Message = p_Recieved[0] & (uint8_t)~MRH_SRV_CIPHER_MASK;
+    
+    // Needs to be decrypted?
+    if (MRH_SRV_IsEncrypted(u8_Message) == 0)
+    {
+        // Flagged messages use the AEAD cipher, the short flag marks counter only nonces
+        MRH_Srv_Cipher e_Cipher;
+        
+        switch (p_Recieved[0] & MRH_SRV_CIPHER_MASK)
+        {
+            case MRH_SRV_CIPHER_FLAG:
+                e_Cipher = MRH_SRV_CIPHER_XCHACHA20;
+                break;
+            case MRH_SRV_CIPHER_MASK:
+                e_Cipher = MRH_SRV_CIPHER_XCHACHA20_SHORT;
+                break;
+            case 0:
+                e_Cipher = MRH_SRV_CIPHER_SECRETBOX;
+                break;
+                
+            default:
+                p_Buffer[0] = MRH_SRV_MSG_UNK;
+                return 1;
+        }
+        
+        // @NOTE: Exclude message id from decryption!
+        int i_Result = -1;
+        
+        if (us_Size >= MRH_SRV_GetEncryptedSize(e_Cipher, 1) &&
+            us_Size <= MRH_SRV_GetEncryptedSize(e_Cipher, MRH_SRV_SIZE_MESSAGE_BUFFER_MAX))
+        {
+            if (e_Cipher == MRH_SRV_CIPHER_SECRETBOX)
+            {
+                i_Result = MRH_SRV_Decrypt(&(p_Buffer[1]), &(p_Recieved[1]), us_Size - 1, p_Key);
+            }
+            else
+            {
+                i_Result = MRH_SRV_DecryptAEAD(&(p_Buffer[1]), &(p_Recieved[1]), us_Size - 1, p_Recieved[0], e_Cipher, p_Server, p_Key);
+            }
+        }
+        
+        if (i_Result < 0)
+        {
+            MRH_ERR_SetServerError((i_Result == -2) ? MRH_SERVER_ERROR_ENCRYPTION_REPLAY : MRH_SERVER_ERROR_ENCRYPTION_FAILED);
+            p_Buffer[0] = MRH_SRV_MSG_UNK;
+            return 1;
+        }
+        
+        p_Buffer[0] = u8_Message;
+        return us_Size - MRH_SRV_GetEncryptedSize(e_Cipher, 0);
+    }
+    
+    // No encprytion, simply copy
+    if (us_Size > MRH_SRV_SIZE_MESSAGE_BUFFER_MAX || (p_Recieved[0] & MRH_SRV_CIPHER_MASK) != 0)
+    {
+        p_Buffer[0] = MRH_SRV_MSG_UNK;
+        return 1;
+    }
+    
+    memcpy(p_Buffer, p_Recieved, us_Size);
+    return us_Size;
+}
+
+static MRH_MsQuicMessage* MRH_SRV_GetRecieved(MRH_MsQuicConnection* p_MsQuic, const uint8_t** p_Recieved)
+{
+    MRH_MsQuicMessage* p_Message;
+    
+    while ((p_Message = MRH_MsQuicNextRecieveMessage(p_MsQuic)) != NULL)
+    {
+        p_Message->i_State = MRH_MSQ_MESSAGE_IN_USE;
+        
+        // Borrowed bytes might be gone already
+        if ((*p_Recieved = MRH_MsQuicReadRecieveMessage(p_Message)) != NULL)
+        {
+            return p_Message;
+        }
+        
+        MRH_MsQuicReleaseRecieveMessage(p_Message);
+    }
+    
+    return NULL;
+}
+
+MRH_Srv_NetMessage MRH_SRV_RecieveMessage(MRH_Srv_Server* p_Server, uint8_t* p_Buffer, const char* p_Password)
+{
+    if (p_Server == NULL || p_Buffer == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return MRH_SRV_MSG_UNK;
+    }
+    
+    MRH_MsQuicConnection* p_MsQuic = p_Server->p_MsQuic;
+    
+    memset(p_Buffer, '\0', MRH_SRV_SIZE_MESSAGE_BUFFER_MAX);
+    
+    const uint8_t* p_Recieved;
+    MRH_MsQuicMessage* p_Message = MRH_SRV_GetRecieved(p_MsQuic, &p_Recieved);
+    
+    if (p_Message == NULL)
+    {
+        // Nothing
+        return MRH_SRV_MSG_UNK;
+    }
+    
+    MRH_SRV_ReadMessage(p_Buffer, p_Recieved, p_Message->us_SizeCur, p_Server, MRH_SRV_GetKey(p_Server, p_Password));
+    
+    // Set as read
+    MRH_MsQuicReleaseRecieveMessage(p_Message);
+    MRH_MsQuicResumeFrameStreams(p_MsQuic);
+    
+    // Return net message id
+    return (MRH_Srv_NetMessage)(p_Buffer[0]);
+}
+
+size_t MRH_SRV_RecieveMessages(MRH_Srv_Server* p_Server, MRH_Srv_RecieveEntry* p_Entry, size_t us_Count, const char* p_Password)
+{
+    if (p_Server == NULL || p_Entry == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return 0;
+    }
+    
+    MRH_MsQuicConnection* p_MsQuic = p_Server->p_MsQuic;
+    const uint8_t* p_Key = MRH_SRV_GetKey(p_Server, p_Password);
+    size_t us_Recieved = 0;
+    
+    while (us_Recieved < us_Count)
+    {
+        const uint8_t* p_Recieved;
+        MRH_MsQuicMessage* p_Message = MRH_SRV_GetRecieved(p_MsQuic, &p_Recieved);
+        
+        if (p_Message == NULL)
         {
-            p_Message = &(p_MsQuic->p_Send[i]);
-            p_Message->i_State = MRH_MSQ_MESSAGE_IN_USE;
             break;
         }
+        
+        MRH_Srv_RecieveEntry* p_Current = &(p_Entry[us_Recieved]);
+        
+        p_Current->us_Size = MRH_SRV_ReadMessage(p_Current->p_Buffer, p_Recieved, p_Message->us_SizeCur, p_Server, p_Key);
+        p_Current->e_Message = (MRH_Srv_NetMessage)(p_Current->p_Buffer[0]);
+        
+        // @NOTE: Strings are read until the first null byte
+        if (p_Current->us_Size < MRH_SRV_SIZE_MESSAGE_BUFFER_MAX)
+        {
+            p_Current->p_Buffer[p_Current->us_Size] = '\0';
+        }
+        
+        // Set as read
+        MRH_MsQuicReleaseRecieveMessage(p_Message);
+        us_Recieved += 1;
+    }
+    
+    if (us_Recieved > 0)
+    {
+        MRH_MsQuicResumeFrameStreams(p_MsQuic);
+    }
+    
+    return us_Recieved;
+}
+
+int MRH_SRV_BorrowMessage(MRH_Srv_Server* p_Server, MRH_Srv_MessageView* p_View, uint8_t* p_Buffer, const char* p_Password)
+{
+    if (p_Server == NULL || p_View == NULL || p_Buffer == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
     }
     
+    MRH_MsQuicConnection* p_MsQuic = p_Server->p_MsQuic;
+    const uint8_t* p_Recieved;
+    MRH_MsQuicMessage* p_Message = MRH_SRV_GetRecieved(p_MsQuic, &p_Recieved);
+    
     if (p_Message == NULL)
     {
-        MRH_ERR_SetServerError(MRH_SERVER_ERROR_SEND_QUEUE_FULL);
         return -1;
     }
     
-    // Now, create or expand the buffer as needed
-    uint8_t p_MessageBuffer[MRH_SRV_SIZE_MESSAGE_BUFFER_MAX] = { '\0' };
-    size_t us_MessageSize = 1; // The real message size, start with message id
+    if (MRH_SRV_IsEncrypted(p_Recieved[0]) == 0 || (p_Recieved[0] & MRH_SRV_CIPHER_MASK) != 0)
+    {
+        // Decrypt straight from the recieved bytes, no need to keep them afterwards
+        p_View->us_Size = MRH_SRV_ReadMessage(p_Buffer, p_Recieved, p_Message->us_SizeCur, p_Server, MRH_SRV_GetKey(p_Server, p_Password));
+        p_View->p_Buffer = p_Buffer;
+        p_View->p_Handle = NULL;
+        
+        MRH_MsQuicReleaseRecieveMessage(p_Message);
+        MRH_MsQuicResumeFrameStreams(p_MsQuic);
+    }
+    else if (p_Message->us_SizeCur > MRH_SRV_SIZE_MESSAGE_BUFFER_MAX)
+    {
+        p_Buffer[0] = MRH_SRV_MSG_UNK;
+        
+        p_View->us_Size = 1;
+        p_View->p_Buffer = p_Buffer;
+        p_View->p_Handle = NULL;
+        
+        MRH_MsQuicReleaseRecieveMessage(p_Message);
+        MRH_MsQuicResumeFrameStreams(p_MsQuic);
+    }
+    else
+    {
+        // Plain bytes are handed out directly
+        p_View->us_Size = p_Message->us_SizeCur;
+        p_View->p_Buffer = p_Recieved;
+        p_View->p_Handle = p_Message;
+    }
     
-    int i_Encrypt; // Define if message uses end to end encryption
+    p_View->e_Message = (MRH_Srv_NetMessage)(p_View->p_Buffer[0]);
+    
+    return 0;
+}
+
+void MRH_SRV_ReleaseMessage(MRH_Srv_Server* p_Server, MRH_Srv_MessageView* p_View)
+{
+    if (p_Server == NULL || p_View == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return;
+    }
+    
+    if (p_View->p_Handle != NULL)
+    {
+        MRH_MsQuicReleaseRecieveMessage((MRH_MsQuicMessage*)(p_View->p_Handle));
+        MRH_MsQuicResumeFrameStreams(p_Server->p_MsQuic);
+    }
+    
+    p_View->p_Buffer = NULL;
+    p_View->us_Size = 0;
+    p_View->p_Handle = NULL;
+}
+
+int MRH_SRV_GetSequenceGaps(MRH_Srv_Server* p_Server, MRH_Srv_SequenceGaps* p_Gaps)
+{
+    if (p_Server == NULL || p_Gaps == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    
+    MRH_MsQuicConnection* p_MsQuic = p_Server->p_MsQuic;
+    
+    p_Gaps->u64_GapCount = p_MsQuic->u64_GapCount;
+    p_Gaps->u64_MissingCount = p_MsQuic->u64_GapMissing;
+    p_Gaps->u32_LastMissing = p_MsQuic->u32_GapLast;
+    p_Gaps->us_HeldCount = p_MsQuic->us_OrderHeld;
+    
+    return 0;
+}
+
+int MRH_SRV_SetNetMessage(void* p_Message, const uint8_t* p_Buffer)
+{
+    if (p_Message == NULL || p_Buffer == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    
+    switch (p_Buffer[0]) // 0 = Net Message ID
+    {
+        /**
+         *  Net Message Version 1
+         */
+        
+        // Server Auth
+        case MRH_SRV_MSG_AUTH_REQUEST:
+            TO_MRH_SRV_MSG_AUTH_REQUEST((MRH_SRV_MSG_AUTH_REQUEST_DATA*)p_Message,
+                                        &(p_Buffer[1]));
+            break;
+        case MRH_SRV_MSG_AUTH_CHALLENGE:
+            TO_MRH_SRV_MSG_AUTH_CHALLENGE((MRH_SRV_MSG_AUTH_CHALLENGE_DATA*)p_Message,
+                                          &(p_Buffer[1]));
+            break;
+        case MRH_SRV_MSG_AUTH_PROOF:
+            TO_MRH_SRV_MSG_AUTH_PROOF((MRH_SRV_MSG_AUTH_PROOF_DATA*)p_Message,
+                                      &(p_Buffer[1]));
+            break;
+        case MRH_SRV_MSG_AUTH_RESULT:
+            TO_MRH_SRV_MSG_AUTH_RESULT((MRH_SRV_MSG_AUTH_RESULT_DATA*)p_Message,
+                                       &(p_Buffer[1]));
+            break;
+            
+        // Communication
+        case MRH_SRV_MSG_TEXT:
+            TO_MRH_SRV_MSG_TEXT((MRH_SRV_MSG_TEXT_DATA*)p_Message,
+                                &(p_Buffer[1]));
+            break;
+        case MRH_SRV_MSG_LOCATION:
+            TO_MRH_SRV_MSG_LOCATION((MRH_SRV_MSG_LOCATION_DATA*)p_Message,
+                                    &(p_Buffer[1]));
+            break;
+        case MRH_SRV_MSG_NOTIFICATION:
+            TO_MRH_SRV_MSG_NOTIFICATION((MRH_SRV_MSG_NOTIFICATION_DATA*)p_Message,
+                                        &(p_Buffer[1]));
+            break;
+        case MRH_SRV_MSG_CUSTOM:
+            TO_MRH_SRV_MSG_CUSTOM((MRH_SRV_MSG_CUSTOM_DATA*)p_Message,
+                                  &(p_Buffer[1]));
+            break;
+            
+        /**
+         *  Default (No Data, Unknown, Not Readable, etc.)
+         */
+            
+        default:
+            MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+            return -1;
+    }
+    
+    return 0;
+}
+
+//*************************************************************************************
+// Send
+//*************************************************************************************
+
+static inline int MRH_SRV_UseDatagram(MRH_MsQuicConnection* p_MsQuic, MRH_Srv_NetMessage e_Message, size_t us_PayloadSize)
+{
+    if (p_MsQuic->i_DatagramSend != 0 ||
+        (p_MsQuic->u32_DatagramMessages & ((uint32_t)1 << e_Message)) == 0 ||
+        p_MsQuic->us_DatagramSizeMax < us_PayloadSize)
+    {
+        return -1;
+    }
+    
+    return 0;
+}
+
+static size_t MRH_SRV_SetMessageBuffer(uint8_t* p_MessageBuffer, MRH_Srv_NetMessage e_Message, const void* p_Data, int* p_Encrypt)
+{
+    size_t us_MessageSize = 1; // The real message size, start with message id
     
     // Set message id
     p_MessageBuffer[0] = (uint8_t)e_Message;
@@ -481,37 +1093,49 @@ int MRH_SRV_SendMessage(MRH_Srv_Server* p_Server, MRH_Srv_NetMessage e_Message,
         case MRH_SRV_MSG_AUTH_REQUEST:
             us_MessageSize += FROM_MRH_SRV_MSG_AUTH_REQUEST(&(p_MessageBuffer[1]),
                                                             (const MRH_SRV_MSG_AUTH_REQUEST_DATA*)p_Data);
-            i_Encrypt = -1;
+            *p_Encrypt = -1;
+            break;
+        case MRH_SRV_MSG_AUTH_CHALLENGE:
+            us_MessageSize += FROM_MRH_SRV_MSG_AUTH_CHALLENGE(&(p_MessageBuffer[1]),
+                                                              (const MRH_SRV_MSG_AUTH_CHALLENGE_DATA*)p_Data);
+            *p_Encrypt = -1;
             break;
         case MRH_SRV_MSG_AUTH_PROOF:
             us_MessageSize += FROM_MRH_SRV_MSG_AUTH_PROOF(&(p_MessageBuffer[1]),
                                                           (const MRH_SRV_MSG_AUTH_PROOF_DATA*)p_Data);
-            i_Encrypt = -1;
+            *p_Encrypt = -1;
+            break;
+        case MRH_SRV_MSG_AUTH_RESULT:
+            us_MessageSize += FROM_MRH_SRV_MSG_AUTH_RESULT(&(p_MessageBuffer[1]),
+                                                           (const MRH_SRV_MSG_AUTH_RESULT_DATA*)p_Data);
+            *p_Encrypt = -1;
             break;
             
         // Communication
+        case MRH_SRV_MSG_DATA_AVAILABLE:
         case MRH_SRV_MSG_GET_DATA:
-            i_Encrypt = -1;
+        case MRH_SRV_MSG_NO_DATA:
+            *p_Encrypt = -1;
             break;
         case MRH_SRV_MSG_TEXT:
             us_MessageSize += FROM_MRH_SRV_MSG_TEXT(&(p_MessageBuffer[1]),
                                                     (const MRH_SRV_MSG_TEXT_DATA*)p_Data);
-            i_Encrypt = 0;
+            *p_Encrypt = 0;
             break;
         case MRH_SRV_MSG_LOCATION:
             us_MessageSize += FROM_MRH_SRV_MSG_LOCATION(&(p_MessageBuffer[1]),
                                                         (const MRH_SRV_MSG_LOCATION_DATA*)p_Data);
-            i_Encrypt = 0;
+            *p_Encrypt = 0;
             break;
         case MRH_SRV_MSG_NOTIFICATION:
             us_MessageSize += FROM_MRH_SRV_MSG_NOTIFICATION(&(p_MessageBuffer[1]),
                                                             (const MRH_SRV_MSG_NOTIFICATION_DATA*)p_Data);
-            i_Encrypt = -1; // Needs to be readable for push
+            *p_Encrypt = -1; // Needs to be readable for push
             break;
         case MRH_SRV_MSG_CUSTOM:
             us_MessageSize += FROM_MRH_SRV_MSG_CUSTOM(&(p_MessageBuffer[1]),
                                                       (const MRH_SRV_MSG_CUSTOM_DATA*)p_Data);
-            i_Encrypt = 0;
+            *p_Encrypt = 0;
             break;
             
         /**
@@ -519,114 +1143,1171 @@ int MRH_SRV_SendMessage(MRH_Srv_Server* p_Server, MRH_Srv_NetMessage e_Message,
          */
             
         default:
-            MRH_ERR_SetServerError(MRH_SERVER_ERROR_SEND_INVALID_MESSAGE);
-            p_Message->i_State = MRH_MSQ_MESSAGE_FREE;
-            return -1;
+            return 0;
     }
     
-    // Do we have a password for encryption?
-    if (i_Encrypt == 0 && p_Password == NULL)
+    return us_MessageSize;
+}
+
+static size_t MRH_SRV_WriteMessage(uint8_t* p_Buffer, const uint8_t* p_MessageBuffer, size_t us_MessageSize, int i_Encrypt, MRH_Srv_Server* p_Server, const uint8_t* p_Key)
+{
+    if (i_Encrypt != 0)
     {
-        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
-        return -1;
+        memcpy(p_Buffer, p_MessageBuffer, us_MessageSize);
+        return us_MessageSize;
     }
     
-    // Now, create or expand the buffer as needed
-    size_t us_BufferSize = sizeof(QUIC_BUFFER);
+    // Set net message
+    p_Buffer[0] = p_MessageBuffer[0];
     
-    if (i_Encrypt == 0)
+    // Encrypt message data
+    // @NOTE: Exclude message id from encryption!
+    if (p_Server->e_Cipher == MRH_SRV_CIPHER_SECRETBOX)
     {
-        us_BufferSize += MRH_SRV_GetEncryptedSize(us_MessageSize);
+        if (MRH_SRV_Encrypt(&(p_Buffer[1]),
+                            &(p_MessageBuffer[1]),
+                            us_MessageSize - 1,
+                            p_Key) < 0)
+        {
+            return 0;
+        }
     }
     else
     {
-        us_BufferSize += us_MessageSize;
-    }
-    
-    if (p_Message->p_Buffer == NULL)
-    {
-        if ((p_Message->p_Buffer = (uint8_t*)malloc(us_BufferSize)) == NULL)
+        p_Buffer[0] |= (p_Server->e_Cipher == MRH_SRV_CIPHER_XCHACHA20_SHORT) ? MRH_SRV_CIPHER_MASK : MRH_SRV_CIPHER_FLAG;
+        
+        if (MRH_SRV_EncryptAEAD(&(p_Buffer[1]),
+                                &(p_MessageBuffer[1]),
+                                us_MessageSize - 1,
+                                p_Buffer[0],
+                                p_Server,
+                                p_Key) < 0)
         {
-            MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_MALLOC);
-            p_Message->i_State = MRH_MSQ_MESSAGE_FREE;
-            return -1;
+            return 0;
         }
-        
-        p_Message->us_SizeMax = us_BufferSize;
     }
-    else if (p_Message->us_SizeMax < us_BufferSize)
-    {
-        if ((p_Message->p_Buffer = (uint8_t*)realloc(p_Message->p_Buffer, us_BufferSize)) == NULL)
-        {
-            MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_MALLOC);
-            p_Message->i_State = MRH_MSQ_MESSAGE_FREE;
-            return -1;
-        }
-        
-        p_Message->us_SizeMax = us_BufferSize;
+    
+    return MRH_SRV_GetEncryptedSize(p_Server->e_Cipher, us_MessageSize);
+}
+
+static int MRH_SRV_ReserveBuffer(MRH_MsQuicMessage* p_Message, size_t us_BufferSize)
+{
+    if (p_Message->us_SizeMax >= us_BufferSize && p_Message->p_Buffer != NULL)
+    {
+        return 0;
     }
     
-    // And now write the message content
-    if (i_Encrypt == 0)
+    uint8_t* p_Buffer = (uint8_t*)realloc(p_Message->p_Buffer, us_BufferSize);
+    
+    if (p_Buffer == NULL)
     {
-        // Set net message
-        p_Message->p_Buffer[sizeof(QUIC_BUFFER)] = p_MessageBuffer[0];
-        
-        // Encrypt message data
-        if (MRH_SRV_Encrypt(&(p_Message->p_Buffer[sizeof(QUIC_BUFFER) + 1]),
-                            &(p_MessageBuffer[1]),
-                            us_MessageSize - 1,
-                            p_Password) < 0)
-        {
-            MRH_ERR_SetServerError(MRH_SERVER_ERROR_ENCRYPTION_FAILED);
-            p_Message->i_State = MRH_MSQ_MESSAGE_FREE;
-            return -1;
-        }
+        return -1;
     }
-    else
+    
+    p_Message->p_Buffer = p_Buffer;
+    p_Message->us_SizeMax = us_BufferSize;
+    
+    return 0;
+}
+
+static void MRH_SRV_SetFrameLength(uint8_t* p_Buffer, size_t us_FrameSize)
+{
+    p_Buffer[0] = (uint8_t)(us_FrameSize & 0xFF);
+    p_Buffer[1] = (uint8_t)((us_FrameSize >> 8) & 0xFF);
+}
+
+static size_t MRH_SRV_AddSequence(uint8_t* p_Buffer, size_t us_Written)
+{
+    // Message was written behind the sequence number, move the id to the front
+    // @NOTE: The sequence number itself is set when submitting
+    p_Buffer[0] = p_Buffer[MRH_MSQ_SEQUENCE_SIZE] | MRH_MSQ_SEQUENCE_FLAG;
+    memset(&(p_Buffer[1]), '\0', MRH_MSQ_SEQUENCE_SIZE);
+    
+    return MRH_MSQ_SEQUENCE_SIZE + us_Written;
+}
+
+static void MRH_SRV_SetSequence(MRH_MsQuicConnection* p_MsQuic, uint8_t* p_Buffer)
+{
+    // @NOTE: Sequence mutex is held by the caller
+    uint32_t u32_Sequence = atomic_fetch_add(&(p_MsQuic->u32_SendSequence), 1);
+    
+    p_Buffer[1] = (uint8_t)(u32_Sequence & 0xFF);
+    p_Buffer[2] = (uint8_t)((u32_Sequence >> 8) & 0xFF);
+    p_Buffer[3] = (uint8_t)((u32_Sequence >> 16) & 0xFF);
+    p_Buffer[4] = (uint8_t)((u32_Sequence >> 24) & 0xFF);
+}
+
+static uint32_t MRH_SRV_LockSequence(MRH_MsQuicConnection* p_MsQuic, uint32_t u32_Count)
+{
+    // Numbers and submit order have to match, a failed submit gives its numbers back
+    if (u32_Count > 0)
     {
-        memcpy(&(p_Message->p_Buffer[sizeof(QUIC_BUFFER)]),
-               p_MessageBuffer,
-               us_MessageSize);
+        pthread_mutex_lock(&(p_MsQuic->p_SequenceMutex));
     }
     
-    p_Message->us_SizeCur = us_BufferSize;
+    return p_MsQuic->u32_SendSequence;
+}
+
+static void MRH_SRV_UnlockSequence(MRH_MsQuicConnection* p_MsQuic, uint32_t u32_Count, uint32_t u32_First, int i_Result)
+{
+    if (u32_Count == 0)
+    {
+        return;
+    }
     
-    // Setup buffer for quic usage
-    QUIC_BUFFER* p_QuicBuffer = (QUIC_BUFFER*)(p_Message->p_Buffer);
-    p_QuicBuffer->Buffer = &(p_Message->p_Buffer[sizeof(QUIC_BUFFER)]);
-    p_QuicBuffer->Length = us_BufferSize - sizeof(QUIC_BUFFER); // Wanted is the payload size
+    // @NOTE: The worker restarts numbering on reconnects, keep the new numbers then
+    uint32_t u32_Next = u32_First + u32_Count;
+    
+    if (i_Result < 0)
+    {
+        atomic_compare_exchange_strong(&(p_MsQuic->u32_SendSequence), &u32_Next, u32_First);
+    }
     
+    pthread_mutex_unlock(&(p_MsQuic->p_SequenceMutex));
+}
+
+static inline uint32_t MRH_SRV_GetBufferCount(const MRH_MsQuicMessage* p_Message)
+{
+    // Shared data follows the message buffer
+    return (p_Message->p_Shared != NULL) ? 2 : 1;
+}
+
+static inline size_t MRH_SRV_GetSendSize(const MRH_MsQuicMessage* p_Message, const QUIC_BUFFER* p_QuicBuffer)
+{
+    return (p_Message->p_Shared != NULL) ? p_QuicBuffer[0].Length + p_QuicBuffer[1].Length : p_QuicBuffer[0].Length;
+}
+
+static int MRH_SRV_SendStream(MRH_MsQuicConnection* p_MsQuic, HQUIC p_QuicConnection, MRH_MsQuicMessage* p_Message, QUIC_BUFFER* p_QuicBuffer, QUIC_SEND_FLAGS e_Flags)
+{
     // Create a stream to send the message on
     HQUIC p_Stream;
     
-    if (QUIC_FAILED(p_MsQuic->p_MsQuicAPI->StreamOpen(p_MsQuic->p_Connection,
+    if (QUIC_FAILED(p_MsQuic->p_MsQuicAPI->StreamOpen(p_QuicConnection,
                                                       QUIC_STREAM_OPEN_FLAG_UNIDIRECTIONAL, /* QUIC_STREAM_OPEN_FLAG_NONE, */
                                                       MRH_MsQuicStreamCallback,
                                                       p_Message, /* Pass message as context */
                                                       &p_Stream)))
     {
         MRH_ERR_SetServerError(MRH_SERVER_ERROR_SEND_STREAM_CREATE);
-        p_Message->i_State = MRH_MSQ_MESSAGE_FREE;
         return -1;
     }
-    else if (QUIC_FAILED(p_MsQuic->p_MsQuicAPI->StreamStart(p_Stream,
-                                                            QUIC_STREAM_START_FLAG_SHUTDOWN_ON_FAIL)))
+    
+    // Priority has to be set before any data is queued, a failure keeps the default
+    if (p_Message->u16_Priority != MRH_SRV_PRIORITY_DEFAULT)
+    {
+        p_MsQuic->p_MsQuicAPI->SetParam(p_Stream,
+                                        QUIC_PARAM_STREAM_PRIORITY,
+                                        sizeof(uint16_t),
+                                        &(p_Message->u16_Priority));
+    }
+    
+    if (QUIC_FAILED(p_MsQuic->p_MsQuicAPI->StreamStart(p_Stream,
+                                                       QUIC_STREAM_START_FLAG_SHUTDOWN_ON_FAIL)))
     {
         MRH_ERR_SetServerError(MRH_SERVER_ERROR_SEND_STREAM_START);
         p_MsQuic->p_MsQuicAPI->StreamClose(p_Stream);
-        p_Message->i_State = MRH_MSQ_MESSAGE_FREE;
         return -1;
     }
-    else if (QUIC_FAILED(p_MsQuic->p_MsQuicAPI->StreamSend(p_Stream,
-                                                           p_QuicBuffer,
-                                                           1,
-                                                           QUIC_SEND_FLAG_FIN,
-                                                           NULL)))
+    
+    // Count before sending, the send might complete before returning
+    MRH_MsQuicAddInFlight(p_Message, MRH_SRV_GetSendSize(p_Message, p_QuicBuffer));
+    
+    if (QUIC_FAILED(p_MsQuic->p_MsQuicAPI->StreamSend(p_Stream,
+                                                      p_QuicBuffer,
+                                                      MRH_SRV_GetBufferCount(p_Message),
+                                                      QUIC_SEND_FLAG_FIN | e_Flags,
+                                                      NULL)))
     {
         MRH_ERR_SetServerError(MRH_SERVER_ERROR_SEND_STREAM_SEND);
+        MRH_MsQuicRemoveInFlight(p_Message);
         p_MsQuic->p_MsQuicAPI->StreamClose(p_Stream);
-        p_Message->i_State = MRH_MSQ_MESSAGE_FREE;
+        return -1;
+    }
+    
+    return 0;
+}
+
+static int MRH_SRV_SendFrames(MRH_MsQuicConnection* p_MsQuic, MRH_MsQuicMessage* p_Message, QUIC_BUFFER* p_QuicBuffer)
+{
+    // Send on a long-lived stream
+    MRH_MsQuicFrameStream* p_Frame = MRH_MsQuicGetFrameStream(p_MsQuic);
+    
+    if (p_Frame == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_SEND_STREAM_CREATE);
+        return -1;
+    }
+    
+    MRH_MsQuicAddInFlight(p_Message, MRH_SRV_GetSendSize(p_Message, p_QuicBuffer));
+    
+    if (QUIC_FAILED(p_MsQuic->p_MsQuicAPI->StreamSend(p_Frame->p_Handle,
+                                                      p_QuicBuffer,
+                                                      MRH_SRV_GetBufferCount(p_Message),
+                                                      QUIC_SEND_FLAG_NONE,
+                                                      p_Message))) /* Send complete frees message */
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_SEND_STREAM_SEND);
+        MRH_MsQuicRemoveInFlight(p_Message);
+        MRH_MsQuicReleaseFrameStream(p_Frame);
+        return -1;
+    }
+    
+    MRH_MsQuicReleaseFrameStream(p_Frame);
+    return 0;
+}
+
+static int MRH_SRV_SubmitStream(MRH_MsQuicConnection* p_MsQuic, HQUIC p_QuicConnection, MRH_MsQuicMessage* p_Message, QUIC_BUFFER* p_QuicBuffer, QUIC_SEND_FLAGS e_Flags)
+{
+    // Replayed messages are numbered again for the new connection
+    uint32_t u32_Count = (p_QuicBuffer->Buffer[0] & MRH_MSQ_SEQUENCE_FLAG) ? 1 : 0;
+    uint32_t u32_First = MRH_SRV_LockSequence(p_MsQuic, u32_Count);
+    
+    if (u32_Count > 0)
+    {
+        MRH_SRV_SetSequence(p_MsQuic, p_QuicBuffer->Buffer);
+    }
+    
+    int i_Result = MRH_SRV_SendStream(p_MsQuic, p_QuicConnection, p_Message, p_QuicBuffer, e_Flags);
+    
+    MRH_SRV_UnlockSequence(p_MsQuic, u32_Count, u32_First, i_Result);
+    return i_Result;
+}
+
+static int MRH_SRV_SubmitFrames(MRH_MsQuicConnection* p_MsQuic, MRH_MsQuicMessage* p_Message, QUIC_BUFFER* p_QuicBuffer)
+{
+    uint8_t* p_Buffer = p_QuicBuffer->Buffer;
+    uint32_t u32_Count = 0;
+    size_t us_Pos;
+    
+    for (us_Pos = 0; us_Pos + MRH_MSQ_FRAME_LENGTH_SIZE < p_QuicBuffer->Length;)
+    {
+        if (p_Buffer[us_Pos + MRH_MSQ_FRAME_LENGTH_SIZE] & MRH_MSQ_SEQUENCE_FLAG)
+        {
+            u32_Count += 1;
+        }
+        
+        us_Pos += MRH_MSQ_FRAME_LENGTH_SIZE + ((size_t)(p_Buffer[us_Pos]) | ((size_t)(p_Buffer[us_Pos + 1]) << 8));
+    }
+    
+    // Replayed messages are numbered again for the new connection
+    uint32_t u32_First = MRH_SRV_LockSequence(p_MsQuic, u32_Count);
+    
+    for (us_Pos = 0; u32_Count > 0 && us_Pos + MRH_MSQ_FRAME_LENGTH_SIZE < p_QuicBuffer->Length;)
+    {
+        if (p_Buffer[us_Pos + MRH_MSQ_FRAME_LENGTH_SIZE] & MRH_MSQ_SEQUENCE_FLAG)
+        {
+            MRH_SRV_SetSequence(p_MsQuic, &(p_Buffer[us_Pos + MRH_MSQ_FRAME_LENGTH_SIZE]));
+        }
+        
+        us_Pos += MRH_MSQ_FRAME_LENGTH_SIZE + ((size_t)(p_Buffer[us_Pos]) | ((size_t)(p_Buffer[us_Pos + 1]) << 8));
+    }
+    
+    int i_Result = MRH_SRV_SendFrames(p_MsQuic, p_Message, p_QuicBuffer);
+    
+    MRH_SRV_UnlockSequence(p_MsQuic, u32_Count, u32_First, i_Result);
+    return i_Result;
+}
+
+static int MRH_SRV_SubmitMessage(MRH_MsQuicConnection* p_MsQuic, HQUIC p_QuicConnection, MRH_MsQuicMessage* p_Message, int i_Queue, int i_Datagram, QUIC_SEND_FLAGS e_Flags)
+{
+    QUIC_BUFFER* p_QuicBuffer = (QUIC_BUFFER*)(p_Message->p_Buffer);
+    
+    p_Message->u64_Queued = atomic_fetch_add(&(p_MsQuic->u64_SendCount), 1);
+    
+    if (i_Queue == 0)
+    {
+        p_Message->i_State = MRH_MSQ_MESSAGE_REPLAY;
+        return 0;
+    }
+    else if (i_Datagram == 0)
+    {
+        MRH_MsQuicAddInFlight(p_Message, MRH_SRV_GetSendSize(p_Message, p_QuicBuffer));
+        
+        if (QUIC_FAILED(p_MsQuic->p_MsQuicAPI->DatagramSend(p_MsQuic->p_Connection,
+                                                            p_QuicBuffer,
+                                                            MRH_SRV_GetBufferCount(p_Message),
+                                                            QUIC_SEND_FLAG_NONE,
+                                                            p_Message))) /* Final send state frees message */
+        {
+            MRH_ERR_SetServerError(MRH_SERVER_ERROR_SEND_DATAGRAM);
+            MRH_MsQuicRemoveInFlight(p_Message);
+            MRH_MsQuicFreeSendMessage(p_Message);
+            return -1;
+        }
+    }
+    else if (p_Message->i_Framed == 0)
+    {
+        if (MRH_SRV_SubmitFrames(p_MsQuic, p_Message, p_QuicBuffer) < 0)
+        {
+            MRH_MsQuicFreeSendMessage(p_Message);
+            return -1;
+        }
+    }
+    else if (MRH_SRV_SubmitStream(p_MsQuic, p_QuicConnection, p_Message, p_QuicBuffer, e_Flags) < 0)
+    {
+        MRH_MsQuicFreeSendMessage(p_Message);
+        return -1;
+    }
+    
+    return 0;
+}
+
+static void MRH_SRV_WaitReplay(MRH_Srv_Server* p_Server)
+{
+    MRH_MsQuicConnection* p_MsQuic = p_Server->p_MsQuic;
+    
+    // @NOTE: The reconnect thread authenticates before replaying, never block it
+    if (p_MsQuic->i_Replaying != 0 || MRH_SRV_IsReconnectThread(p_Server) == 0)
+    {
+        return;
+    }
+    
+    // Kept messages have to be submitted before anything new
+    pthread_mutex_lock(&(p_MsQuic->p_StateMutex));
+    
+    while (p_MsQuic->i_Replaying == 0 && p_Server->i_ReconnectRun == 0)
+    {
+        pthread_cond_wait(&(p_MsQuic->p_StateCond), &(p_MsQuic->p_StateMutex));
+    }
+    
+    pthread_mutex_unlock(&(p_MsQuic->p_StateMutex));
+}
+
+static int MRH_SRV_Send(MRH_Srv_Server* p_Server, MRH_Srv_NetMessage e_Message, const void* p_Data, const char* p_Password, int i_TimeoutMS, int i_Priority)
+{
+    if (p_Server == NULL || e_Message < MRH_SRV_MSG_UNK || e_Message > MRH_SRV_NET_MESSAGE_MAX)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    
+    MRH_SRV_WaitReplay(p_Server);
+    
+    // Find the server for the channel
+    MRH_MsQuicConnection* p_MsQuic = p_Server->p_MsQuic;
+    HQUIC p_QuicConnection = p_MsQuic->p_Connection;
+    QUIC_SEND_FLAGS e_Flags = QUIC_SEND_FLAG_NONE;
+    
+    // The first auth request on a resumed connection can be sent with 0-RTT
+    if (p_QuicConnection == NULL &&
+        e_Message == MRH_SRV_MSG_AUTH_REQUEST &&
+        atomic_exchange(&(p_MsQuic->i_ZeroRTT), -1) == 0)
+    {
+        p_QuicConnection = p_MsQuic->p_Handle;
+        e_Flags = QUIC_SEND_FLAG_ALLOW_0_RTT;
+    }
+    
+    // Disconnected messages are kept for the next connection when reconnecting
+    int i_Queue = -1;
+    
+    if (p_QuicConnection == NULL)
+    {
+        if (p_MsQuic->i_Replay != 0)
+        {
+            MRH_ERR_SetServerError(MRH_SERVER_ERROR_SEND_DISCONNECTED);
+            return -1;
+        }
+        
+        i_Queue = 0;
+    }
+    
+    // Build the message first
+    uint8_t p_MessageBuffer[MRH_SRV_SIZE_MESSAGE_BUFFER_MAX] = { '\0' };
+    int i_Encrypt; // Define if message uses end to end encryption
+    size_t us_MessageSize = MRH_SRV_SetMessageBuffer(p_MessageBuffer, e_Message, p_Data, &i_Encrypt);
+    const uint8_t* p_Key = MRH_SRV_GetKey(p_Server, p_Password);
+    
+    if (us_MessageSize == 0)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_SEND_INVALID_MESSAGE);
+        return -1;
+    }
+    else if (i_Encrypt == 0 && p_Key == NULL) // Do we have a key for encryption?
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    
+    // Now grab the send buffer
+    MRH_MsQuicMessage* p_Message = MRH_MsQuicGetSendMessage(p_MsQuic, i_TimeoutMS);
+    
+    if (p_Message == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_SEND_QUEUE_FULL);
+        return -1;
+    }
+    
+    size_t us_PayloadSize = (i_Encrypt == 0) ? MRH_SRV_GetEncryptedSize(p_Server->e_Cipher, us_MessageSize) : us_MessageSize;
+    uint16_t u16_Priority = (i_Priority < 0) ? p_MsQuic->p_Priority[e_Message] : (uint16_t)i_Priority;
+    
+    // Small messages marked for datagrams skip streams
+    // @NOTE: 0-RTT messages always use their own stream
+    int i_Datagram = (e_Flags == QUIC_SEND_FLAG_NONE) ? MRH_SRV_UseDatagram(p_MsQuic, e_Message, us_PayloadSize) : -1;
+    
+    // Framed messages are prefixed with their length
+    // @NOTE: Frame streams are shared, prioritized messages use their own stream
+    //        to not wait behind queued frames
+    int i_Framed = -1;
+    size_t us_HeaderSize = sizeof(QUIC_BUFFER);
+    
+    if (i_Datagram != 0 &&
+        e_Flags == QUIC_SEND_FLAG_NONE &&
+        u16_Priority <= MRH_SRV_PRIORITY_DEFAULT &&
+        p_MsQuic->i_Transport == MRH_MSQ_TRANSPORT_FRAMED)
+    {
+        i_Framed = 0;
+        us_HeaderSize += MRH_MSQ_FRAME_LENGTH_SIZE;
+    }
+    
+    // Datagrams are unordered, 0-RTT messages are sent before the connection numbers start
+    int i_Sequence = (i_Datagram != 0 && e_Flags == QUIC_SEND_FLAG_NONE && p_MsQuic->i_SendSequence == 0) ? 0 : -1;
+    size_t us_SequenceSize = (i_Sequence == 0) ? MRH_MSQ_SEQUENCE_SIZE : 0;
+    
+    us_PayloadSize += us_SequenceSize;
+    
+    // Now, create or expand the buffer as needed
+    size_t us_BufferSize = us_HeaderSize + us_PayloadSize;
+    
+    if (MRH_SRV_ReserveBuffer(p_Message, us_BufferSize) < 0)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_MALLOC);
+        MRH_MsQuicFreeSendMessage(p_Message);
+        return -1;
+    }
+    
+    // And now write the message content
+    if (MRH_SRV_WriteMessage(&(p_Message->p_Buffer[us_HeaderSize + us_SequenceSize]),
+                             p_MessageBuffer,
+                             us_MessageSize,
+                             i_Encrypt,
+                             p_Server,
+                             p_Key) == 0)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_ENCRYPTION_FAILED);
+        MRH_MsQuicFreeSendMessage(p_Message);
+        return -1;
+    }
+    
+    if (i_Sequence == 0)
+    {
+        MRH_SRV_AddSequence(&(p_Message->p_Buffer[us_HeaderSize]), 0);
+    }
+    
+    p_Message->us_SizeCur = us_BufferSize;
+    
+    // Setup buffer for quic usage
+    QUIC_BUFFER* p_QuicBuffer = (QUIC_BUFFER*)(p_Message->p_Buffer);
+    p_QuicBuffer->Buffer = &(p_Message->p_Buffer[sizeof(QUIC_BUFFER)]);
+    p_QuicBuffer->Length = us_BufferSize - sizeof(QUIC_BUFFER); // Wanted is the payload size
+    
+    if (i_Framed == 0)
+    {
+        // Frame length is the message size without the length itself
+        MRH_SRV_SetFrameLength(p_QuicBuffer->Buffer, us_PayloadSize);
+    }
+    
+    p_Message->i_Framed = i_Framed;
+    p_Message->u16_Priority = (i_Framed == 0) ? MRH_SRV_PRIORITY_DEFAULT : u16_Priority;
+    
+    return MRH_SRV_SubmitMessage(p_MsQuic, p_QuicConnection, p_Message, i_Queue, i_Datagram, e_Flags);
+}
+
+int MRH_SRV_SendMessage(MRH_Srv_Server* p_Server, MRH_Srv_NetMessage e_Message, const void* p_Data, const char* p_Password)
+{
+    return MRH_SRV_Send(p_Server, e_Message, p_Data, p_Password, 0, -1);
+}
+
+int MRH_SRV_SendMessageWait(MRH_Srv_Server* p_Server, MRH_Srv_NetMessage e_Message, const void* p_Data, const char* p_Password, int i_TimeoutMS)
+{
+    return MRH_SRV_Send(p_Server, e_Message, p_Data, p_Password, (i_TimeoutMS < 0) ? -1 : i_TimeoutMS, -1);
+}
+
+int MRH_SRV_SendMessagePriority(MRH_Srv_Server* p_Server, MRH_Srv_NetMessage e_Message, const void* p_Data, const char* p_Password, uint16_t u16_Priority)
+{
+    return MRH_SRV_Send(p_Server, e_Message, p_Data, p_Password, 0, (int)u16_Priority);
+}
+
+int MRH_SRV_SendMessages(MRH_Srv_Server* p_Server, const MRH_Srv_SendEntry* p_Entry, size_t us_Count, const char* p_Password)
+{
+    // @NOTE: Framed batches are written into one buffer, keep it small
+    if (p_Server == NULL || p_Entry == NULL || us_Count == 0 || us_Count > MRH_SRV_SIZE_SEND_BATCH_MAX)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    
+    MRH_SRV_WaitReplay(p_Server);
+    
+    MRH_MsQuicConnection* p_MsQuic = p_Server->p_MsQuic;
+    int i_Queue = -1;
+    
+    if (p_MsQuic->p_Connection == NULL)
+    {
+        if (p_MsQuic->i_Replay != 0)
+        {
+            MRH_ERR_SetServerError(MRH_SERVER_ERROR_SEND_DISCONNECTED);
+            return -1;
+        }
+        
+        // Kept for the next connection
+        i_Queue = 0;
+    }
+    
+    // Framed batches share a single buffer, single message streams need one each
+    int i_Framed = (p_MsQuic->i_Transport == MRH_MSQ_TRANSPORT_FRAMED) ? 0 : -1;
+    size_t us_Reserve = (i_Framed == 0) ? 1 : us_Count;
+    
+    if (us_Reserve > MRH_SRV_MESSAGE_BUFFER_COUNT)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_SEND_QUEUE_FULL);
+        return -1;
+    }
+    
+    MRH_MsQuicMessage* p_Message[MRH_SRV_MESSAGE_BUFFER_COUNT];
+    size_t us_Reserved = 0;
+    
+    while (us_Reserved < us_Reserve && (p_Message[us_Reserved] = MRH_MsQuicGetSendMessage(p_MsQuic, 0)) != NULL)
+    {
+        us_Reserved += 1;
+    }
+    
+    if (us_Reserved < us_Reserve)
+    {
+        for (size_t i = 0; i < us_Reserved; ++i)
+        {
+            MRH_MsQuicFreeSendMessage(p_Message[i]);
+        }
+        
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_SEND_QUEUE_FULL);
+        return -1;
+    }
+    
+    // Reserve for the largest message possible, messages are written in place
+    size_t us_SequenceSize = (p_MsQuic->i_SendSequence == 0) ? MRH_MSQ_SEQUENCE_SIZE : 0;
+    size_t us_EntrySize = MRH_SRV_GetEncryptedSize(MRH_SRV_CIPHER_SECRETBOX, MRH_SRV_SIZE_MESSAGE_BUFFER_MAX) + us_SequenceSize;
+    size_t us_BufferSize;
+    
+    if (i_Framed == 0)
+    {
+        us_BufferSize = sizeof(QUIC_BUFFER) + ((MRH_MSQ_FRAME_LENGTH_SIZE + us_EntrySize) * us_Count);
+    }
+    else
+    {
+        us_BufferSize = sizeof(QUIC_BUFFER) + us_EntrySize;
+    }
+    
+    for (size_t i = 0; i < us_Reserved; ++i)
+    {
+        if (MRH_SRV_ReserveBuffer(p_Message[i], us_BufferSize) < 0)
+        {
+            for (size_t j = 0; j < us_Reserved; ++j)
+            {
+                MRH_MsQuicFreeSendMessage(p_Message[j]);
+            }
+            
+            MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_MALLOC);
+            return -1;
+        }
+    }
+    
+    // Write all messages
+    uint8_t p_MessageBuffer[MRH_SRV_SIZE_MESSAGE_BUFFER_MAX];
+    const uint8_t* p_Key = MRH_SRV_GetKey(p_Server, p_Password);
+    size_t us_FramePos = sizeof(QUIC_BUFFER);
+    size_t us_Failed = us_Count;
+    
+    for (size_t i = 0; i < us_Count; ++i)
+    {
+        int i_Encrypt;
+        size_t us_MessageSize = MRH_SRV_SetMessageBuffer(p_MessageBuffer, p_Entry[i].e_Message, p_Entry[i].p_Data, &i_Encrypt);
+        
+        if (us_MessageSize == 0)
+        {
+            MRH_ERR_SetServerError(MRH_SERVER_ERROR_SEND_INVALID_MESSAGE);
+            us_Failed = i;
+            break;
+        }
+        else if (i_Encrypt == 0 && p_Key == NULL)
+        {
+            MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+            us_Failed = i;
+            break;
+        }
+        
+        if (i_Framed == 0)
+        {
+            // Append to the shared frame buffer
+            uint8_t* p_Frame = &(p_Message[0]->p_Buffer[us_FramePos]);
+            size_t us_Written = MRH_SRV_WriteMessage(&(p_Frame[MRH_MSQ_FRAME_LENGTH_SIZE + us_SequenceSize]),
+                                                     p_MessageBuffer,
+                                                     us_MessageSize,
+                                                     i_Encrypt,
+                                                     p_Server,
+                                                     p_Key);
+            
+            if (us_Written == 0)
+            {
+                MRH_ERR_SetServerError(MRH_SERVER_ERROR_ENCRYPTION_FAILED);
+                us_Failed = i;
+                break;
+            }
+            else if (us_SequenceSize > 0)
+            {
+                us_Written = MRH_SRV_AddSequence(&(p_Frame[MRH_MSQ_FRAME_LENGTH_SIZE]), us_Written);
+            }
+            
+            MRH_SRV_SetFrameLength(p_Frame, us_Written);
+            us_FramePos += MRH_MSQ_FRAME_LENGTH_SIZE + us_Written;
+        }
+        else
+        {
+            size_t us_Written = MRH_SRV_WriteMessage(&(p_Message[i]->p_Buffer[sizeof(QUIC_BUFFER) + us_SequenceSize]),
+                                                     p_MessageBuffer,
+                                                     us_MessageSize,
+                                                     i_Encrypt,
+                                                     p_Server,
+                                                     p_Key);
+            
+            if (us_Written == 0)
+            {
+                MRH_ERR_SetServerError(MRH_SERVER_ERROR_ENCRYPTION_FAILED);
+                us_Failed = i;
+                break;
+            }
+            else if (us_SequenceSize > 0)
+            {
+                us_Written = MRH_SRV_AddSequence(&(p_Message[i]->p_Buffer[sizeof(QUIC_BUFFER)]), us_Written);
+            }
+            
+            p_Message[i]->us_SizeCur = sizeof(QUIC_BUFFER) + us_Written;
+        }
+    }
+    
+    // Nothing is sent if any message is invalid
+    if (us_Failed < us_Count)
+    {
+        for (size_t i = 0; i < us_Reserved; ++i)
+        {
+            MRH_MsQuicFreeSendMessage(p_Message[i]);
+        }
+        
+        return -1;
+    }
+    
+    // Submit all messages
+    for (size_t i = 0; i < us_Reserved; ++i)
+    {
+        p_Message[i]->i_Framed = i_Framed;
+        p_Message[i]->u64_Queued = atomic_fetch_add(&(p_MsQuic->u64_SendCount), 1);
+        p_Message[i]->u16_Priority = (i_Framed == 0) ? MRH_SRV_PRIORITY_DEFAULT : p_MsQuic->p_Priority[p_Entry[i].e_Message];
+    }
+    
+    if (i_Framed == 0)
+    {
+        // All frames go out with a single send
+        p_Message[0]->us_SizeCur = us_FramePos;
+        
+        QUIC_BUFFER* p_QuicBuffer = (QUIC_BUFFER*)(p_Message[0]->p_Buffer);
+        p_QuicBuffer->Buffer = &(p_Message[0]->p_Buffer[sizeof(QUIC_BUFFER)]);
+        p_QuicBuffer->Length = us_FramePos - sizeof(QUIC_BUFFER);
+        
+        if (i_Queue == 0)
+        {
+            p_Message[0]->i_State = MRH_MSQ_MESSAGE_REPLAY;
+        }
+        else if (MRH_SRV_SubmitFrames(p_MsQuic, p_Message[0], p_QuicBuffer) < 0)
+        {
+            MRH_MsQuicFreeSendMessage(p_Message[0]);
+            return -1;
+        }
+        
+        return 0;
+    }
+    
+    for (size_t i = 0; i < us_Count; ++i)
+    {
+        QUIC_BUFFER* p_QuicBuffer = (QUIC_BUFFER*)(p_Message[i]->p_Buffer);
+        p_QuicBuffer->Buffer = &(p_Message[i]->p_Buffer[sizeof(QUIC_BUFFER)]);
+        p_QuicBuffer->Length = p_Message[i]->us_SizeCur - sizeof(QUIC_BUFFER);
+        
+        if (i_Queue == 0)
+        {
+            p_Message[i]->i_State = MRH_MSQ_MESSAGE_REPLAY;
+        }
+        else if (MRH_SRV_SubmitStream(p_MsQuic, p_MsQuic->p_Connection, p_Message[i], p_QuicBuffer, QUIC_SEND_FLAG_NONE) < 0)
+        {
+            // Already submitted messages are freed by their streams
+            for (size_t j = i; j < us_Count; ++j)
+            {
+                MRH_MsQuicFreeSendMessage(p_Message[j]);
+            }
+            
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+
+static int MRH_SRV_SendShared(MRH_Srv_Server* p_Server, MRH_Srv_NetMessage e_Message, MRH_MsQuicShared* p_Shared)
+{
+    MRH_SRV_WaitReplay(p_Server);
+    
+    MRH_MsQuicConnection* p_MsQuic = p_Server->p_MsQuic;
+    HQUIC p_QuicConnection = p_MsQuic->p_Connection;
+    int i_Queue = -1;
+    
+    if (p_QuicConnection == NULL)
+    {
+        if (p_MsQuic->i_Replay != 0)
+        {
+            MRH_ERR_SetServerError(MRH_SERVER_ERROR_SEND_DISCONNECTED);
+            return -1;
+        }
+        
+        // Kept for the next connection
+        i_Queue = 0;
+    }
+    
+    MRH_MsQuicMessage* p_Message = MRH_MsQuicGetSendMessage(p_MsQuic, 0);
+    
+    if (p_Message == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_SEND_QUEUE_FULL);
+        return -1;
+    }
+    
+    // Only the message id, sequence number and frame length are written per
+    // connection, the message data is shared
+    size_t us_PayloadSize = 1 + p_Shared->us_Size;
+    uint16_t u16_Priority = p_MsQuic->p_Priority[e_Message];
+    int i_Datagram = MRH_SRV_UseDatagram(p_MsQuic, e_Message, us_PayloadSize);
+    int i_Framed = -1;
+    size_t us_HeaderSize = 2 * sizeof(QUIC_BUFFER);
+    
+    if (i_Datagram != 0 &&
+        u16_Priority <= MRH_SRV_PRIORITY_DEFAULT &&
+        p_MsQuic->i_Transport == MRH_MSQ_TRANSPORT_FRAMED)
+    {
+        i_Framed = 0;
+        us_HeaderSize += MRH_MSQ_FRAME_LENGTH_SIZE;
+    }
+    
+    size_t us_SequenceSize = (i_Datagram != 0 && p_MsQuic->i_SendSequence == 0) ? MRH_MSQ_SEQUENCE_SIZE : 0;
+    size_t us_BufferSize = us_HeaderSize + 1 + us_SequenceSize;
+    
+    us_PayloadSize += us_SequenceSize;
+    
+    if (MRH_SRV_ReserveBuffer(p_Message, us_BufferSize) < 0)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_MALLOC);
+        MRH_MsQuicFreeSendMessage(p_Message);
+        return -1;
+    }
+    
+    p_Message->p_Buffer[us_HeaderSize + us_SequenceSize] = (uint8_t)e_Message;
+    
+    if (us_SequenceSize > 0)
+    {
+        MRH_SRV_AddSequence(&(p_Message->p_Buffer[us_HeaderSize]), 0);
+    }
+    
+    p_Message->us_SizeCur = us_BufferSize;
+    
+    // Setup buffers for quic usage, the shared data follows the header
+    QUIC_BUFFER* p_QuicBuffer = (QUIC_BUFFER*)(p_Message->p_Buffer);
+    p_QuicBuffer[0].Buffer = &(p_Message->p_Buffer[2 * sizeof(QUIC_BUFFER)]);
+    p_QuicBuffer[0].Length = us_BufferSize - (2 * sizeof(QUIC_BUFFER));
+    
+    if (p_Shared->us_Size > 0)
+    {
+        p_QuicBuffer[1].Buffer = p_Shared->p_Buffer;
+        p_QuicBuffer[1].Length = p_Shared->us_Size;
+        
+        MRH_MsQuicAttachShared(p_Message, p_Shared);
+    }
+    
+    if (i_Framed == 0)
+    {
+        MRH_SRV_SetFrameLength(p_QuicBuffer[0].Buffer, us_PayloadSize);
+    }
+    
+    p_Message->i_Framed = i_Framed;
+    p_Message->u16_Priority = (i_Framed == 0) ? MRH_SRV_PRIORITY_DEFAULT : u16_Priority;
+    
+    return MRH_SRV_SubmitMessage(p_MsQuic, p_QuicConnection, p_Message, i_Queue, i_Datagram, QUIC_SEND_FLAG_NONE);
+}
+
+size_t MRH_SRV_Broadcast(MRH_Srv_Context* p_Context, MRH_Srv_Server* const* p_Server, size_t us_Count, MRH_Srv_NetMessage e_Message, const void* p_Data, const char* p_Password)
+{
+    if (p_Context == NULL || p_Server == NULL || us_Count == 0 ||
+        e_Message < MRH_SRV_MSG_UNK || e_Message > MRH_SRV_NET_MESSAGE_MAX)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return 0;
+    }
+    
+    // Build the message once for all servers
+    uint8_t p_MessageBuffer[MRH_SRV_SIZE_MESSAGE_BUFFER_MAX] = { '\0' };
+    int i_Encrypt;
+    size_t us_MessageSize = MRH_SRV_SetMessageBuffer(p_MessageBuffer, e_Message, p_Data, &i_Encrypt);
+    
+    if (us_MessageSize == 0)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_SEND_INVALID_MESSAGE);
+        return 0;
+    }
+    else if (i_Encrypt == 0 && p_Password == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return 0;
+    }
+    
+    // @NOTE: Exclude message id, written for each connection
+    size_t us_DataSize = us_MessageSize - 1;
+    // @NOTE: Counter nonces belong to a single server, shared data uses random nonces
+    MRH_MsQuicShared* p_Shared = MRH_MsQuicCreateShared((i_Encrypt == 0) ? MRH_SRV_GetEncryptedSize(MRH_SRV_CIPHER_SECRETBOX, us_DataSize) : us_DataSize);
+    
+    if (p_Shared == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_MALLOC);
+        return 0;
+    }
+    
+    if (i_Encrypt != 0)
+    {
+        memcpy(p_Shared->p_Buffer, &(p_MessageBuffer[1]), us_DataSize);
+    }
+    else if (MRH_SRV_Encrypt(p_Shared->p_Buffer, &(p_MessageBuffer[1]), us_DataSize, (const uint8_t*)p_Password) < 0)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_ENCRYPTION_FAILED);
+        MRH_MsQuicReleaseShared(p_Shared);
+        return 0;
+    }
+    
+    size_t us_Sent = 0;
+    
+    for (size_t i = 0; i < us_Count; ++i)
+    {
+        if (p_Server[i] == NULL || p_Server[i]->p_Context != p_Context)
+        {
+            MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+            continue;
+        }
+        else if (i_Encrypt == 0 &&
+                 (p_Server[i]->p_SessionKey != NULL || p_Server[i]->e_Cipher != MRH_SRV_CIPHER_SECRETBOX))
+        {
+            // The other side expects its own key or cipher, it can't decrypt shared data
+            MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+            continue;
+        }
+        
+        if (MRH_SRV_SendShared(p_Server[i], e_Message, p_Shared) == 0)
+        {
+            us_Sent += 1;
+        }
+    }
+    
+    // Send messages hold their own reference
+    MRH_MsQuicReleaseShared(p_Shared);
+    
+    return us_Sent;
+}
+
+static void MRH_SRV_NotifyWritable(void* p_Context)
+{
+    MRH_Srv_Server* p_Server = (MRH_Srv_Server*)p_Context;
+    MRH_MsQuicConnection* p_MsQuic = p_Server->p_MsQuic;
+    
+    // Callback and user data are set together, copy both at once
+    pthread_mutex_lock(&(p_MsQuic->p_StateMutex));
+    
+    MRH_Srv_WritableCallback p_Callback = p_Server->p_WritableCallback;
+    void* p_User = p_Server->p_WritableUser;
+    
+    pthread_mutex_unlock(&(p_MsQuic->p_StateMutex));
+    
+    if (p_Callback != NULL)
+    {
+        p_Callback(p_Server, p_User);
+    }
+}
+
+int MRH_SRV_GetSendCapacity(MRH_Srv_Server* p_Server, MRH_Srv_SendCapacity* p_Capacity)
+{
+    if (p_Server == NULL || p_Capacity == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    
+    MRH_MsQuicConnection* p_MsQuic = p_Server->p_MsQuic;
+    
+    p_Capacity->u64_IdealBytes = p_MsQuic->u64_SendIdeal;
+    p_Capacity->u64_InFlightBytes = p_MsQuic->u64_SendInFlight;
+    p_Capacity->u64_AvailableBytes = (p_Capacity->u64_InFlightBytes < p_Capacity->u64_IdealBytes) ? p_Capacity->u64_IdealBytes - p_Capacity->u64_InFlightBytes : 0;
+    p_Capacity->us_MessageCount = MRH_MsQuicGetSendFree(p_MsQuic);
+    
+    return 0;
+}
+
+int MRH_SRV_SetWritableCallback(MRH_Srv_Server* p_Server, MRH_Srv_WritableCallback p_Callback, void* p_User)
+{
+    if (p_Server == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    
+    MRH_MsQuicConnection* p_MsQuic = p_Server->p_MsQuic;
+    
+    pthread_mutex_lock(&(p_MsQuic->p_StateMutex));
+    
+    p_Server->p_WritableCallback = p_Callback;
+    p_Server->p_WritableUser = p_User;
+    
+    pthread_mutex_unlock(&(p_MsQuic->p_StateMutex));
+    
+    MRH_MsQuicSetWritableCallback(p_MsQuic, (p_Callback != NULL) ? MRH_SRV_NotifyWritable : NULL, p_Server);
+    
+    return 0;
+}
+
+//*************************************************************************************
+// Reconnect
+//*************************************************************************************
+
+static void MRH_SRV_ReplayMessages(MRH_MsQuicConnection* p_MsQuic)
+{
+    // Send kept messages in their original order
+    while (p_MsQuic->p_Connection != NULL)
+    {
+        MRH_MsQuicMessage* p_Message = NULL;
+        size_t us_ChunkCount = p_MsQuic->us_SendChunkCount;
+        
+        for (size_t i = 0; i < us_ChunkCount; ++i)
+        {
+            MRH_MsQuicMessage* p_Chunk = p_MsQuic->p_SendChunk[i];
+            
+            for (size_t j = 0; j < MRH_SRV_MESSAGE_BUFFER_COUNT; ++j)
+            {
+                if (p_Chunk[j].i_State == MRH_MSQ_MESSAGE_REPLAY &&
+                    (p_Message == NULL || p_Chunk[j].u64_Queued < p_Message->u64_Queued))
+                {
+                    p_Message = &(p_Chunk[j]);
+                }
+            }
+        }
+        
+        if (p_Message == NULL)
+        {
+            return;
+        }
+        
+        int i_State = MRH_MSQ_MESSAGE_REPLAY;
+        
+        if (atomic_compare_exchange_strong(&(p_Message->i_State), &i_State, MRH_MSQ_MESSAGE_IN_USE) == false)
+        {
+            continue;
+        }
+        
+        QUIC_BUFFER* p_QuicBuffer = (QUIC_BUFFER*)(p_Message->p_Buffer);
+        int i_Result;
+        
+        if (p_Message->i_Framed == 0)
+        {
+            i_Result = MRH_SRV_SubmitFrames(p_MsQuic, p_Message, p_QuicBuffer);
+        }
+        else
+        {
+            i_Result = MRH_SRV_SubmitStream(p_MsQuic, p_MsQuic->p_Connection, p_Message, p_QuicBuffer, QUIC_SEND_FLAG_NONE);
+        }
+        
+        if (i_Result < 0)
+        {
+            // Lost again, keep for the next connection
+            p_Message->i_State = MRH_MSQ_MESSAGE_REPLAY;
+            return;
+        }
+    }
+}
+
+static void MRH_SRV_EndReplay(MRH_MsQuicConnection* p_MsQuic)
+{
+    pthread_mutex_lock(&(p_MsQuic->p_StateMutex));
+    p_MsQuic->i_Replaying = -1;
+    pthread_cond_broadcast(&(p_MsQuic->p_StateCond));
+    pthread_mutex_unlock(&(p_MsQuic->p_StateMutex));
+}
+
+static int MRH_SRV_ReconnectDelay(MRH_Srv_Server* p_Server, int i_DelayMS)
+{
+    MRH_MsQuicConnection* p_MsQuic = p_Server->p_MsQuic;
+    struct timespec s_End;
+    
+    MRH_MsQuicGetDeadline(&s_End, i_DelayMS);
+    
+    pthread_mutex_lock(&(p_MsQuic->p_StateMutex));
+    
+    while (p_Server->i_ReconnectRun == 0 && p_MsQuic->i_Replay == 0)
+    {
+        if (pthread_cond_timedwait(&(p_MsQuic->p_StateCond), &(p_MsQuic->p_StateMutex), &s_End) != 0)
+        {
+            break;
+        }
+    }
+    
+    pthread_mutex_unlock(&(p_MsQuic->p_StateMutex));
+    
+    return (p_Server->i_ReconnectRun == 0 && p_MsQuic->i_Replay == 0) ? 0 : -1;
+}
+
+static int MRH_SRV_Reconnect(MRH_Srv_Server* p_Server)
+{
+    MRH_Srv_ReconnectPolicy* p_Policy = &(p_Server->c_Reconnect);
+    MRH_MsQuicConnection* p_MsQuic = p_Server->p_MsQuic;
+    int i_DelayMS = p_Policy->i_DelayMinMS;
+    
+    for (int i = 0; p_Policy->i_AttemptMax < 0 || i < p_Policy->i_AttemptMax; ++i)
+    {
+        // Wait between half and the full delay, spreads reconnects of many clients
+        int i_HalfMS = i_DelayMS / 2;
+        
+        if (MRH_SRV_ReconnectDelay(p_Server, i_HalfMS + (int)randombytes_uniform((uint32_t)(i_DelayMS - i_HalfMS) + 1)) < 0)
+        {
+            return -1;
+        }
+        
+        // Connecting blocks new sends until replayed
+        p_MsQuic->i_Replaying = 1;
+        
+        if (MRH_SRV_StartConnection(p_Server->p_ReconnectContext,
+                                    p_Server,
+                                    p_Server->p_Address,
+                                    p_Server->i_Port,
+                                    NULL,
+                                    NULL,
+                                    0) == 0)
+        {
+            // @NOTE: Failed handshakes complete the shutdown on their own
+            if (MRH_MsQuicWaitConnection(p_MsQuic, 0, p_Server->i_TimeoutMS) == 0)
+            {
+                return 0;
+            }
+            
+            HQUIC p_QuicConnection = p_MsQuic->p_Handle;
+            
+            if (p_QuicConnection != NULL)
+            {
+                p_MsQuic->p_MsQuicAPI->ConnectionShutdown(p_QuicConnection,
+                                                          QUIC_CONNECTION_SHUTDOWN_FLAG_NONE,
+                                                          0);
+            }
+            
+            MRH_MsQuicWaitConnection(p_MsQuic, -1, -1);
+        }
+        
+        if (i_DelayMS < p_Policy->i_DelayMaxMS)
+        {
+            i_DelayMS = (i_DelayMS > p_Policy->i_DelayMaxMS / 2) ? p_Policy->i_DelayMaxMS : i_DelayMS * 2;
+        }
+    }
+    
+    return -1;
+}
+
+static void* MRH_SRV_ReconnectThread(void* p_Arg)
+{
+    MRH_Srv_Server* p_Server = (MRH_Srv_Server*)p_Arg;
+    MRH_MsQuicConnection* p_MsQuic = p_Server->p_MsQuic;
+    
+    while (p_Server->i_ReconnectRun == 0)
+    {
+        // Wait for the connection to be lost
+        pthread_mutex_lock(&(p_MsQuic->p_StateMutex));
+        
+        while (p_Server->i_ReconnectRun == 0 &&
+               (p_MsQuic->i_Replay != 0 || p_MsQuic->p_Handle != NULL))
+        {
+            pthread_cond_wait(&(p_MsQuic->p_StateCond), &(p_MsQuic->p_StateMutex));
+        }
+        
+        pthread_mutex_unlock(&(p_MsQuic->p_StateMutex));
+        
+        if (p_Server->i_ReconnectRun != 0)
+        {
+            break;
+        }
+        else if (MRH_SRV_Reconnect(p_Server) < 0)
+        {
+            // Gave up or disconnected on purpose, kept messages can't be sent
+            p_MsQuic->i_Replay = -1;
+            MRH_MsQuicDropReplay(p_MsQuic);
+            MRH_SRV_EndReplay(p_MsQuic);
+            continue;
+        }
+        
+        // Connected again, authenticate before sending kept messages
+        if (p_Server->c_Reconnect.p_Callback != NULL &&
+            p_Server->c_Reconnect.p_Callback(p_Server, p_Server->c_Reconnect.p_User) != 0)
+        {
+            MRH_MsQuicDropReplay(p_MsQuic);
+            MRH_SRV_EndReplay(p_MsQuic);
+            continue;
+        }
+        
+        MRH_SRV_ReplayMessages(p_MsQuic);
+        MRH_SRV_EndReplay(p_MsQuic);
+    }
+    
+    // Nothing left to replay, release waiting senders
+    MRH_SRV_EndReplay(p_MsQuic);
+    return NULL;
+}
+
+int MRH_SRV_SetReconnect(MRH_Srv_Context* p_Context, MRH_Srv_Server* p_Server, const MRH_Srv_ReconnectPolicy* p_Policy)
+{
+    // @NOTE: The reconnect callback can't replace its own thread
+    if (p_Context == NULL || p_Server == NULL || MRH_SRV_IsReconnectThread(p_Server) == 0 ||
+        (p_Policy != NULL && (p_Policy->i_DelayMinMS <= 0 || p_Policy->i_DelayMaxMS < p_Policy->i_DelayMinMS ||
+                              p_Context->u8_DeviceType == MRH_SRV_SERVER)))
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    
+    MRH_MsQuicConnection* p_MsQuic = p_Server->p_MsQuic;
+    
+    // Stop the current thread first, the policy is read without locking
+    if (p_Server->i_ReconnectRun == 0)
+    {
+        pthread_mutex_lock(&(p_MsQuic->p_StateMutex));
+        p_Server->i_ReconnectRun = -1;
+        pthread_cond_broadcast(&(p_MsQuic->p_StateCond));
+        pthread_mutex_unlock(&(p_MsQuic->p_StateMutex));
+        
+        pthread_join(p_Server->p_ReconnectThread, NULL);
+    }
+    
+    if (p_Policy == NULL)
+    {
+        p_MsQuic->i_Replay = -1;
+        MRH_MsQuicDropReplay(p_MsQuic);
+        return 0;
+    }
+    
+    p_Server->p_ReconnectContext = p_Context;
+    p_Server->c_Reconnect = *p_Policy;
+    p_Server->i_ReconnectRun = 0;
+    
+    // Restore the current connection if lost
+    p_MsQuic->i_Replay = (p_MsQuic->p_Handle != NULL) ? 0 : -1;
+    
+    if (pthread_create(&(p_Server->p_ReconnectThread), NULL, MRH_SRV_ReconnectThread, p_Server) != 0)
+    {
+        p_Server->i_ReconnectRun = -1;
+        p_MsQuic->i_Replay = -1;
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_MALLOC);
         return -1;
     }
     
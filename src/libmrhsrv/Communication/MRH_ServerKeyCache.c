@@ -0,0 +1,238 @@
+/**
+ *  libmrhsrv
+ *  Copyright (C) 2021 - 2022 Jens Brörken
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty.  In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any source distribution.
+ */
+
+// C
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// External
+
+// Project
+#include "./MRH_ServerKeyCache.h"
+
+// Pre-defined
+#define MRH_SRV_KEY_TAG_INPUT_SIZE (MRH_SRV_SIZE_ACCOUNT_MAIL + MRH_SRV_SIZE_ACCOUNT_PASSWORD_SALT + 1 + MRH_SRV_SIZE_ACCOUNT_PASSWORD)
+
+
+//*************************************************************************************
+// Cache
+//*************************************************************************************
+
+MRH_Srv_KeyCache* MRH_SRV_CreateKeyCache(size_t us_Count, uint32_t u32_ExpireS)
+{
+    MRH_Srv_KeyCache* p_Cache = (MRH_Srv_KeyCache*)malloc(sizeof(MRH_Srv_KeyCache));
+    
+    if (p_Cache == NULL)
+    {
+        return NULL;
+    }
+    else if (pthread_mutex_init(&(p_Cache->p_Mutex), NULL) != 0)
+    {
+        free(p_Cache);
+        return NULL;
+    }
+    
+    // @NOTE: sodium_malloc locks the pages and adds guard pages
+    p_Cache->p_Key = (MRH_Srv_CachedKey*)sodium_allocarray(us_Count, sizeof(MRH_Srv_CachedKey));
+    p_Cache->p_TagKey = (uint8_t*)sodium_malloc(crypto_generichash_KEYBYTES);
+    
+    if (p_Cache->p_Key == NULL || p_Cache->p_TagKey == NULL)
+    {
+        if (p_Cache->p_Key != NULL)
+        {
+            sodium_free(p_Cache->p_Key);
+        }
+        
+        if (p_Cache->p_TagKey != NULL)
+        {
+            sodium_free(p_Cache->p_TagKey);
+        }
+        
+        pthread_mutex_destroy(&(p_Cache->p_Mutex));
+        free(p_Cache);
+        return NULL;
+    }
+    
+    sodium_memzero(p_Cache->p_Key, us_Count * sizeof(MRH_Srv_CachedKey));
+    randombytes_buf(p_Cache->p_TagKey, crypto_generichash_KEYBYTES);
+    
+    sodium_mprotect_noaccess(p_Cache->p_Key);
+    sodium_mprotect_noaccess(p_Cache->p_TagKey);
+    
+    p_Cache->us_Count = us_Count;
+    p_Cache->u32_ExpireS = u32_ExpireS;
+    p_Cache->u64_Use = 0;
+    
+    return p_Cache;
+}
+
+MRH_Srv_KeyCache* MRH_SRV_DestroyKeyCache(MRH_Srv_KeyCache* p_Cache)
+{
+    // @NOTE: sodium_free wipes the memory
+    sodium_free(p_Cache->p_Key);
+    sodium_free(p_Cache->p_TagKey);
+    
+    pthread_mutex_destroy(&(p_Cache->p_Mutex));
+    free(p_Cache);
+    
+    return NULL;
+}
+
+//*************************************************************************************
+// Keys
+//*************************************************************************************
+
+static uint64_t MRH_SRV_GetKeyTime(void)
+{
+    struct timespec s_Now;
+    clock_gettime(CLOCK_MONOTONIC, &s_Now);
+    
+    return (uint64_t)s_Now.tv_sec;
+}
+
+static void MRH_SRV_CreateKeyTag(MRH_Srv_KeyCache* p_Cache, uint8_t* p_Tag, const char* p_Account, const char* p_Password, const char* p_Salt, uint8_t u8_HashType)
+{
+    // Fixed size input, the account is zero padded
+    uint8_t p_Input[MRH_SRV_KEY_TAG_INPUT_SIZE] = { '\0' };
+    uint8_t* p_Pos = p_Input;
+    
+    memcpy(p_Pos, p_Account, strnlen(p_Account, MRH_SRV_SIZE_ACCOUNT_MAIL));
+    p_Pos += MRH_SRV_SIZE_ACCOUNT_MAIL;
+    memcpy(p_Pos, p_Salt, MRH_SRV_SIZE_ACCOUNT_PASSWORD_SALT);
+    p_Pos += MRH_SRV_SIZE_ACCOUNT_PASSWORD_SALT;
+    *p_Pos = u8_HashType;
+    p_Pos += 1;
+    memcpy(p_Pos, p_Password, MRH_SRV_SIZE_ACCOUNT_PASSWORD);
+    
+    crypto_generichash(p_Tag,
+                       crypto_generichash_BYTES,
+                       p_Input,
+                       MRH_SRV_KEY_TAG_INPUT_SIZE,
+                       p_Cache->p_TagKey,
+                       crypto_generichash_KEYBYTES);
+    
+    sodium_memzero(p_Input, MRH_SRV_KEY_TAG_INPUT_SIZE);
+}
+
+static void MRH_SRV_LockKeyCache(MRH_Srv_KeyCache* p_Cache)
+{
+    pthread_mutex_lock(&(p_Cache->p_Mutex));
+    
+    sodium_mprotect_readwrite(p_Cache->p_Key);
+    sodium_mprotect_readonly(p_Cache->p_TagKey);
+}
+
+static void MRH_SRV_UnlockKeyCache(MRH_Srv_KeyCache* p_Cache)
+{
+    sodium_mprotect_noaccess(p_Cache->p_TagKey);
+    sodium_mprotect_noaccess(p_Cache->p_Key);
+    
+    pthread_mutex_unlock(&(p_Cache->p_Mutex));
+}
+
+int MRH_SRV_FindCachedKey(MRH_Srv_KeyCache* p_Cache, uint8_t* p_Key, const char* p_Account, const char* p_Password, const char* p_Salt, uint8_t u8_HashType)
+{
+    uint8_t p_Tag[crypto_generichash_BYTES];
+    uint64_t u64_Now = MRH_SRV_GetKeyTime();
+    int i_Result = -1;
+    
+    MRH_SRV_LockKeyCache(p_Cache);
+    MRH_SRV_CreateKeyTag(p_Cache, p_Tag, p_Account, p_Password, p_Salt, u8_HashType);
+    
+    for (size_t i = 0; i < p_Cache->us_Count; ++i)
+    {
+        MRH_Srv_CachedKey* p_Entry = &(p_Cache->p_Key[i]);
+        
+        if (p_Entry->u64_ExpireS == 0)
+        {
+            continue;
+        }
+        else if (p_Entry->u64_ExpireS <= u64_Now)
+        {
+            sodium_memzero(p_Entry, sizeof(MRH_Srv_CachedKey));
+        }
+        else if (i_Result != 0 && sodium_memcmp(p_Entry->p_Tag, p_Tag, crypto_generichash_BYTES) == 0)
+        {
+            memcpy(p_Key, p_Entry->p_Key, MRH_SRV_SIZE_ACCOUNT_PASSWORD);
+            p_Entry->u64_LastUse = ++(p_Cache->u64_Use);
+            i_Result = 0;
+        }
+    }
+    
+    MRH_SRV_UnlockKeyCache(p_Cache);
+    
+    return i_Result;
+}
+
+void MRH_SRV_StoreCachedKey(MRH_Srv_KeyCache* p_Cache, const uint8_t* p_Key, const char* p_Account, const char* p_Password, const char* p_Salt, uint8_t u8_HashType)
+{
+    if (p_Cache->us_Count == 0)
+    {
+        return;
+    }
+    
+    uint8_t p_Tag[crypto_generichash_BYTES];
+    uint64_t u64_Now = MRH_SRV_GetKeyTime();
+    
+    MRH_SRV_LockKeyCache(p_Cache);
+    MRH_SRV_CreateKeyTag(p_Cache, p_Tag, p_Account, p_Password, p_Salt, u8_HashType);
+    
+    // Replace the same key, then unused or expired keys, then the oldest key
+    MRH_Srv_CachedKey* p_Entry = &(p_Cache->p_Key[0]);
+    
+    for (size_t i = 0; i < p_Cache->us_Count; ++i)
+    {
+        MRH_Srv_CachedKey* p_Cur = &(p_Cache->p_Key[i]);
+        
+        if (p_Cur->u64_ExpireS != 0 && sodium_memcmp(p_Cur->p_Tag, p_Tag, crypto_generichash_BYTES) == 0)
+        {
+            p_Entry = p_Cur;
+            break;
+        }
+        else if (p_Cur->u64_ExpireS <= u64_Now)
+        {
+            p_Entry = p_Cur;
+        }
+        else if (p_Entry->u64_ExpireS > u64_Now && p_Cur->u64_LastUse < p_Entry->u64_LastUse)
+        {
+            p_Entry = p_Cur;
+        }
+    }
+    
+    memcpy(p_Entry->p_Tag, p_Tag, crypto_generichash_BYTES);
+    memcpy(p_Entry->p_Key, p_Key, MRH_SRV_SIZE_ACCOUNT_PASSWORD);
+    p_Entry->u64_ExpireS = u64_Now + p_Cache->u32_ExpireS;
+    p_Entry->u64_LastUse = ++(p_Cache->u64_Use);
+    
+    MRH_SRV_UnlockKeyCache(p_Cache);
+}
+
+void MRH_SRV_WipeKeyCache(MRH_Srv_KeyCache* p_Cache)
+{
+    MRH_SRV_LockKeyCache(p_Cache);
+    
+    sodium_memzero(p_Cache->p_Key, p_Cache->us_Count * sizeof(MRH_Srv_CachedKey));
+    
+    MRH_SRV_UnlockKeyCache(p_Cache);
+}
@@ -0,0 +1,128 @@
+/**
+ *  libmrhsrv
+ *  Copyright (C) 2021 - 2022 Jens Brörken
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty.  In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any source distribution.
+ */
+
+#ifndef MRH_ServerKeyCache_h
+#define MRH_ServerKeyCache_h
+
+// C
+#include <pthread.h>
+
+// External
+#include <sodium.h>
+
+// Project
+#include "../../../include/libmrhsrv/libmrhsrv/MRH_ServerSizes.h"
+
+
+//*************************************************************************************
+// Key
+//*************************************************************************************
+
+typedef struct MRH_Srv_CachedKey_t
+{
+    uint8_t p_Tag[crypto_generichash_BYTES]; // Keyed hash of account, salt, hash type and password
+    uint8_t p_Key[MRH_SRV_SIZE_ACCOUNT_PASSWORD];
+    
+    uint64_t u64_ExpireS; // CLOCK_MONOTONIC seconds, 0 if unused
+    uint64_t u64_LastUse; // Oldest key is replaced if full
+    
+}MRH_Srv_CachedKey;
+
+//*************************************************************************************
+// Cache
+//*************************************************************************************
+
+typedef struct MRH_Srv_KeyCache_t
+{
+    pthread_mutex_t p_Mutex;
+    
+    // Guarded memory, only accessible while the mutex is held
+    MRH_Srv_CachedKey* p_Key;
+    uint8_t* p_TagKey;
+    
+    size_t us_Count;
+    uint32_t u32_ExpireS;
+    uint64_t u64_Use;
+    
+}MRH_Srv_KeyCache;
+
+/**
+ *  Create a new empty key cache.
+ *
+ *  \param us_Count The number of keys to keep.
+ *  \param u32_ExpireS The time in seconds a key is kept after it was derived.
+ *
+ *  \return The key cache on success, NULL on failure.
+ */
+
+extern MRH_Srv_KeyCache* MRH_SRV_CreateKeyCache(size_t us_Count, uint32_t u32_ExpireS);
+
+/**
+ *  Destroy a key cache. All keys are wiped.
+ *
+ *  \param p_Cache The key cache to destroy.
+ *
+ *  \return Always NULL.
+ */
+
+extern MRH_Srv_KeyCache* MRH_SRV_DestroyKeyCache(MRH_Srv_KeyCache* p_Cache);
+
+/**
+ *  Get a cached key. Expired keys are wiped.
+ *
+ *  \param p_Cache The key cache to use.
+ *  \param p_Key The key buffer. The buffer has to be of size
+ *               MRH_SRV_SIZE_ACCOUNT_PASSWORD.
+ *  \param p_Account The account mail the key belongs to.
+ *  \param p_Password The account password the key was derived from.
+ *  \param p_Salt The salt the key was derived with.
+ *  \param u8_HashType The hash type the key was derived with.
+ *
+ *  \return 0 if a key was found, -1 if not.
+ */
+
+extern int MRH_SRV_FindCachedKey(MRH_Srv_KeyCache* p_Cache, uint8_t* p_Key, const char* p_Account, const char* p_Password, const char* p_Salt, uint8_t u8_HashType);
+
+/**
+ *  Add a derived key to the cache.
+ *
+ *  \param p_Cache The key cache to use.
+ *  \param p_Key The derived key of size MRH_SRV_SIZE_ACCOUNT_PASSWORD.
+ *  \param p_Account The account mail the key belongs to.
+ *  \param p_Password The account password the key was derived from.
+ *  \param p_Salt The salt the key was derived with.
+ *  \param u8_HashType The hash type the key was derived with.
+ */
+
+extern void MRH_SRV_StoreCachedKey(MRH_Srv_KeyCache* p_Cache, const uint8_t* p_Key, const char* p_Account, const char* p_Password, const char* p_Salt, uint8_t u8_HashType);
+
+/**
+ *  Wipe all keys in the cache.
+ *
+ *  \param p_Cache The key cache to wipe.
+ */
+
+extern void MRH_SRV_WipeKeyCache(MRH_Srv_KeyCache* p_Cache);
+
+
+#endif /* MRH_ServerKeyCache_h */
@@ -0,0 +1,544 @@
+/**
+ *  libmrhsrv
+ *  Copyright (C) 2021 - 2022 Jens Brörken
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty.  In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any source distribution.
+ */
+
+
+// C
+#include <stdlib.h>
+#include <string.h>
+
+// External
+#include <sodium.h>
+
+// Project
+#include "../../../include/libmrhsrv/libmrhsrv/Communication/MRH_ServerCommunication.h"
+#include "../Error/MRH_ServerErrorInternal.h"
+#include "../MRH_ServerTypesInternal.h"
+#include "./MsQuic/MRH_MsQuic.h"
+
+// Pre-defined
+#define MRH_SRV_STREAM_CHUNK_LENGTH_SIZE 4 // Chunks are [Length (uint32_t, LE)][Encrypted Chunk]
+#define MRH_SRV_STREAM_CIPHER_SIZE_MAX (MRH_SRV_SIZE_STREAM_CHUNK_MAX + crypto_secretstream_xchacha20poly1305_ABYTES)
+
+
+//*************************************************************************************
+// Stream
+//*************************************************************************************
+
+struct MRH_Srv_Stream_t
+{
+    MRH_MsQuicTransfer* p_Transfer;
+    crypto_secretstream_xchacha20poly1305_state c_State;
+    
+    int i_Send; // 0 for send streams
+    int i_Failed; // 0 if the stream can't be used anymore
+    int i_Complete; // 0 once the final chunk was sent or recieved
+    
+    // Recieve
+    uint8_t p_Key[crypto_secretstream_xchacha20poly1305_KEYBYTES]; // Kept until the header was read
+    int i_Header; // 0 once the header was read
+    size_t us_CipherSize; // Size of the next encrypted chunk, 0 if not yet read
+    uint8_t* p_Cipher;
+    uint8_t* p_Plain;
+    size_t us_PlainPos;
+    size_t us_PlainSize;
+};
+
+static MRH_Srv_Stream* MRH_SRV_CreateStream(MRH_MsQuicTransfer* p_Transfer, int i_Send)
+{
+    MRH_Srv_Stream* p_Stream = (MRH_Srv_Stream*)malloc(sizeof(MRH_Srv_Stream));
+    
+    if (p_Stream == NULL)
+    {
+        return NULL;
+    }
+    
+    p_Stream->p_Transfer = p_Transfer;
+    p_Stream->i_Send = i_Send;
+    p_Stream->i_Failed = -1;
+    p_Stream->i_Complete = -1;
+    p_Stream->i_Header = -1;
+    p_Stream->us_CipherSize = 0;
+    p_Stream->p_Cipher = NULL;
+    p_Stream->p_Plain = NULL;
+    p_Stream->us_PlainPos = 0;
+    p_Stream->us_PlainSize = 0;
+    
+    // Recieved chunks are decrypted in place of the stream
+    if (i_Send != 0)
+    {
+        p_Stream->p_Cipher = (uint8_t*)malloc(MRH_SRV_STREAM_CIPHER_SIZE_MAX);
+        p_Stream->p_Plain = (uint8_t*)malloc(MRH_SRV_SIZE_STREAM_CHUNK_MAX);
+        
+        if (p_Stream->p_Cipher == NULL || p_Stream->p_Plain == NULL)
+        {
+            free(p_Stream->p_Cipher);
+            free(p_Stream->p_Plain);
+            free(p_Stream);
+            return NULL;
+        }
+    }
+    
+    return p_Stream;
+}
+
+MRH_Srv_Stream* MRH_SRV_StreamClose(MRH_Srv_Stream* p_Stream)
+{
+    if (p_Stream == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return NULL;
+    }
+    
+    // Unfinished payloads are useless for the peer
+    if (p_Stream->i_Complete != 0)
+    {
+        MRH_MsQuicShutdownTransfer(p_Stream->p_Transfer, 0);
+    }
+    
+    MRH_MsQuicReleaseTransfer(p_Stream->p_Transfer);
+    
+    if (p_Stream->p_Cipher != NULL)
+    {
+        free(p_Stream->p_Cipher);
+    }
+    
+    if (p_Stream->p_Plain != NULL)
+    {
+        sodium_memzero(p_Stream->p_Plain, MRH_SRV_SIZE_STREAM_CHUNK_MAX);
+        free(p_Stream->p_Plain);
+    }
+    
+    sodium_memzero(p_Stream, sizeof(MRH_Srv_Stream));
+    free(p_Stream);
+    
+    return NULL;
+}
+
+//*************************************************************************************
+// Send
+//*************************************************************************************
+
+static int MRH_SRV_StreamReserve(MRH_MsQuicTransfer* p_Transfer, size_t us_Size, int i_TimeoutMS)
+{
+    switch (MRH_MsQuicReserveTransfer(p_Transfer, us_Size, i_TimeoutMS))
+    {
+        case MRH_MSQ_TRANSFER_READY:
+            return 0;
+        case MRH_MSQ_TRANSFER_TIMEOUT:
+            MRH_ERR_SetServerError(MRH_SERVER_ERROR_STREAM_TIMEOUT);
+            return 1;
+            
+        default:
+            MRH_ERR_SetServerError(MRH_SERVER_ERROR_STREAM_CLOSED);
+            return -1;
+    }
+}
+
+static int MRH_SRV_StreamPush(MRH_Srv_Stream* p_Stream, const uint8_t* p_Data, size_t us_Size, unsigned char u8_Tag, int i_TimeoutMS)
+{
+    size_t us_CipherSize = us_Size + crypto_secretstream_xchacha20poly1305_ABYTES;
+    size_t us_ChunkSize = MRH_SRV_STREAM_CHUNK_LENGTH_SIZE + us_CipherSize;
+    
+    // Wait before encrypting, a timeout leaves the stream state untouched
+    int i_Result = MRH_SRV_StreamReserve(p_Stream->p_Transfer, us_ChunkSize, i_TimeoutMS);
+    
+    if (i_Result != 0)
+    {
+        return i_Result;
+    }
+    
+    uint8_t* p_Buffer = (uint8_t*)malloc(sizeof(QUIC_BUFFER) + us_ChunkSize);
+    
+    if (p_Buffer == NULL)
+    {
+        // Nothing was encrypted yet, the stream can still be used
+        MRH_MsQuicUnreserveTransfer(p_Stream->p_Transfer, us_ChunkSize);
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_MALLOC);
+        return 1;
+    }
+    
+    uint8_t* p_Chunk = &(p_Buffer[sizeof(QUIC_BUFFER)]);
+    
+    p_Chunk[0] = (uint8_t)(us_CipherSize & 0xFF);
+    p_Chunk[1] = (uint8_t)((us_CipherSize >> 8) & 0xFF);
+    p_Chunk[2] = (uint8_t)((us_CipherSize >> 16) & 0xFF);
+    p_Chunk[3] = (uint8_t)((us_CipherSize >> 24) & 0xFF);
+    
+    if (crypto_secretstream_xchacha20poly1305_push(&(p_Stream->c_State),
+                                                   &(p_Chunk[MRH_SRV_STREAM_CHUNK_LENGTH_SIZE]),
+                                                   NULL,
+                                                   p_Data,
+                                                   us_Size,
+                                                   NULL,
+                                                   0,
+                                                   u8_Tag) != 0)
+    {
+        MRH_MsQuicUnreserveTransfer(p_Stream->p_Transfer, us_ChunkSize);
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_ENCRYPTION_FAILED);
+        free(p_Buffer);
+        return -1;
+    }
+    
+    // The final chunk also ends the stream
+    if (MRH_MsQuicSendTransfer(p_Stream->p_Transfer,
+                               p_Buffer,
+                               us_ChunkSize,
+                               (u8_Tag == crypto_secretstream_xchacha20poly1305_TAG_FINAL) ? 0 : -1) < 0)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_STREAM_CLOSED);
+        return -1;
+    }
+    
+    return 0;
+}
+
+MRH_Srv_Stream* MRH_SRV_StreamBegin(MRH_Srv_Server* p_Server, const char* p_Password)
+{
+    if (p_Server == NULL || (p_Password == NULL && p_Server->p_SessionKey == NULL))
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return NULL;
+    }
+    
+    // Passed passwords replace the session key
+    const uint8_t* p_Key = (p_Password != NULL) ? (const uint8_t*)p_Password : p_Server->p_SessionKey;
+    
+    MRH_MsQuicTransfer* p_Transfer = MRH_MsQuicOpenTransfer(p_Server->p_MsQuic);
+    
+    if (p_Transfer == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_STREAM_OPEN);
+        return NULL;
+    }
+    
+    MRH_Srv_Stream* p_Stream = MRH_SRV_CreateStream(p_Transfer, 0);
+    
+    if (p_Stream == NULL)
+    {
+        MRH_MsQuicShutdownTransfer(p_Transfer, 0);
+        MRH_MsQuicReleaseTransfer(p_Transfer);
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_MALLOC);
+        return NULL;
+    }
+    
+    // The secretstream header is sent first, once
+    uint8_t* p_Buffer = (uint8_t*)malloc(sizeof(QUIC_BUFFER) + crypto_secretstream_xchacha20poly1305_HEADERBYTES);
+    
+    if (p_Buffer == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_MALLOC);
+        return MRH_SRV_StreamClose(p_Stream);
+    }
+    else if (crypto_secretstream_xchacha20poly1305_init_push(&(p_Stream->c_State),
+                                                             &(p_Buffer[sizeof(QUIC_BUFFER)]),
+                                                             p_Key) != 0)
+    {
+        free(p_Buffer);
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_ENCRYPTION_FAILED);
+        return MRH_SRV_StreamClose(p_Stream);
+    }
+    else if (MRH_MsQuicReserveTransfer(p_Transfer, crypto_secretstream_xchacha20poly1305_HEADERBYTES, -1) != MRH_MSQ_TRANSFER_READY)
+    {
+        free(p_Buffer);
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_STREAM_CLOSED);
+        return MRH_SRV_StreamClose(p_Stream);
+    }
+    else if (MRH_MsQuicSendTransfer(p_Transfer,
+                                    p_Buffer,
+                                    crypto_secretstream_xchacha20poly1305_HEADERBYTES,
+                                    -1) < 0)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_STREAM_CLOSED);
+        return MRH_SRV_StreamClose(p_Stream);
+    }
+    
+    return p_Stream;
+}
+
+int MRH_SRV_StreamWrite(MRH_Srv_Stream* p_Stream, const uint8_t* p_Data, size_t us_Size, int i_TimeoutMS)
+{
+    if (p_Stream == NULL || p_Stream->i_Send != 0 || (p_Data == NULL && us_Size > 0))
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    else if (p_Stream->i_Failed == 0)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_STREAM_CLOSED);
+        return -1;
+    }
+    
+    // @NOTE: Only the first chunk can time out, a write is either not started
+    //        or sent completely. Otherwise the caller can't know what was sent.
+    int i_Started = -1;
+    
+    while (us_Size > 0)
+    {
+        size_t us_Chunk = (us_Size > MRH_SRV_SIZE_STREAM_CHUNK_MAX) ? MRH_SRV_SIZE_STREAM_CHUNK_MAX : us_Size;
+        int i_Result = MRH_SRV_StreamPush(p_Stream,
+                                          p_Data,
+                                          us_Chunk,
+                                          crypto_secretstream_xchacha20poly1305_TAG_MESSAGE,
+                                          (i_Started == 0) ? -1 : i_TimeoutMS);
+        
+        if (i_Result != 0)
+        {
+            // Partial writes or a moved on encryption state break the payload
+            if (i_Result < 0 || i_Started == 0)
+            {
+                p_Stream->i_Failed = 0;
+            }
+            
+            return -1;
+        }
+        
+        p_Data += us_Chunk;
+        us_Size -= us_Chunk;
+        i_Started = 0;
+    }
+    
+    return 0;
+}
+
+int MRH_SRV_StreamEnd(MRH_Srv_Stream* p_Stream)
+{
+    if (p_Stream == NULL || p_Stream->i_Send != 0)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    
+    int i_Result = -1;
+    
+    if (p_Stream->i_Failed == 0)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_STREAM_CLOSED);
+    }
+    else if (MRH_SRV_StreamPush(p_Stream, NULL, 0, crypto_secretstream_xchacha20poly1305_TAG_FINAL, -1) == 0)
+    {
+        p_Stream->i_Complete = 0;
+        i_Result = 0;
+    }
+    
+    MRH_SRV_StreamClose(p_Stream);
+    
+    return i_Result;
+}
+
+//*************************************************************************************
+// Recieve
+//*************************************************************************************
+
+static int MRH_SRV_StreamWait(MRH_MsQuicTransfer* p_Transfer, size_t us_Size, int i_TimeoutMS)
+{
+    switch (MRH_MsQuicWaitTransfer(p_Transfer, us_Size, i_TimeoutMS))
+    {
+        case MRH_MSQ_TRANSFER_READY:
+            return 0;
+        case MRH_MSQ_TRANSFER_TIMEOUT:
+            return 1;
+            
+        // Ended before the final chunk, payload is incomplete
+        default:
+            MRH_ERR_SetServerError(MRH_SERVER_ERROR_STREAM_CLOSED);
+            return -1;
+    }
+}
+
+static int MRH_SRV_StreamPull(MRH_Srv_Stream* p_Stream, int i_TimeoutMS)
+{
+    MRH_MsQuicTransfer* p_Transfer = p_Stream->p_Transfer;
+    int i_Result;
+    
+    // Read the header first, needed for all chunks
+    if (p_Stream->i_Header != 0)
+    {
+        uint8_t p_Header[crypto_secretstream_xchacha20poly1305_HEADERBYTES];
+        
+        if ((i_Result = MRH_SRV_StreamWait(p_Transfer, crypto_secretstream_xchacha20poly1305_HEADERBYTES, i_TimeoutMS)) != 0)
+        {
+            return i_Result;
+        }
+        
+        MRH_MsQuicReadTransfer(p_Transfer, p_Header, crypto_secretstream_xchacha20poly1305_HEADERBYTES);
+        
+        if (crypto_secretstream_xchacha20poly1305_init_pull(&(p_Stream->c_State), p_Header, p_Stream->p_Key) != 0)
+        {
+            MRH_ERR_SetServerError(MRH_SERVER_ERROR_ENCRYPTION_FAILED);
+            return -1;
+        }
+        
+        sodium_memzero(p_Stream->p_Key, crypto_secretstream_xchacha20poly1305_KEYBYTES);
+        p_Stream->i_Header = 0;
+    }
+    
+    // Next chunk length
+    if (p_Stream->us_CipherSize == 0)
+    {
+        uint8_t p_Length[MRH_SRV_STREAM_CHUNK_LENGTH_SIZE];
+        
+        if ((i_Result = MRH_SRV_StreamWait(p_Transfer, MRH_SRV_STREAM_CHUNK_LENGTH_SIZE, i_TimeoutMS)) != 0)
+        {
+            return i_Result;
+        }
+        
+        MRH_MsQuicReadTransfer(p_Transfer, p_Length, MRH_SRV_STREAM_CHUNK_LENGTH_SIZE);
+        
+        p_Stream->us_CipherSize = (size_t)(p_Length[0]) |
+                                  ((size_t)(p_Length[1]) << 8) |
+                                  ((size_t)(p_Length[2]) << 16) |
+                                  ((size_t)(p_Length[3]) << 24);
+        
+        if (p_Stream->us_CipherSize < crypto_secretstream_xchacha20poly1305_ABYTES ||
+            p_Stream->us_CipherSize > MRH_SRV_STREAM_CIPHER_SIZE_MAX)
+        {
+            MRH_ERR_SetServerError(MRH_SERVER_ERROR_ENCRYPTION_FAILED);
+            return -1;
+        }
+    }
+    
+    // Full chunk is needed for decryption
+    if ((i_Result = MRH_SRV_StreamWait(p_Transfer, p_Stream->us_CipherSize, i_TimeoutMS)) != 0)
+    {
+        return i_Result;
+    }
+    
+    MRH_MsQuicReadTransfer(p_Transfer, p_Stream->p_Cipher, p_Stream->us_CipherSize);
+    
+    unsigned long long u64_PlainSize;
+    unsigned char u8_Tag;
+    
+    if (crypto_secretstream_xchacha20poly1305_pull(&(p_Stream->c_State),
+                                                   p_Stream->p_Plain,
+                                                   &u64_PlainSize,
+                                                   &u8_Tag,
+                                                   p_Stream->p_Cipher,
+                                                   p_Stream->us_CipherSize,
+                                                   NULL,
+                                                   0) != 0)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_ENCRYPTION_FAILED);
+        return -1;
+    }
+    
+    p_Stream->us_CipherSize = 0;
+    p_Stream->us_PlainPos = 0;
+    p_Stream->us_PlainSize = (size_t)u64_PlainSize;
+    
+    if (u8_Tag == crypto_secretstream_xchacha20poly1305_TAG_FINAL)
+    {
+        p_Stream->i_Complete = 0;
+    }
+    
+    return 0;
+}
+
+MRH_Srv_Stream* MRH_SRV_StreamAccept(MRH_Srv_Server* p_Server, const char* p_Password)
+{
+    if (p_Server == NULL || (p_Password == NULL && p_Server->p_SessionKey == NULL))
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return NULL;
+    }
+    
+    // Passed passwords replace the session key
+    const uint8_t* p_Key = (p_Password != NULL) ? (const uint8_t*)p_Password : p_Server->p_SessionKey;
+    
+    MRH_MsQuicTransfer* p_Transfer = MRH_MsQuicAcceptTransfer(p_Server->p_MsQuic);
+    
+    if (p_Transfer == NULL)
+    {
+        return NULL;
+    }
+    
+    MRH_Srv_Stream* p_Stream = MRH_SRV_CreateStream(p_Transfer, -1);
+    
+    if (p_Stream == NULL)
+    {
+        MRH_MsQuicShutdownTransfer(p_Transfer, 0);
+        MRH_MsQuicReleaseTransfer(p_Transfer);
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_MALLOC);
+        return NULL;
+    }
+    
+    // The header might not be recieved yet
+    memcpy(p_Stream->p_Key, p_Key, crypto_secretstream_xchacha20poly1305_KEYBYTES);
+    
+    return p_Stream;
+}
+
+int MRH_SRV_StreamRead(MRH_Srv_Stream* p_Stream, uint8_t* p_Buffer, size_t us_Size, size_t* p_Read, int i_TimeoutMS)
+{
+    if (p_Stream == NULL || p_Stream->i_Send == 0 || p_Buffer == NULL || p_Read == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    
+    *p_Read = 0;
+    
+    if (p_Stream->i_Failed == 0)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_STREAM_CLOSED);
+        return -1;
+    }
+    
+    while (*p_Read < us_Size)
+    {
+        // Hand out decrypted bytes first
+        if (p_Stream->us_PlainPos < p_Stream->us_PlainSize)
+        {
+            size_t us_Copy = p_Stream->us_PlainSize - p_Stream->us_PlainPos;
+            
+            if (us_Copy > us_Size - *p_Read)
+            {
+                us_Copy = us_Size - *p_Read;
+            }
+            
+            memcpy(&(p_Buffer[*p_Read]), &(p_Stream->p_Plain[p_Stream->us_PlainPos]), us_Copy);
+            
+            p_Stream->us_PlainPos += us_Copy;
+            *p_Read += us_Copy;
+            continue;
+        }
+        else if (p_Stream->i_Complete == 0)
+        {
+            break;
+        }
+        
+        // Only wait if nothing could be read yet
+        int i_Result = MRH_SRV_StreamPull(p_Stream, (*p_Read == 0) ? i_TimeoutMS : 0);
+        
+        if (i_Result < 0)
+        {
+            p_Stream->i_Failed = 0;
+            return -1;
+        }
+        else if (i_Result > 0)
+        {
+            break;
+        }
+    }
+    
+    return (p_Stream->i_Complete == 0 && p_Stream->us_PlainPos == p_Stream->us_PlainSize) ? 1 : 0;
+}
@@ -22,6 +22,8 @@
  */
 
 // C
+#include <stdlib.h>
+#include <string.h>
 
 // External
 
@@ -29,10 +31,231 @@
 #include "./MRH_MsQuic.h"
 
 
+//*************************************************************************************
+// Recieve
+//*************************************************************************************
+
+static int MRH_MsQuicCopyRecieved(MRH_MsQuicMessage* p_Message, const uint8_t* p_Buffer, size_t us_Size)
+{
+    // Buffers are sized for the largest message, anything larger is invalid
+    size_t us_NextSize = p_Message->us_SizeCur + us_Size;
+    
+    if (us_NextSize > p_Message->us_SizeMax)
+    {
+        return -1;
+    }
+    
+    memcpy(&(p_Message->p_Buffer[p_Message->us_SizeCur]),
+           p_Buffer,
+           us_Size);
+    
+    p_Message->us_SizeCur = us_NextSize;
+    
+    return 0;
+}
+
+static int MRH_MsQuicRecieveMessage(MRH_MsQuicMessage* p_Message, const QUIC_STREAM_EVENT* Event)
+{
+    for (uint32_t i = 0; i < Event->RECEIVE.BufferCount; ++i)
+    {
+        if (MRH_MsQuicCopyRecieved(p_Message,
+                                   Event->RECEIVE.Buffers[i].Buffer,
+                                   Event->RECEIVE.Buffers[i].Length) < 0)
+        {
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+
+static uint64_t MRH_MsQuicRecieveFrames(MRH_MsQuicFrameStream* p_Frame, const QUIC_STREAM_EVENT* Event, uint64_t u64_Skip)
+{
+    uint64_t u64_Consumed = u64_Skip;
+    
+    for (uint32_t i = 0; i < Event->RECEIVE.BufferCount; ++i)
+    {
+        const uint8_t* p_Buffer = Event->RECEIVE.Buffers[i].Buffer;
+        size_t us_Size = Event->RECEIVE.Buffers[i].Length;
+        size_t us_Pos = 0;
+        
+        // Skip bytes not part of any frame
+        if (u64_Skip >= us_Size)
+        {
+            u64_Skip -= us_Size;
+            continue;
+        }
+        
+        us_Pos = (size_t)u64_Skip;
+        u64_Skip = 0;
+        
+        while (us_Pos < us_Size)
+        {
+            // Read frame length first
+            if (p_Frame->us_LengthCur < MRH_MSQ_FRAME_LENGTH_SIZE)
+            {
+                p_Frame->p_Length[p_Frame->us_LengthCur] = p_Buffer[us_Pos];
+                p_Frame->us_LengthCur += 1;
+                us_Pos += 1;
+                u64_Consumed += 1;
+                
+                if (p_Frame->us_LengthCur == MRH_MSQ_FRAME_LENGTH_SIZE)
+                {
+                    p_Frame->us_FrameSize = (size_t)(p_Frame->p_Length[0]) | ((size_t)(p_Frame->p_Length[1]) << 8);
+                    
+                    if (p_Frame->us_FrameSize == 0)
+                    {
+                        p_Frame->us_LengthCur = 0; // Empty frame, skip
+                    }
+                    else if (p_Frame->us_FrameSize > MRH_MSQ_RECIEVE_SIZE_MAX)
+                    {
+                        // Stream can't be parsed anymore, abort
+                        p_Frame->p_MsQuicAPI->StreamShutdown(p_Frame->p_Stream,
+                                                             QUIC_STREAM_SHUTDOWN_FLAG_ABORT,
+                                                             0);
+                        return Event->RECEIVE.TotalBufferLength;
+                    }
+                }
+                continue;
+            }
+            
+            // Got length, now grab a message to write to
+            if (p_Frame->p_Message == NULL)
+            {
+                if ((p_Frame->p_Message = MRH_MsQuicGetRecieveMessage(p_Frame->p_Connection)) == NULL)
+                {
+                    // Pause first, then check again in case a message was freed in between
+                    p_Frame->i_Paused = 1;
+                    
+                    if ((p_Frame->p_Message = MRH_MsQuicGetRecieveMessage(p_Frame->p_Connection)) == NULL)
+                    {
+                        return u64_Consumed;
+                    }
+                    
+                    atomic_exchange(&(p_Frame->i_Paused), 0);
+                }
+            }
+            
+            // Copy frame bytes
+            size_t us_Copy = p_Frame->us_FrameSize - p_Frame->p_Message->us_SizeCur;
+            
+            if (us_Copy > us_Size - us_Pos)
+            {
+                us_Copy = us_Size - us_Pos;
+            }
+            
+            if (MRH_MsQuicCopyRecieved(p_Frame->p_Message, &(p_Buffer[us_Pos]), us_Copy) < 0)
+            {
+                p_Frame->p_MsQuicAPI->StreamShutdown(p_Frame->p_Stream,
+                                                     QUIC_STREAM_SHUTDOWN_FLAG_ABORT,
+                                                     0);
+                return Event->RECEIVE.TotalBufferLength;
+            }
+            
+            us_Pos += us_Copy;
+            u64_Consumed += us_Copy;
+            
+            // Frame done?
+            if (p_Frame->p_Message->us_SizeCur == p_Frame->us_FrameSize)
+            {
+                MRH_MsQuicCompleteRecieveMessage(p_Frame->p_Message);
+                p_Frame->p_Message = NULL;
+                p_Frame->us_LengthCur = 0;
+            }
+        }
+    }
+    
+    return u64_Consumed;
+}
+
+static void MRH_MsQuicResetFrameStream(MRH_MsQuicFrameStream* p_Frame)
+{
+    // Partial frames are lost
+    if (p_Frame->p_Message != NULL)
+    {
+        MRH_MsQuicDropRecieveMessage(p_Frame->p_Message);
+        p_Frame->p_Message = NULL;
+    }
+    
+    p_Frame->us_LengthCur = 0;
+    p_Frame->us_FrameSize = 0;
+    p_Frame->i_Paused = 0;
+}
+
+//*************************************************************************************
+// Listener Callback
+//*************************************************************************************
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+_Function_class_(QUIC_LISTENER_CALLBACK)
+QUIC_STATUS QUIC_API MRH_MsQuicListenerCallback(_In_ HQUIC Listener, _In_opt_ void* Context, _Inout_ QUIC_LISTENER_EVENT* Event)
+{
+    MRH_MsQuicListener* p_Listener = (MRH_MsQuicListener*)Context;
+    
+    (void)Listener; // Accepted connections are tracked by the context
+    
+    switch (Event->Type)
+    {
+        case QUIC_LISTENER_EVENT_NEW_CONNECTION:
+        {
+            // Refuse early if the backlog is full, nothing was created yet
+            if (MRH_MsQuicReserveAccept(p_Listener) < 0)
+            {
+                return QUIC_STATUS_CONNECTION_REFUSED;
+            }
+            
+            HQUIC p_Connection = Event->NEW_CONNECTION.Connection;
+            MRH_MsQuicConnection* p_MsQuic = MRH_MsQuicCreateConnection(p_Listener->p_MsQuicAPI);
+            QUIC_STATUS ui_Status;
+            
+            if (p_MsQuic == NULL)
+            {
+                MRH_MsQuicCancelAccept(p_Listener);
+                return QUIC_STATUS_OUT_OF_MEMORY;
+            }
+            else if (QUIC_FAILED(ui_Status = p_Listener->p_MsQuicAPI->ConnectionSetConfiguration(p_Connection,
+                                                                                                  p_Listener->p_Configuration)))
+            {
+                // @NOTE: MsQuic closes rejected connections, no callback was set
+                MRH_MsQuicDestroyConnection(p_MsQuic);
+                MRH_MsQuicCancelAccept(p_Listener);
+                return ui_Status;
+            }
+            
+            // Queued for taking once the handshake completed
+            p_MsQuic->p_Listener = p_Listener;
+            p_MsQuic->p_ConnectContext = p_MsQuic;
+            p_MsQuic->p_ConnectCallback = MRH_MsQuicCompleteAccept;
+            p_MsQuic->p_Handle = p_Connection;
+            
+            p_Listener->p_MsQuicAPI->SetCallbackHandler(p_Connection,
+                                                        (void*)MRH_MsQuicConnectionCallback,
+                                                        p_MsQuic);
+            break;
+        }
+            
+        case QUIC_LISTENER_EVENT_STOP_COMPLETE: { break; }
+        default: { break; }
+    }
+    
+    return QUIC_STATUS_SUCCESS;
+}
+
 //*************************************************************************************
 // Connection Callback
 //*************************************************************************************
 
+static inline void MRH_MsQuicConnectComplete(MRH_MsQuicConnection* p_MsQuic, int i_Result)
+{
+    // @NOTE: Exchange, only the first result is reported
+    MRH_MsQuicConnectCallback p_Callback = atomic_exchange(&(p_MsQuic->p_ConnectCallback), NULL);
+    
+    if (p_Callback != NULL)
+    {
+        p_Callback(p_MsQuic->p_ConnectContext, i_Result);
+    }
+}
+
 _IRQL_requires_max_(DISPATCH_LEVEL)
 _Function_class_(QUIC_CONNECTION_CALLBACK)
 QUIC_STATUS QUIC_API MRH_MsQuicConnectionCallback(_In_ HQUIC Connection, _In_opt_ void* Context, _Inout_ QUIC_CONNECTION_EVENT* Event)
@@ -43,62 +266,73 @@ QUIC_STATUS QUIC_API MRH_MsQuicConnectionCallback(_In_ HQUIC Connection, _In_opt
     {
         case QUIC_CONNECTION_EVENT_CONNECTED:
         {
-            // Clear messages
-            for (size_t i = 0; i < MRH_SRV_MESSAGE_BUFFER_COUNT; ++i)
-            {
-                //p_MsQuicConnection->p_Recieved[i]->i_DataSet = -1;
-                p_MsQuic->p_Send[i].i_State = MRH_MSQ_MESSAGE_COMPLETE;
-            }
+            // @NOTE: Send messages are kept, cancelled messages are replayed
             
-            // Set connection
-            atomic_init(&(p_MsQuic->p_Connection), Connection);
+            // Sequence numbers restart with each connection
+            p_MsQuic->u32_SendSequence = 0;
+            p_MsQuic->u32_RecieveEpoch += 1;
+            p_MsQuic->i_Shutdown = -1;
+            
+            // Kept messages go first, new sends wait until they were replayed
+            int i_Reconnect = 1;
+            atomic_compare_exchange_strong(&(p_MsQuic->i_Replaying), &i_Reconnect, 0);
+            
+            // Set connection, wakes waiting connects
+            MRH_MsQuicSignalConnection(p_MsQuic, Connection);
+            MRH_MsQuicConnectComplete(p_MsQuic, 0);
             break;
         }
             
         case QUIC_CONNECTION_EVENT_SHUTDOWN_COMPLETE:
         {
-            if (p_MsQuic->p_Connection != NULL)
+            // Accepted connections are owned by the listener until connected
+            MRH_MsQuicListener* p_Listener = p_MsQuic->p_Listener;
+            HQUIC p_Connected = p_MsQuic->p_Connection;
+            
+            // @NOTE: Also close connections which never connected
+            if (Event->SHUTDOWN_COMPLETE.AppCloseInProgress == FALSE)
             {
                 p_MsQuic->p_MsQuicAPI->ConnectionClose(Connection);
-                p_MsQuic->p_Connection = NULL;
             }
-            break;
-        }
             
-        case QUIC_CONNECTION_EVENT_PEER_STREAM_STARTED:
-        {
-            // Find a free message
-            MRH_MsQuicMessage* p_Message = NULL;
+            p_MsQuic->i_DatagramSend = -1;
+            p_MsQuic->i_ZeroRTT = -1;
             
-            for (size_t i = 0; i < MRH_SRV_MESSAGE_BUFFER_COUNT; ++i)
+            // All streams are closed now, nothing to replay without reconnecting
+            if (p_MsQuic->i_Replay != 0)
             {
-                if (p_MsQuic->p_Recieved[i].i_State == MRH_MSQ_MESSAGE_FREE)
-                {
-                    p_Message = &(p_MsQuic->p_Recieved[i]);
-                    p_Message->i_State = MRH_MSQ_MESSAGE_IN_USE;
-                    p_Message->us_SizeCur = 0; // Reset to 0, new message
-                    break;
-                }
+                MRH_MsQuicDropReplay(p_MsQuic);
             }
             
-            if (p_Message != NULL)
-            {
-                p_MsQuic->p_MsQuicAPI->SetCallbackHandler(Event->PEER_STREAM_STARTED.Stream,
-                                                          (void*)MRH_MsQuicStreamCallback,
-                                                          p_Message);
-            }
-            else
+            // Never connected, inform about the failure
+            MRH_MsQuicConnectComplete(p_MsQuic, -1);
+            
+            // @NOTE: The context might be destroyed after signaling, don't touch it!
+            MRH_MsQuicSignalConnection(p_MsQuic, NULL);
+            
+            // Never connected, nobody else knows about the accepted connection
+            if (p_Listener != NULL && p_Connected == NULL)
             {
-                p_MsQuic->p_MsQuicAPI->StreamShutdown(Event->PEER_STREAM_STARTED.Stream,
-                                                      QUIC_STREAM_SHUTDOWN_FLAG_ABORT,
-                                                      0);
+                MRH_MsQuicDropAccept(p_MsQuic);
             }
             break;
         }
+            
+        case QUIC_CONNECTION_EVENT_PEER_STREAM_STARTED:
+        {
+            // @NOTE: The stream type is only known with the first bytes
+            p_MsQuic->p_MsQuicAPI->SetCallbackHandler(Event->PEER_STREAM_STARTED.Stream,
+                                                      (void*)MRH_MsQuicPeerStreamCallback,
+                                                      p_MsQuic);
+            break;
+        }
         
         case QUIC_CONNECTION_EVENT_SHUTDOWN_INITIATED_BY_PEER:
         case QUIC_CONNECTION_EVENT_SHUTDOWN_INITIATED_BY_TRANSPORT:
         {
+            // Sends cancelled from now on were lost with the connection
+            p_MsQuic->i_Shutdown = 0;
+            
             if (p_MsQuic->p_Connection != NULL)
             {
                 p_MsQuic->p_MsQuicAPI->ConnectionShutdown(Connection,
@@ -108,6 +342,67 @@ QUIC_STATUS QUIC_API MRH_MsQuicConnectionCallback(_In_ HQUIC Connection, _In_opt
             break;
         }
             
+        case QUIC_CONNECTION_EVENT_RESUMPTION_TICKET_RECEIVED:
+        {
+            // Keep for the next connection to this server
+            if (p_MsQuic->p_Tickets != NULL && p_MsQuic->p_TicketAddress != NULL)
+            {
+                MRH_MsQuicStoreTicket(p_MsQuic->p_Tickets,
+                                      p_MsQuic->p_TicketAddress,
+                                      p_MsQuic->i_TicketPort,
+                                      Event->RESUMPTION_TICKET_RECEIVED.ResumptionTicket,
+                                      Event->RESUMPTION_TICKET_RECEIVED.ResumptionTicketLength);
+            }
+            break;
+        }
+            
+        case QUIC_CONNECTION_EVENT_DATAGRAM_STATE_CHANGED:
+        {
+            p_MsQuic->us_DatagramSizeMax = Event->DATAGRAM_STATE_CHANGED.MaxSendLength;
+            p_MsQuic->i_DatagramSend = Event->DATAGRAM_STATE_CHANGED.SendEnabled ? 0 : -1;
+            break;
+        }
+            
+        case QUIC_CONNECTION_EVENT_DATAGRAM_RECEIVED:
+        {
+            // @NOTE: Datagrams are unreliable, drop if no message is free
+            MRH_MsQuicMessage* p_Message = MRH_MsQuicGetRecieveMessage(p_MsQuic);
+            
+            if (p_Message == NULL)
+            {
+                break;
+            }
+            
+            if (MRH_MsQuicCopyRecieved(p_Message,
+                                       Event->DATAGRAM_RECEIVED.Buffer->Buffer,
+                                       Event->DATAGRAM_RECEIVED.Buffer->Length) < 0 ||
+                p_Message->us_SizeCur == 0)
+            {
+                MRH_MsQuicDropRecieveMessage(p_Message);
+            }
+            else
+            {
+                MRH_MsQuicCompleteRecieveMessage(p_Message);
+            }
+            break;
+        }
+            
+        case QUIC_CONNECTION_EVENT_DATAGRAM_SEND_STATE_CHANGED:
+        {
+            // Sent, lost or cancelled, the message buffer is no longer needed
+            if (QUIC_DATAGRAM_SEND_STATE_IS_FINAL(Event->DATAGRAM_SEND_STATE_CHANGED.State))
+            {
+                MRH_MsQuicMessage* p_Message = (MRH_MsQuicMessage*)(Event->DATAGRAM_SEND_STATE_CHANGED.ClientContext);
+                
+                if (p_Message != NULL)
+                {
+                    MRH_MsQuicRemoveInFlight(p_Message);
+                    MRH_MsQuicFreeSendMessage(p_Message);
+                }
+            }
+            break;
+        }
+            
         case QUIC_CONNECTION_EVENT_RESUMED: { break; }
         default: { break; }
     }
@@ -129,44 +424,212 @@ QUIC_STATUS QUIC_API MRH_MsQuicStreamCallback(_In_ HQUIC Stream, _In_opt_ void*
     {
         case QUIC_STREAM_EVENT_SEND_COMPLETE:
         {
-            p_MsQuic->us_SizeCur = 0;
-            p_MsQuic->i_State = MRH_MSQ_MESSAGE_FREE;
+            MRH_MsQuicRemoveInFlight(p_MsQuic);
+            
+            // Cancelled sends are kept until the connection is gone
+            if (Event->SEND_COMPLETE.Canceled)
+            {
+                MRH_MsQuicCancelSendMessage(p_MsQuic);
+            }
+            else
+            {
+                MRH_MsQuicFreeSendMessage(p_MsQuic);
+            }
+            
+            p_MsQuic->p_MsQuicAPI->StreamShutdown(Stream,
+                                                  QUIC_STREAM_SHUTDOWN_FLAG_GRACEFUL,
+                                                  0);
+            break;
+        }
+            
+        case QUIC_STREAM_EVENT_IDEAL_SEND_BUFFER_SIZE:
+        {
+            MRH_MsQuicSetIdealSendSize(p_MsQuic->p_Connection, Event->IDEAL_SEND_BUFFER_SIZE.ByteCount);
+            break;
+        }
+            
+        case QUIC_STREAM_EVENT_RECEIVE:
+        {
+            if (MRH_MsQuicRecieveMessage(p_MsQuic, Event) < 0)
+            {
+                MRH_MsQuicDropRecieveMessage(p_MsQuic);
+                p_MsQuic->p_MsQuicAPI->StreamShutdown(Stream,
+                                                      QUIC_STREAM_SHUTDOWN_FLAG_ABORT,
+                                                      0);
+            }
+            break;
+        }
+            
+        case QUIC_STREAM_EVENT_PEER_SEND_ABORTED:
+        {
+            MRH_MsQuicDropRecieveMessage(p_MsQuic);
+            p_MsQuic->p_MsQuicAPI->StreamShutdown(Stream,
+                                                  QUIC_STREAM_SHUTDOWN_FLAG_ABORT,
+                                                  0);
+            break;
+        }
             
+        case QUIC_STREAM_EVENT_PEER_SEND_SHUTDOWN:
+        {
+            MRH_MsQuicCompleteRecieveMessage(p_MsQuic);
             p_MsQuic->p_MsQuicAPI->StreamShutdown(Stream,
                                                   QUIC_STREAM_SHUTDOWN_FLAG_GRACEFUL,
                                                   0);
             break;
         }
+                
+        case QUIC_STREAM_EVENT_SHUTDOWN_COMPLETE:
+        {
+            p_MsQuic->p_MsQuicAPI->StreamClose(Stream);
+            break;
+        }
             
+        default: { break; }
+    }
+    
+    return QUIC_STATUS_SUCCESS;
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+_Function_class_(QUIC_STREAM_CALLBACK)
+QUIC_STATUS QUIC_API MRH_MsQuicPeerStreamCallback(_In_ HQUIC Stream, _In_opt_ void* Context, _Inout_ QUIC_STREAM_EVENT* Event)
+{
+    MRH_MsQuicConnection* p_MsQuic = (MRH_MsQuicConnection*)Context;
+    
+    switch (Event->Type)
+    {
         case QUIC_STREAM_EVENT_RECEIVE:
         {
+            // Find the first byte of the stream
+            const uint8_t* p_First = NULL;
+            
             for (uint32_t i = 0; i < Event->RECEIVE.BufferCount; ++i)
             {
-                // Do we need to expand?
-                size_t us_NextSize = p_MsQuic->us_SizeCur + Event->RECEIVE.Buffers[i].Length;
+                if (Event->RECEIVE.Buffers[i].Length > 0)
+                {
+                    p_First = Event->RECEIVE.Buffers[i].Buffer;
+                    break;
+                }
+            }
+            
+            if (p_First == NULL)
+            {
+                break;
+            }
+            
+            if (*p_First == MRH_MSQ_STREAM_HEADER_FRAMED)
+            {
+                // Long-lived stream, grab a frame parser
+                MRH_MsQuicFrameStream* p_Frame = NULL;
                 
-                if (us_NextSize > p_MsQuic->us_SizeMax)
+                for (size_t i = 0; i < MRH_SRV_FRAME_STREAM_COUNT; ++i)
                 {
-                    if ((p_MsQuic->p_Buffer = (uint8_t*)realloc(p_MsQuic->p_Buffer, us_NextSize)) == NULL)
+                    int i_Expected = MRH_MSQ_MESSAGE_FREE;
+                    
+                    if (atomic_compare_exchange_strong(&(p_MsQuic->p_FrameRecieved[i].i_State),
+                                                       &i_Expected,
+                                                       MRH_MSQ_MESSAGE_IN_USE))
                     {
+                        p_Frame = &(p_MsQuic->p_FrameRecieved[i]);
                         break;
                     }
+                }
+                
+                if (p_Frame == NULL)
+                {
+                    p_MsQuic->p_MsQuicAPI->StreamShutdown(Stream,
+                                                          QUIC_STREAM_SHUTDOWN_FLAG_ABORT,
+                                                          0);
+                    break;
+                }
+                
+                MRH_MsQuicResetFrameStream(p_Frame);
+                p_Frame->p_Stream = Stream;
+                
+                p_MsQuic->p_MsQuicAPI->SetCallbackHandler(Stream,
+                                                          (void*)MRH_MsQuicFrameStreamCallback,
+                                                          p_Frame);
+                
+                // Skip the stream header
+                uint64_t u64_Consumed = MRH_MsQuicRecieveFrames(p_Frame, Event, 1);
+                
+                if (u64_Consumed < Event->RECEIVE.TotalBufferLength)
+                {
+                    Event->RECEIVE.TotalBufferLength = u64_Consumed;
+                }
+            }
+            else if (*p_First == MRH_MSQ_STREAM_HEADER_TRANSFER)
+            {
+                // Single large payload, read by the user
+                MRH_MsQuicTransfer* p_Transfer = MRH_MsQuicCreateTransfer(p_MsQuic, Stream);
+                
+                if (p_Transfer == NULL)
+                {
+                    p_MsQuic->p_MsQuicAPI->StreamShutdown(Stream,
+                                                          QUIC_STREAM_SHUTDOWN_FLAG_ABORT,
+                                                          0);
+                    break;
+                }
+                
+                p_MsQuic->p_MsQuicAPI->SetCallbackHandler(Stream,
+                                                          (void*)MRH_MsQuicTransferCallback,
+                                                          p_Transfer);
+                
+                // Skip the stream header
+                uint64_t u64_Consumed = MRH_MsQuicRecieveTransfer(p_Transfer, Event, 1);
+                
+                if (u64_Consumed < Event->RECEIVE.TotalBufferLength)
+                {
+                    Event->RECEIVE.TotalBufferLength = u64_Consumed;
+                }
+            }
+            else
+            {
+                // Single message stream
+                MRH_MsQuicMessage* p_Message = MRH_MsQuicGetRecieveMessage(p_MsQuic);
+                
+                if (p_Message == NULL)
+                {
+                    p_MsQuic->p_MsQuicAPI->StreamShutdown(Stream,
+                                                          QUIC_STREAM_SHUTDOWN_FLAG_ABORT,
+                                                          0);
+                    break;
+                }
+                
+                // Complete messages in a single buffer can be borrowed
+                if (p_MsQuic->i_RecieveBorrow == 0 &&
+                    (Event->RECEIVE.Flags & QUIC_RECEIVE_FLAG_FIN) &&
+                    Event->RECEIVE.BufferCount == 1 &&
+                    Event->RECEIVE.Buffers[0].Length <= MRH_MSQ_RECIEVE_SIZE_MAX &&
+                    (*p_First & MRH_MSQ_SEQUENCE_FLAG) == 0)
+                {
+                    // @NOTE: The stream keeps this callback, closing invalidates the message
+                    p_Message->p_Borrowed = Event->RECEIVE.Buffers[0].Buffer;
+                    p_Message->us_SizeCur = Event->RECEIVE.Buffers[0].Length;
+                    p_Message->p_Stream = Stream;
+                    p_Message->i_Borrow = MRH_MSQ_BORROW_PENDING;
+                    MRH_MsQuicCompleteRecieveMessage(p_Message);
                     
-                    p_MsQuic->us_SizeMax = us_NextSize;
+                    return QUIC_STATUS_PENDING;
                 }
                 
-                memcpy(&(p_MsQuic->p_Buffer[p_MsQuic->us_SizeCur]),
-                       Event->RECEIVE.Buffers[i].Buffer,
-                       Event->RECEIVE.Buffers[i].Length);
+                p_MsQuic->p_MsQuicAPI->SetCallbackHandler(Stream,
+                                                          (void*)MRH_MsQuicStreamCallback,
+                                                          p_Message);
                 
-                p_MsQuic->us_SizeCur = us_NextSize;
+                if (MRH_MsQuicRecieveMessage(p_Message, Event) < 0)
+                {
+                    MRH_MsQuicDropRecieveMessage(p_Message);
+                    p_MsQuic->p_MsQuicAPI->StreamShutdown(Stream,
+                                                          QUIC_STREAM_SHUTDOWN_FLAG_ABORT,
+                                                          0);
+                }
             }
             break;
         }
             
         case QUIC_STREAM_EVENT_PEER_SEND_ABORTED:
         {
-            p_MsQuic->i_State = MRH_MSQ_MESSAGE_FREE;
             p_MsQuic->p_MsQuicAPI->StreamShutdown(Stream,
                                                   QUIC_STREAM_SHUTDOWN_FLAG_ABORT,
                                                   0);
@@ -175,16 +638,165 @@ QUIC_STATUS QUIC_API MRH_MsQuicStreamCallback(_In_ HQUIC Stream, _In_opt_ void*
             
         case QUIC_STREAM_EVENT_PEER_SEND_SHUTDOWN:
         {
-            p_MsQuic->i_State = MRH_MSQ_MESSAGE_COMPLETE;
+            // Empty stream, nothing to recieve
             p_MsQuic->p_MsQuicAPI->StreamShutdown(Stream,
                                                   QUIC_STREAM_SHUTDOWN_FLAG_GRACEFUL,
                                                   0);
             break;
         }
-                
+            
         case QUIC_STREAM_EVENT_SHUTDOWN_COMPLETE:
         {
-            p_MsQuic->p_MsQuicAPI->StreamClose(Stream);
+            // Borrowed bytes still being read keep the stream open
+            if (MRH_MsQuicCloseBorrowed(p_MsQuic, Stream) == 0)
+            {
+                p_MsQuic->p_MsQuicAPI->StreamClose(Stream);
+            }
+            break;
+        }
+            
+        default: { break; }
+    }
+    
+    return QUIC_STATUS_SUCCESS;
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+_Function_class_(QUIC_STREAM_CALLBACK)
+QUIC_STATUS QUIC_API MRH_MsQuicFrameStreamCallback(_In_ HQUIC Stream, _In_opt_ void* Context, _Inout_ QUIC_STREAM_EVENT* Event)
+{
+    MRH_MsQuicFrameStream* p_Frame = (MRH_MsQuicFrameStream*)Context;
+    
+    switch (Event->Type)
+    {
+        case QUIC_STREAM_EVENT_SEND_COMPLETE:
+        {
+            // @NOTE: The stream header has no message
+            MRH_MsQuicMessage* p_Message = (MRH_MsQuicMessage*)(Event->SEND_COMPLETE.ClientContext);
+            
+            if (p_Message == NULL)
+            {
+                break;
+            }
+            
+            MRH_MsQuicRemoveInFlight(p_Message);
+            
+            if (Event->SEND_COMPLETE.Canceled)
+            {
+                MRH_MsQuicCancelSendMessage(p_Message);
+            }
+            else
+            {
+                MRH_MsQuicFreeSendMessage(p_Message);
+            }
+            break;
+        }
+            
+        case QUIC_STREAM_EVENT_IDEAL_SEND_BUFFER_SIZE:
+        {
+            MRH_MsQuicSetIdealSendSize(p_Frame->p_Connection, Event->IDEAL_SEND_BUFFER_SIZE.ByteCount);
+            break;
+        }
+            
+        case QUIC_STREAM_EVENT_RECEIVE:
+        {
+            uint64_t u64_Consumed = MRH_MsQuicRecieveFrames(p_Frame, Event, 0);
+            
+            if (u64_Consumed < Event->RECEIVE.TotalBufferLength)
+            {
+                Event->RECEIVE.TotalBufferLength = u64_Consumed;
+            }
+            break;
+        }
+            
+        case QUIC_STREAM_EVENT_PEER_SEND_ABORTED:
+        {
+            p_Frame->p_MsQuicAPI->StreamShutdown(Stream,
+                                                 QUIC_STREAM_SHUTDOWN_FLAG_ABORT,
+                                                 0);
+            break;
+        }
+            
+        case QUIC_STREAM_EVENT_PEER_SEND_SHUTDOWN:
+        {
+            p_Frame->p_MsQuicAPI->StreamShutdown(Stream,
+                                                 QUIC_STREAM_SHUTDOWN_FLAG_GRACEFUL,
+                                                 0);
+            break;
+        }
+            
+        case QUIC_STREAM_EVENT_SHUTDOWN_COMPLETE:
+        {
+            MRH_MsQuicResetFrameStream(p_Frame);
+            
+            p_Frame->p_Stream = NULL;
+            
+            // Recieved streams have no users, send streams drop the open reference
+            if (p_Frame->i_Users == 0)
+            {
+                p_Frame->p_MsQuicAPI->StreamClose(Stream);
+                p_Frame->i_State = MRH_MSQ_MESSAGE_FREE;
+            }
+            else
+            {
+                MRH_MsQuicReleaseFrameStream(p_Frame);
+            }
+            break;
+        }
+            
+        default: { break; }
+    }
+    
+    return QUIC_STATUS_SUCCESS;
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+_Function_class_(QUIC_STREAM_CALLBACK)
+QUIC_STATUS QUIC_API MRH_MsQuicTransferCallback(_In_ HQUIC Stream, _In_opt_ void* Context, _Inout_ QUIC_STREAM_EVENT* Event)
+{
+    MRH_MsQuicTransfer* p_Transfer = (MRH_MsQuicTransfer*)Context;
+    
+    switch (Event->Type)
+    {
+        case QUIC_STREAM_EVENT_SEND_COMPLETE:
+        case QUIC_STREAM_EVENT_PEER_SEND_SHUTDOWN:
+        {
+            MRH_MsQuicUpdateTransfer(p_Transfer, Event);
+            break;
+        }
+            
+        case QUIC_STREAM_EVENT_IDEAL_SEND_BUFFER_SIZE:
+        {
+            MRH_MsQuicSetIdealSendSize(p_Transfer->p_Connection, Event->IDEAL_SEND_BUFFER_SIZE.ByteCount);
+            break;
+        }
+            
+        case QUIC_STREAM_EVENT_RECEIVE:
+        {
+            uint64_t u64_Consumed = MRH_MsQuicRecieveTransfer(p_Transfer, Event, 0);
+            
+            if (u64_Consumed < Event->RECEIVE.TotalBufferLength)
+            {
+                Event->RECEIVE.TotalBufferLength = u64_Consumed;
+            }
+            break;
+        }
+            
+        case QUIC_STREAM_EVENT_PEER_SEND_ABORTED:
+        {
+            MRH_MsQuicUpdateTransfer(p_Transfer, Event);
+            p_Transfer->p_MsQuicAPI->StreamShutdown(Stream,
+                                                    QUIC_STREAM_SHUTDOWN_FLAG_ABORT,
+                                                    0);
+            break;
+        }
+            
+        case QUIC_STREAM_EVENT_SHUTDOWN_COMPLETE:
+        {
+            // @NOTE: Update first, the user can't use the stream afterwards
+            MRH_MsQuicUpdateTransfer(p_Transfer, Event);
+            p_Transfer->p_MsQuicAPI->StreamClose(Stream);
+            MRH_MsQuicReleaseTransfer(p_Transfer);
             break;
         }
             
@@ -30,8 +30,28 @@
 
 // Project
 #include "./MRH_MsQuicContext.h"
+#include "./MRH_MsQuicListener.h"
 
 
+//*************************************************************************************
+// Listener Callback
+//*************************************************************************************
+
+/**
+ *  MsQuic listener callback.
+ *
+ *  \param Listener The listener for the callback.
+ *  \param Context The provided listener context.
+ *  \param Event The recieved listener event.
+ *
+ *  \return The callback result.
+ */
+
+extern
+_IRQL_requires_max_(PASSIVE_LEVEL)
+_Function_class_(QUIC_LISTENER_CALLBACK)
+QUIC_STATUS QUIC_API MRH_MsQuicListenerCallback(_In_ HQUIC Listener, _In_opt_ void* Context, _Inout_ QUIC_LISTENER_EVENT* Event);
+
 //*************************************************************************************
 // Connection Callback
 //*************************************************************************************
@@ -70,5 +90,51 @@ _IRQL_requires_max_(DISPATCH_LEVEL)
 _Function_class_(QUIC_STREAM_CALLBACK)
 QUIC_STATUS QUIC_API MRH_MsQuicStreamCallback(_In_ HQUIC Stream, _In_opt_ void* Context, _Inout_ QUIC_STREAM_EVENT* Event);
 
+/**
+ *  MsQuic peer stream callback. Used until the first bytes decide if the
+ *  stream is a single message or a framed stream.
+ *
+ *  \param Stream The stream for the callback.
+ *  \param Context The provided connection context.
+ *  \param Event The recieved stream event.
+ *
+ *  \return The callback result.
+ */
+
+extern
+_IRQL_requires_max_(DISPATCH_LEVEL)
+_Function_class_(QUIC_STREAM_CALLBACK)
+QUIC_STATUS QUIC_API MRH_MsQuicPeerStreamCallback(_In_ HQUIC Stream, _In_opt_ void* Context, _Inout_ QUIC_STREAM_EVENT* Event);
+
+/**
+ *  MsQuic framed stream callback.
+ *
+ *  \param Stream The stream for the callback.
+ *  \param Context The provided frame stream context.
+ *  \param Event The recieved stream event.
+ *
+ *  \return The callback result.
+ */
+
+extern
+_IRQL_requires_max_(DISPATCH_LEVEL)
+_Function_class_(QUIC_STREAM_CALLBACK)
+QUIC_STATUS QUIC_API MRH_MsQuicFrameStreamCallback(_In_ HQUIC Stream, _In_opt_ void* Context, _Inout_ QUIC_STREAM_EVENT* Event);
+
+/**
+ *  MsQuic transfer stream callback.
+ *
+ *  \param Stream The stream for the callback.
+ *  \param Context The provided transfer context.
+ *  \param Event The recieved stream event.
+ *
+ *  \return The callback result.
+ */
+
+extern
+_IRQL_requires_max_(DISPATCH_LEVEL)
+_Function_class_(QUIC_STREAM_CALLBACK)
+QUIC_STATUS QUIC_API MRH_MsQuicTransferCallback(_In_ HQUIC Stream, _In_opt_ void* Context, _Inout_ QUIC_STREAM_EVENT* Event);
+
 
 #endif /* MRH_MsQuic_h */
@@ -23,6 +23,9 @@
 
 // C
 #include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
 
 // External
 
@@ -34,6 +37,56 @@
 // Connection
 //*************************************************************************************
 
+static void MRH_MsQuicInitMessage(MRH_MsQuicMessage* p_Message, MRH_MsQuicConnection* p_Connection)
+{
+    p_Message->p_MsQuicAPI = p_Connection->p_MsQuicAPI;
+    p_Message->p_Connection = p_Connection;
+    p_Message->p_Buffer = NULL;
+    p_Message->us_SizeCur = 0;
+    p_Message->us_SizeMax = 0;
+    p_Message->p_Borrowed = NULL;
+    p_Message->p_Stream = NULL;
+    atomic_init(&(p_Message->i_Borrow), MRH_MSQ_BORROW_NONE);
+    p_Message->i_Framed = -1;
+    p_Message->u64_Queued = 0;
+    p_Message->u16_Priority = MRH_SRV_PRIORITY_DEFAULT;
+    p_Message->p_Next = NULL;
+    p_Message->us_InFlight = 0;
+    p_Message->p_Shared = NULL;
+    p_Message->us_Offset = 0;
+    p_Message->i_Sequenced = -1;
+    p_Message->u32_Sequence = 0;
+    p_Message->u32_Epoch = 0;
+    atomic_init(&(p_Message->i_State), MRH_MSQ_MESSAGE_FREE);
+}
+
+static uint16_t MRH_MsQuicGetDefaultPriority(MRH_Srv_NetMessage e_Message)
+{
+    switch (e_Message)
+    {
+        // Auth blocks everything else
+        case MRH_SRV_MSG_AUTH_REQUEST:
+        case MRH_SRV_MSG_AUTH_CHALLENGE:
+        case MRH_SRV_MSG_AUTH_PROOF:
+        case MRH_SRV_MSG_AUTH_RESULT:
+            return MRH_SRV_PRIORITY_HIGHEST;
+            
+        // Control
+        case MRH_SRV_MSG_DATA_AVAILABLE:
+        case MRH_SRV_MSG_GET_DATA:
+        case MRH_SRV_MSG_NO_DATA:
+        case MRH_SRV_MSG_NOTIFICATION:
+            return MRH_SRV_PRIORITY_HIGH;
+            
+        // Bulk data
+        case MRH_SRV_MSG_CUSTOM:
+            return MRH_SRV_PRIORITY_LOW;
+            
+        default:
+            return MRH_SRV_PRIORITY_DEFAULT;
+    }
+}
+
 MRH_MsQuicConnection* MRH_MsQuicCreateConnection(const QUIC_API_TABLE* p_MsQuicAPI)
 {
     MRH_MsQuicConnection* p_Connection = (MRH_MsQuicConnection*)malloc(sizeof(MRH_MsQuicConnection));
@@ -45,22 +98,186 @@ MRH_MsQuicConnection* MRH_MsQuicCreateConnection(const QUIC_API_TABLE* p_MsQuicA
     
     p_Connection->p_MsQuicAPI = p_MsQuicAPI;
     p_Connection->p_Connection = NULL;
+    p_Connection->p_Handle = NULL;
+    p_Connection->p_ConnectContext = NULL;
+    atomic_init(&(p_Connection->p_ConnectCallback), NULL);
+    p_Connection->p_Listener = NULL;
+    
+    p_Connection->p_Tickets = NULL;
+    p_Connection->p_TicketAddress = NULL;
+    p_Connection->i_TicketPort = -1;
+    atomic_init(&(p_Connection->i_ZeroRTT), -1);
+    
+    atomic_init(&(p_Connection->i_Replay), -1);
+    atomic_init(&(p_Connection->i_Replaying), -1);
+    atomic_init(&(p_Connection->i_Shutdown), -1);
+    atomic_init(&(p_Connection->u64_SendCount), 0);
+    
+    pthread_condattr_t p_CondAttr;
+    
+    if (pthread_condattr_init(&p_CondAttr) != 0)
+    {
+        free(p_Connection);
+        return NULL;
+    }
+    else if (pthread_condattr_setclock(&p_CondAttr, CLOCK_MONOTONIC) != 0 ||
+             pthread_mutex_init(&(p_Connection->p_StateMutex), NULL) != 0)
+    {
+        pthread_condattr_destroy(&p_CondAttr);
+        free(p_Connection);
+        return NULL;
+    }
+    else if (pthread_cond_init(&(p_Connection->p_StateCond), &p_CondAttr) != 0)
+    {
+        pthread_mutex_destroy(&(p_Connection->p_StateMutex));
+        pthread_condattr_destroy(&p_CondAttr);
+        free(p_Connection);
+        return NULL;
+    }
+    else if (pthread_mutex_init(&(p_Connection->p_SendMutex), NULL) != 0)
+    {
+        pthread_cond_destroy(&(p_Connection->p_StateCond));
+        pthread_mutex_destroy(&(p_Connection->p_StateMutex));
+        pthread_condattr_destroy(&p_CondAttr);
+        free(p_Connection);
+        return NULL;
+    }
+    else if (pthread_cond_init(&(p_Connection->p_SendCond), &p_CondAttr) != 0)
+    {
+        pthread_mutex_destroy(&(p_Connection->p_SendMutex));
+        pthread_cond_destroy(&(p_Connection->p_StateCond));
+        pthread_mutex_destroy(&(p_Connection->p_StateMutex));
+        pthread_condattr_destroy(&p_CondAttr);
+        free(p_Connection);
+        return NULL;
+    }
+    else if (pthread_mutex_init(&(p_Connection->p_FrameMutex), NULL) != 0)
+    {
+        pthread_cond_destroy(&(p_Connection->p_SendCond));
+        pthread_mutex_destroy(&(p_Connection->p_SendMutex));
+        pthread_cond_destroy(&(p_Connection->p_StateCond));
+        pthread_mutex_destroy(&(p_Connection->p_StateMutex));
+        pthread_condattr_destroy(&p_CondAttr);
+        free(p_Connection);
+        return NULL;
+    }
+    else if (pthread_mutex_init(&(p_Connection->p_SequenceMutex), NULL) != 0)
+    {
+        pthread_mutex_destroy(&(p_Connection->p_FrameMutex));
+        pthread_cond_destroy(&(p_Connection->p_SendCond));
+        pthread_mutex_destroy(&(p_Connection->p_SendMutex));
+        pthread_cond_destroy(&(p_Connection->p_StateCond));
+        pthread_mutex_destroy(&(p_Connection->p_StateMutex));
+        pthread_condattr_destroy(&p_CondAttr);
+        free(p_Connection);
+        return NULL;
+    }
+    
+    pthread_condattr_destroy(&p_CondAttr);
 
     int i_Failed = -1;
     
+    // Recieve buffers are never resized, the worker should not allocate
+    p_Connection->p_RecieveSlab = (uint8_t*)malloc(MRH_MSQ_RECIEVE_SIZE_MAX * MRH_SRV_MESSAGE_BUFFER_COUNT);
+    
+    if (p_Connection->p_RecieveSlab == NULL)
+    {
+        i_Failed = 0;
+    }
+    
+    for (size_t i = 0; i < MRH_SRV_MESSAGE_BUFFER_COUNT; ++i)
+    {
+        MRH_MsQuicInitMessage(&(p_Connection->p_Recieved[i]), p_Connection);
+        
+        if (i_Failed != 0)
+        {
+            p_Connection->p_Recieved[i].p_Buffer = &(p_Connection->p_RecieveSlab[MRH_MSQ_RECIEVE_SIZE_MAX * i]);
+            p_Connection->p_Recieved[i].us_SizeMax = MRH_MSQ_RECIEVE_SIZE_MAX;
+        }
+    }
+    
+    // Send messages are created on first use
+    for (size_t i = 0; i < MRH_MSQ_SEND_CHUNK_COUNT; ++i)
+    {
+        p_Connection->p_SendChunk[i] = NULL;
+    }
+    
+    atomic_init(&(p_Connection->us_SendChunkCount), 0);
+    p_Connection->p_SendFree = NULL;
+    p_Connection->us_SendUsed = 0;
+    p_Connection->us_SendLimit = MRH_SRV_SEND_LIMIT_DEFAULT;
+    
+    atomic_init(&(p_Connection->u64_SendIdeal), MRH_MSQ_SEND_IDEAL_DEFAULT);
+    atomic_init(&(p_Connection->u64_SendInFlight), 0);
+    p_Connection->p_WritableCallback = NULL;
+    p_Connection->p_WritableContext = NULL;
+    
+    // All recieve messages start out free
+    MRH_MsQuicRingReset(&(p_Connection->c_RecieveComplete));
+    MRH_MsQuicRingReset(&(p_Connection->c_RecieveFree));
+    p_Connection->us_RecieveSpare = 0;
+    
     for (size_t i = 0; i < MRH_SRV_MESSAGE_BUFFER_COUNT; ++i)
     {
-        p_Connection->p_Recieved[i].p_MsQuicAPI = p_MsQuicAPI;
-        p_Connection->p_Recieved[i].p_Buffer = NULL;
-        p_Connection->p_Recieved[i].us_SizeCur = 0;
-        p_Connection->p_Recieved[i].us_SizeMax = 0;
-        atomic_init(&(p_Connection->p_Recieved[i].i_State), MRH_MSQ_MESSAGE_FREE);
+        MRH_MsQuicRingPush(&(p_Connection->c_RecieveFree), &(p_Connection->p_Recieved[i]));
+    }
+    
+    atomic_init(&(p_Connection->i_Transport), MRH_MSQ_TRANSPORT_STREAM_PER_MESSAGE);
+    atomic_init(&(p_Connection->i_RecieveBorrow), -1);
+    
+    atomic_init(&(p_Connection->i_SendSequence), -1);
+    atomic_init(&(p_Connection->u32_SendSequence), 0);
+    p_Connection->u32_RecieveEpoch = 0;
+    
+    atomic_init(&(p_Connection->i_RecieveOrder), -1);
+    atomic_init(&(p_Connection->i_RecieveGapMS), 0);
+    memset(p_Connection->p_OrderWindow, 0, sizeof(p_Connection->p_OrderWindow));
+    p_Connection->p_OrderDeferred = NULL;
+    p_Connection->us_OrderHeld = 0;
+    p_Connection->u32_OrderNext = 0;
+    p_Connection->u32_OrderEpoch = 0;
+    p_Connection->u64_OrderGapSince = 0;
+    p_Connection->u64_GapCount = 0;
+    p_Connection->u64_GapMissing = 0;
+    p_Connection->u32_GapLast = 0;
+    
+    for (size_t i = 0; i < MRH_SRV_FRAME_STREAM_COUNT; ++i)
+    {
+        p_Connection->p_FrameRecieved[i].p_MsQuicAPI = p_MsQuicAPI;
+        p_Connection->p_FrameRecieved[i].p_Connection = p_Connection;
+        p_Connection->p_FrameRecieved[i].p_Message = NULL;
+        p_Connection->p_FrameRecieved[i].us_LengthCur = 0;
+        p_Connection->p_FrameRecieved[i].us_FrameSize = 0;
+        atomic_init(&(p_Connection->p_FrameRecieved[i].p_Stream), NULL);
+        p_Connection->p_FrameRecieved[i].p_Handle = NULL;
+        atomic_init(&(p_Connection->p_FrameRecieved[i].i_Users), 0);
+        atomic_init(&(p_Connection->p_FrameRecieved[i].i_Paused), 0);
+        atomic_init(&(p_Connection->p_FrameRecieved[i].i_State), MRH_MSQ_MESSAGE_FREE);
         
-        p_Connection->p_Send[i].p_MsQuicAPI = p_MsQuicAPI;
-        p_Connection->p_Send[i].p_Buffer = NULL;
-        p_Connection->p_Send[i].us_SizeCur = 0;
-        p_Connection->p_Send[i].us_SizeMax = 0;
-        atomic_init(&(p_Connection->p_Send[i].i_State), MRH_MSQ_MESSAGE_FREE);
+        p_Connection->p_FrameSend[i].p_MsQuicAPI = p_MsQuicAPI;
+        p_Connection->p_FrameSend[i].p_Connection = p_Connection;
+        p_Connection->p_FrameSend[i].p_Message = NULL;
+        p_Connection->p_FrameSend[i].us_LengthCur = 0;
+        p_Connection->p_FrameSend[i].us_FrameSize = 0;
+        atomic_init(&(p_Connection->p_FrameSend[i].p_Stream), NULL);
+        p_Connection->p_FrameSend[i].p_Handle = NULL;
+        atomic_init(&(p_Connection->p_FrameSend[i].i_Users), 0);
+        atomic_init(&(p_Connection->p_FrameSend[i].i_Paused), 0);
+        atomic_init(&(p_Connection->p_FrameSend[i].i_State), MRH_MSQ_MESSAGE_FREE);
+    }
+    
+    atomic_init(&(p_Connection->us_FrameSendNext), 0);
+    
+    p_Connection->p_TransferPending = NULL;
+    p_Connection->us_TransferPending = 0;
+    
+    atomic_init(&(p_Connection->i_DatagramSend), -1);
+    atomic_init(&(p_Connection->us_DatagramSizeMax), 0);
+    atomic_init(&(p_Connection->u32_DatagramMessages), 0);
+    
+    for (int i = 0; i < MRH_SRV_NET_MESSAGE_COUNT; ++i)
+    {
+        atomic_init(&(p_Connection->p_Priority[i]), MRH_MsQuicGetDefaultPriority((MRH_Srv_NetMessage)i));
     }
     
     if (i_Failed == 0)
@@ -73,31 +290,879 @@ MRH_MsQuicConnection* MRH_MsQuicCreateConnection(const QUIC_API_TABLE* p_MsQuicA
 
 MRH_MsQuicConnection* MRH_MsQuicDestroyConnection(MRH_MsQuicConnection* p_Connection)
 {
-    if (p_Connection->p_Connection != NULL)
+    HQUIC p_QuicConnection = p_Connection->p_Handle;
+    
+    if (p_QuicConnection != NULL)
     {
-        p_Connection->p_MsQuicAPI->ConnectionShutdown(p_Connection->p_Connection,
+        p_Connection->p_MsQuicAPI->ConnectionShutdown(p_QuicConnection,
                                                       QUIC_CONNECTION_SHUTDOWN_FLAG_NONE,
                                                       0);
-        while (p_Connection->p_Connection != NULL) // Callback sets this, signals us that we can start deletion
+        
+        // Callback signals us that we can start deletion
+        MRH_MsQuicWaitConnection(p_Connection, -1, -1);
+    }
+    
+    // Never accepted, the streams are already closed
+    MRH_MsQuicDropTransfers(p_Connection);
+    
+    // Messages left unreleased keep their stream open, close them now
+    for (size_t i = 0; i < MRH_SRV_MESSAGE_BUFFER_COUNT; ++i)
+    {
+        MRH_MsQuicMessage* p_Message = &(p_Connection->p_Recieved[i]);
+        
+        if (p_Message->i_Borrow == MRH_MSQ_BORROW_CLOSE_PENDING)
         {
-            sleep(1);
+            p_Connection->p_MsQuicAPI->StreamClose(p_Message->p_Stream);
         }
     }
     
     // Streams are all closed after shutdown, so simply delete
+    if (p_Connection->p_RecieveSlab != NULL)
+    {
+        free(p_Connection->p_RecieveSlab);
+    }
+    
+    for (size_t i = 0; i < p_Connection->us_SendChunkCount; ++i)
+    {
+        MRH_MsQuicMessage* p_Chunk = p_Connection->p_SendChunk[i];
+        
+        for (size_t j = 0; j < MRH_SRV_MESSAGE_BUFFER_COUNT; ++j)
+        {
+            if (p_Chunk[j].p_Buffer != NULL)
+            {
+                free(p_Chunk[j].p_Buffer);
+            }
+            
+            if (p_Chunk[j].p_Shared != NULL)
+            {
+                MRH_MsQuicReleaseShared(p_Chunk[j].p_Shared);
+            }
+        }
+        
+        free(p_Chunk);
+    }
+    
+    pthread_mutex_destroy(&(p_Connection->p_SequenceMutex));
+    pthread_mutex_destroy(&(p_Connection->p_FrameMutex));
+    pthread_cond_destroy(&(p_Connection->p_SendCond));
+    pthread_mutex_destroy(&(p_Connection->p_SendMutex));
+    pthread_cond_destroy(&(p_Connection->p_StateCond));
+    pthread_mutex_destroy(&(p_Connection->p_StateMutex));
+    
+    free(p_Connection);
+    return NULL;
+}
+
+void MRH_MsQuicSignalConnection(MRH_MsQuicConnection* p_Connection, HQUIC p_QuicConnection)
+{
+    pthread_mutex_lock(&(p_Connection->p_StateMutex));
+    
+    p_Connection->p_Connection = p_QuicConnection;
+    
+    if (p_QuicConnection == NULL)
+    {
+        p_Connection->p_Handle = NULL;
+    }
+    
+    pthread_cond_broadcast(&(p_Connection->p_StateCond));
+    pthread_mutex_unlock(&(p_Connection->p_StateMutex));
+}
+
+static void MRH_MsQuicPushSendMessage(MRH_MsQuicConnection* p_Connection, MRH_MsQuicMessage* p_Message)
+{
+    // @NOTE: Send mutex is held by the caller
+    if (p_Message->p_Shared != NULL)
+    {
+        p_Message->p_Shared = MRH_MsQuicReleaseShared(p_Message->p_Shared);
+    }
+    
+    p_Message->us_SizeCur = 0;
+    p_Message->i_State = MRH_MSQ_MESSAGE_FREE;
+    p_Message->p_Next = p_Connection->p_SendFree;
+    p_Connection->p_SendFree = p_Message;
+    p_Connection->us_SendUsed -= 1;
+}
+
+void MRH_MsQuicDropReplay(MRH_MsQuicConnection* p_Connection)
+{
+    pthread_mutex_lock(&(p_Connection->p_SendMutex));
+    
+    for (size_t i = 0; i < p_Connection->us_SendChunkCount; ++i)
+    {
+        MRH_MsQuicMessage* p_Chunk = p_Connection->p_SendChunk[i];
+        
+        for (size_t j = 0; j < MRH_SRV_MESSAGE_BUFFER_COUNT; ++j)
+        {
+            int i_State = MRH_MSQ_MESSAGE_REPLAY;
+            
+            // Replaying takes the message without the lock
+            if (atomic_compare_exchange_strong(&(p_Chunk[j].i_State), &i_State, MRH_MSQ_MESSAGE_IN_USE))
+            {
+                MRH_MsQuicPushSendMessage(p_Connection, &(p_Chunk[j]));
+            }
+        }
+    }
+    
+    pthread_cond_broadcast(&(p_Connection->p_SendCond));
+    pthread_mutex_unlock(&(p_Connection->p_SendMutex));
+}
+
+void MRH_MsQuicSetSendLimit(MRH_MsQuicConnection* p_Connection, size_t us_Limit)
+{
+    pthread_mutex_lock(&(p_Connection->p_SendMutex));
+    
+    p_Connection->us_SendLimit = us_Limit;
+    
+    // Raised limits might allow waiting senders to continue
+    pthread_cond_broadcast(&(p_Connection->p_SendCond));
+    pthread_mutex_unlock(&(p_Connection->p_SendMutex));
+}
+
+void MRH_MsQuicGetDeadline(struct timespec* p_Deadline, int i_TimeoutMS)
+{
+    clock_gettime(CLOCK_MONOTONIC, p_Deadline);
+    
+    p_Deadline->tv_sec += i_TimeoutMS / 1000;
+    p_Deadline->tv_nsec += (long)(i_TimeoutMS % 1000) * 1000000L;
+    
+    if (p_Deadline->tv_nsec >= 1000000000L)
+    {
+        p_Deadline->tv_sec += 1;
+        p_Deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+int MRH_MsQuicWaitConnection(MRH_MsQuicConnection* p_Connection, int i_Connected, int i_TimeoutMS)
+{
+    struct timespec s_End;
+    
+    if (i_TimeoutMS >= 0)
+    {
+        MRH_MsQuicGetDeadline(&s_End, i_TimeoutMS);
+    }
+    
+    int i_Result = 0;
+    
+    pthread_mutex_lock(&(p_Connection->p_StateMutex));
+    
+    // Connected needs the connection, shutdown waits for the handle to be closed
+    while ((i_Connected == 0) ? (p_Connection->p_Connection == NULL) : (p_Connection->p_Handle != NULL))
+    {
+        // A closed handle means the handshake failed, no connection will follow
+        if (i_Connected == 0 && p_Connection->p_Handle == NULL)
+        {
+            i_Result = -1;
+            break;
+        }
+        
+        if (i_TimeoutMS < 0)
+        {
+            pthread_cond_wait(&(p_Connection->p_StateCond), &(p_Connection->p_StateMutex));
+        }
+        else if (pthread_cond_timedwait(&(p_Connection->p_StateCond), &(p_Connection->p_StateMutex), &s_End) != 0)
+        {
+            // Timeout, check the state one last time
+            if ((i_Connected == 0) ? (p_Connection->p_Connection == NULL) : (p_Connection->p_Handle != NULL))
+            {
+                i_Result = -1;
+            }
+            break;
+        }
+    }
+    
+    pthread_mutex_unlock(&(p_Connection->p_StateMutex));
+    
+    return i_Result;
+}
+
+//*************************************************************************************
+// Recieve
+//*************************************************************************************
+
+MRH_MsQuicMessage* MRH_MsQuicGetRecieveMessage(MRH_MsQuicConnection* p_Connection)
+{
+    MRH_MsQuicMessage* p_Message;
+    
+    // Prefer messages dropped by the worker, no need to sync
+    if (p_Connection->us_RecieveSpare > 0)
+    {
+        p_Connection->us_RecieveSpare -= 1;
+        p_Message = p_Connection->p_RecieveSpare[p_Connection->us_RecieveSpare];
+    }
+    else if ((p_Message = MRH_MsQuicRingPop(&(p_Connection->c_RecieveFree))) == NULL)
+    {
+        return NULL;
+    }
+    
+    p_Message->i_State = MRH_MSQ_MESSAGE_IN_USE;
+    p_Message->p_Stream = NULL;
+    p_Message->us_SizeCur = 0; // Reset to 0, new message
+    p_Message->us_Offset = 0;
+    p_Message->i_Sequenced = -1;
+    p_Message->u32_Epoch = p_Connection->u32_RecieveEpoch;
+    
+    return p_Message;
+}
+
+static void MRH_MsQuicReadSequence(MRH_MsQuicMessage* p_Message)
+{
+    uint8_t* p_Buffer = p_Message->p_Buffer;
+    
+    // @NOTE: Borrowed bytes can't be rewritten, sequenced messages are never borrowed
+    if (p_Message->i_Borrow != MRH_MSQ_BORROW_NONE ||
+        p_Message->us_SizeCur <= MRH_MSQ_SEQUENCE_SIZE ||
+        (p_Buffer[0] & MRH_MSQ_SEQUENCE_FLAG) == 0)
+    {
+        return;
+    }
+    
+    p_Message->u32_Sequence = (uint32_t)(p_Buffer[1]) |
+                              ((uint32_t)(p_Buffer[2]) << 8) |
+                              ((uint32_t)(p_Buffer[3]) << 16) |
+                              ((uint32_t)(p_Buffer[4]) << 24);
+    p_Message->i_Sequenced = 0;
+    
+    // Move the message id in front of the message data instead of moving the data
+    p_Buffer[MRH_MSQ_SEQUENCE_SIZE] = p_Buffer[0] & ~MRH_MSQ_SEQUENCE_FLAG;
+    p_Message->us_Offset = MRH_MSQ_SEQUENCE_SIZE;
+    p_Message->us_SizeCur -= MRH_MSQ_SEQUENCE_SIZE;
+}
+
+void MRH_MsQuicCompleteRecieveMessage(MRH_MsQuicMessage* p_Message)
+{
+    int i_Expected = MRH_MSQ_MESSAGE_IN_USE;
+    
+    if (atomic_compare_exchange_strong(&(p_Message->i_State), &i_Expected, MRH_MSQ_MESSAGE_COMPLETE))
+    {
+        MRH_MsQuicReadSequence(p_Message);
+        
+        // @NOTE: Never full, the ring holds every message
+        MRH_MsQuicRingPush(&(p_Message->p_Connection->c_RecieveComplete), p_Message);
+    }
+}
+
+void MRH_MsQuicDropRecieveMessage(MRH_MsQuicMessage* p_Message)
+{
+    int i_Expected = MRH_MSQ_MESSAGE_IN_USE;
+    
+    // Stream events might drop the same message twice
+    if (atomic_compare_exchange_strong(&(p_Message->i_State), &i_Expected, MRH_MSQ_MESSAGE_FREE))
+    {
+        MRH_MsQuicConnection* p_Connection = p_Message->p_Connection;
+        
+        p_Message->us_SizeCur = 0;
+        p_Connection->p_RecieveSpare[p_Connection->us_RecieveSpare] = p_Message;
+        p_Connection->us_RecieveSpare += 1;
+    }
+}
+
+static uint64_t MRH_MsQuicGetTimeMS(void)
+{
+    struct timespec c_Time;
+    clock_gettime(CLOCK_MONOTONIC, &c_Time);
+    
+    return ((uint64_t)c_Time.tv_sec * 1000) + ((uint64_t)c_Time.tv_nsec / 1000000);
+}
+
+static void MRH_MsQuicSkipSequenceGap(MRH_MsQuicConnection* p_Connection)
+{
+    // Continue with the closest held message
+    uint32_t u32_Skip = MRH_MSQ_SEQUENCE_WINDOW;
+    
+    for (uint32_t i = 1; i < MRH_MSQ_SEQUENCE_WINDOW; ++i)
+    {
+        MRH_MsQuicMessage* p_Held = p_Connection->p_OrderWindow[(p_Connection->u32_OrderNext + i) % MRH_MSQ_SEQUENCE_WINDOW];
+        
+        if (p_Held != NULL)
+        {
+            u32_Skip = i;
+            break;
+        }
+    }
+    
+    p_Connection->u64_GapCount += 1;
+    p_Connection->u64_GapMissing += u32_Skip;
+    p_Connection->u32_GapLast = p_Connection->u32_OrderNext;
+    p_Connection->u32_OrderNext += u32_Skip;
+}
+
+static MRH_MsQuicMessage* MRH_MsQuicTakeSequence(MRH_MsQuicConnection* p_Connection)
+{
+    size_t us_Slot = p_Connection->u32_OrderNext % MRH_MSQ_SEQUENCE_WINDOW;
+    MRH_MsQuicMessage* p_Message = p_Connection->p_OrderWindow[us_Slot];
+    
+    if (p_Message == NULL)
+    {
+        return NULL;
+    }
+    
+    p_Connection->p_OrderWindow[us_Slot] = NULL;
+    p_Connection->us_OrderHeld -= 1;
+    p_Connection->u32_OrderNext += 1;
+    
+    // Wait for the next gap from now on
+    p_Connection->u64_OrderGapSince = MRH_MsQuicGetTimeMS();
+    
+    return p_Message;
+}
+
+MRH_MsQuicMessage* MRH_MsQuicNextRecieveMessage(MRH_MsQuicConnection* p_Connection)
+{
+    MRH_MsQuicMessage* p_Message;
+    
+    while (1)
+    {
+        // Held messages which are next in order first
+        if (p_Connection->us_OrderHeld > 0)
+        {
+            if ((p_Message = MRH_MsQuicTakeSequence(p_Connection)) != NULL)
+            {
+                return p_Message;
+            }
+            
+            // Skip the gap once waited long enough, new messages might keep arriving
+            if (p_Connection->i_RecieveOrder != 0 ||
+                MRH_MsQuicGetTimeMS() - p_Connection->u64_OrderGapSince >= (uint64_t)(p_Connection->i_RecieveGapMS))
+            {
+                MRH_MsQuicSkipSequenceGap(p_Connection);
+                continue;
+            }
+        }
+        
+        if (p_Connection->p_OrderDeferred != NULL)
+        {
+            p_Message = p_Connection->p_OrderDeferred;
+            p_Connection->p_OrderDeferred = NULL;
+        }
+        else if ((p_Message = MRH_MsQuicRingPop(&(p_Connection->c_RecieveComplete))) == NULL)
+        {
+            return NULL;
+        }
+        
+        if (p_Message->i_Sequenced != 0)
+        {
+            return p_Message;
+        }
+        
+        // New connection, hand out what is left of the previous one first
+        if (p_Message->u32_Epoch != p_Connection->u32_OrderEpoch)
+        {
+            if (p_Connection->us_OrderHeld > 0)
+            {
+                p_Connection->p_OrderDeferred = p_Message;
+                MRH_MsQuicSkipSequenceGap(p_Connection);
+                continue;
+            }
+            
+            p_Connection->u32_OrderEpoch = p_Message->u32_Epoch;
+            p_Connection->u32_OrderNext = 0;
+        }
+        
+        uint32_t u32_Distance = p_Message->u32_Sequence - p_Connection->u32_OrderNext;
+        
+        if (u32_Distance == 0)
+        {
+            p_Connection->u32_OrderNext += 1;
+            return p_Message;
+        }
+        else if (p_Connection->i_RecieveOrder != 0 || u32_Distance > UINT32_MAX / 2)
+        {
+            // Unordered or late after skipping its gap, deliver right away
+            return p_Message;
+        }
+        else if (u32_Distance >= MRH_MSQ_SEQUENCE_WINDOW)
+        {
+            // Too far ahead, make room first
+            if (p_Connection->us_OrderHeld > 0)
+            {
+                p_Connection->p_OrderDeferred = p_Message;
+                MRH_MsQuicSkipSequenceGap(p_Connection);
+                continue;
+            }
+            
+            p_Connection->u64_GapCount += 1;
+            p_Connection->u64_GapMissing += u32_Distance;
+            p_Connection->u32_GapLast = p_Connection->u32_OrderNext;
+            p_Connection->u32_OrderNext = p_Message->u32_Sequence + 1;
+            return p_Message;
+        }
+        
+        size_t us_Slot = p_Message->u32_Sequence % MRH_MSQ_SEQUENCE_WINDOW;
+        
+        if (p_Connection->p_OrderWindow[us_Slot] != NULL)
+        {
+            // Duplicate sequence number, nothing to order by
+            return p_Message;
+        }
+        
+        if (p_Connection->us_OrderHeld == 0)
+        {
+            p_Connection->u64_OrderGapSince = MRH_MsQuicGetTimeMS();
+        }
+        
+        p_Connection->p_OrderWindow[us_Slot] = p_Message;
+        p_Connection->us_OrderHeld += 1;
+    }
+}
+
+const uint8_t* MRH_MsQuicReadRecieveMessage(MRH_MsQuicMessage* p_Message)
+{
+    if (p_Message->i_Borrow == MRH_MSQ_BORROW_NONE)
+    {
+        return &(p_Message->p_Buffer[p_Message->us_Offset]);
+    }
+    
+    // Borrowed, keep the stream from closing while reading
+    int i_Expected = MRH_MSQ_BORROW_PENDING;
+    
+    if (atomic_compare_exchange_strong(&(p_Message->i_Borrow), &i_Expected, MRH_MSQ_BORROW_READING) == false)
+    {
+        return NULL;
+    }
+    
+    return p_Message->p_Borrowed;
+}
+
+void MRH_MsQuicReleaseRecieveMessage(MRH_MsQuicMessage* p_Message)
+{
+    if (p_Message->i_Borrow == MRH_MSQ_BORROW_READING)
+    {
+        // Return buffers, the stream can now complete
+        // @NOTE: The worker never closes the stream while reading
+        p_Message->p_MsQuicAPI->StreamReceiveComplete(p_Message->p_Stream,
+                                                      p_Message->us_SizeCur);
+        
+        int i_Expected = MRH_MSQ_BORROW_READING;
+        
+        if (atomic_compare_exchange_strong(&(p_Message->i_Borrow), &i_Expected, MRH_MSQ_BORROW_NONE) == false)
+        {
+            // Shutdown completed while reading, closing was left to us
+            p_Message->p_MsQuicAPI->StreamClose(p_Message->p_Stream);
+        }
+    }
+    else if (p_Message->i_Borrow == MRH_MSQ_BORROW_CLOSE_PENDING)
+    {
+        p_Message->p_MsQuicAPI->StreamClose(p_Message->p_Stream);
+    }
+    
+    p_Message->p_Borrowed = NULL;
+    p_Message->us_SizeCur = 0;
+    p_Message->us_Offset = 0;
+    p_Message->i_Borrow = MRH_MSQ_BORROW_NONE;
+    p_Message->i_State = MRH_MSQ_MESSAGE_FREE;
+    
+    // Hand back to the worker
+    MRH_MsQuicRingPush(&(p_Message->p_Connection->c_RecieveFree), p_Message);
+}
+
+int MRH_MsQuicCloseBorrowed(MRH_MsQuicConnection* p_Connection, HQUIC p_Stream)
+{
+    int i_Result = 0;
+    
     for (size_t i = 0; i < MRH_SRV_MESSAGE_BUFFER_COUNT; ++i)
     {
-        if (p_Connection->p_Recieved[i].p_Buffer != NULL)
+        MRH_MsQuicMessage* p_Message = &(p_Connection->p_Recieved[i]);
+        
+        if (p_Message->p_Stream != p_Stream)
         {
-            free(p_Connection->p_Recieved[i].p_Buffer);
+            continue;
         }
         
-        if (p_Connection->p_Send[i].p_Buffer != NULL)
+        // Not yet read, the bytes are dropped
+        int i_Expected = MRH_MSQ_BORROW_PENDING;
+        
+        if (atomic_compare_exchange_strong(&(p_Message->i_Borrow), &i_Expected, MRH_MSQ_BORROW_CLOSED))
         {
-            free(p_Connection->p_Send[i].p_Buffer);
+            continue;
+        }
+        
+        // Being read, the bytes have to stay valid until released
+        // @NOTE: Don't wait here, this blocks every connection on the worker
+        i_Expected = MRH_MSQ_BORROW_READING;
+        
+        if (atomic_compare_exchange_strong(&(p_Message->i_Borrow), &i_Expected, MRH_MSQ_BORROW_CLOSE_PENDING))
+        {
+            i_Result = -1;
         }
     }
     
-    free(p_Connection);
+    return i_Result;
+}
+
+void MRH_MsQuicResumeFrameStreams(MRH_MsQuicConnection* p_Connection)
+{
+    for (size_t i = 0; i < MRH_SRV_FRAME_STREAM_COUNT; ++i)
+    {
+        MRH_MsQuicFrameStream* p_Frame = &(p_Connection->p_FrameRecieved[i]);
+        
+        // @NOTE: Exchange, the callback might resume on its own
+        if (atomic_exchange(&(p_Frame->i_Paused), 0) == 0)
+        {
+            continue;
+        }
+        
+        HQUIC p_Stream = p_Frame->p_Stream;
+        
+        if (p_Stream != NULL)
+        {
+            p_Connection->p_MsQuicAPI->StreamReceiveSetEnabled(p_Stream, TRUE);
+        }
+    }
+}
+
+//*************************************************************************************
+// Send
+//*************************************************************************************
+
+static MRH_MsQuicMessage* MRH_MsQuicPopSendMessage(MRH_MsQuicConnection* p_Connection)
+{
+    // @NOTE: Send mutex is held by the caller
+    if (p_Connection->us_SendUsed >= p_Connection->us_SendLimit)
+    {
+        return NULL;
+    }
+    else if (p_Connection->p_SendFree == NULL)
+    {
+        // Grow by a full chunk, messages can't move while sending
+        size_t us_Chunk = p_Connection->us_SendChunkCount;
+        
+        if (us_Chunk == MRH_MSQ_SEND_CHUNK_COUNT)
+        {
+            return NULL;
+        }
+        
+        MRH_MsQuicMessage* p_Chunk = (MRH_MsQuicMessage*)malloc(sizeof(MRH_MsQuicMessage) * MRH_SRV_MESSAGE_BUFFER_COUNT);
+        
+        if (p_Chunk == NULL)
+        {
+            return NULL;
+        }
+        
+        for (size_t i = MRH_SRV_MESSAGE_BUFFER_COUNT; i > 0; --i)
+        {
+            MRH_MsQuicInitMessage(&(p_Chunk[i - 1]), p_Connection);
+            
+            p_Chunk[i - 1].p_Next = p_Connection->p_SendFree;
+            p_Connection->p_SendFree = &(p_Chunk[i - 1]);
+        }
+        
+        p_Connection->p_SendChunk[us_Chunk] = p_Chunk;
+        p_Connection->us_SendChunkCount = us_Chunk + 1;
+    }
+    
+    MRH_MsQuicMessage* p_Message = p_Connection->p_SendFree;
+    
+    p_Connection->p_SendFree = p_Message->p_Next;
+    p_Connection->us_SendUsed += 1;
+    
+    p_Message->p_Next = NULL;
+    p_Message->us_SizeCur = 0;
+    p_Message->i_State = MRH_MSQ_MESSAGE_IN_USE;
+    
+    return p_Message;
+}
+
+MRH_MsQuicMessage* MRH_MsQuicGetSendMessage(MRH_MsQuicConnection* p_Connection, int i_TimeoutMS)
+{
+    struct timespec s_End;
+    
+    if (i_TimeoutMS > 0)
+    {
+        MRH_MsQuicGetDeadline(&s_End, i_TimeoutMS);
+    }
+    
+    MRH_MsQuicMessage* p_Message;
+    
+    pthread_mutex_lock(&(p_Connection->p_SendMutex));
+    
+    while ((p_Message = MRH_MsQuicPopSendMessage(p_Connection)) == NULL && i_TimeoutMS != 0)
+    {
+        if (i_TimeoutMS < 0)
+        {
+            pthread_cond_wait(&(p_Connection->p_SendCond), &(p_Connection->p_SendMutex));
+        }
+        else if (pthread_cond_timedwait(&(p_Connection->p_SendCond), &(p_Connection->p_SendMutex), &s_End) != 0)
+        {
+            // Timeout, try one last time
+            p_Message = MRH_MsQuicPopSendMessage(p_Connection);
+            break;
+        }
+    }
+    
+    pthread_mutex_unlock(&(p_Connection->p_SendMutex));
+    
+    return p_Message;
+}
+
+size_t MRH_MsQuicGetSendFree(MRH_MsQuicConnection* p_Connection)
+{
+    size_t us_Free = 0;
+    
+    pthread_mutex_lock(&(p_Connection->p_SendMutex));
+    
+    if (p_Connection->us_SendUsed < p_Connection->us_SendLimit)
+    {
+        us_Free = p_Connection->us_SendLimit - p_Connection->us_SendUsed;
+    }
+    
+    pthread_mutex_unlock(&(p_Connection->p_SendMutex));
+    
+    return us_Free;
+}
+
+void MRH_MsQuicFreeSendMessage(MRH_MsQuicMessage* p_Message)
+{
+    MRH_MsQuicConnection* p_Connection = p_Message->p_Connection;
+    
+    pthread_mutex_lock(&(p_Connection->p_SendMutex));
+    
+    MRH_MsQuicPushSendMessage(p_Connection, p_Message);
+    
+    pthread_cond_signal(&(p_Connection->p_SendCond));
+    pthread_mutex_unlock(&(p_Connection->p_SendMutex));
+}
+
+void MRH_MsQuicCancelSendMessage(MRH_MsQuicMessage* p_Message)
+{
+    MRH_MsQuicConnection* p_Connection = p_Message->p_Connection;
+    
+    // @NOTE: Streams cancelled on a open connection won't be replayed, nothing
+    //        would pick them up until the connection is lost
+    if (p_Connection->i_Replay == 0 && p_Connection->i_Shutdown == 0)
+    {
+        p_Message->i_State = MRH_MSQ_MESSAGE_REPLAY;
+    }
+    else
+    {
+        MRH_MsQuicFreeSendMessage(p_Message);
+    }
+}
+
+MRH_MsQuicShared* MRH_MsQuicCreateShared(size_t us_Size)
+{
+    MRH_MsQuicShared* p_Shared = (MRH_MsQuicShared*)malloc(sizeof(MRH_MsQuicShared) + us_Size);
+    
+    if (p_Shared == NULL)
+    {
+        return NULL;
+    }
+    
+    atomic_init(&(p_Shared->us_RefCount), 1);
+    p_Shared->us_Size = us_Size;
+    
+    return p_Shared;
+}
+
+void MRH_MsQuicAttachShared(MRH_MsQuicMessage* p_Message, MRH_MsQuicShared* p_Shared)
+{
+    atomic_fetch_add(&(p_Shared->us_RefCount), 1);
+    p_Message->p_Shared = p_Shared;
+}
+
+MRH_MsQuicShared* MRH_MsQuicReleaseShared(MRH_MsQuicShared* p_Shared)
+{
+    if (atomic_fetch_sub(&(p_Shared->us_RefCount), 1) == 1)
+    {
+        free(p_Shared);
+    }
+    
     return NULL;
 }
+
+static inline void MRH_MsQuicNotifyWritable(MRH_MsQuicConnection* p_Connection)
+{
+    // Copy as a pair, the callback is called without the lock
+    pthread_mutex_lock(&(p_Connection->p_StateMutex));
+    
+    MRH_MsQuicWritableCallback p_Callback = p_Connection->p_WritableCallback;
+    void* p_Context = p_Connection->p_WritableContext;
+    
+    pthread_mutex_unlock(&(p_Connection->p_StateMutex));
+    
+    if (p_Callback != NULL)
+    {
+        p_Callback(p_Context);
+    }
+}
+
+void MRH_MsQuicSetWritableCallback(MRH_MsQuicConnection* p_Connection, MRH_MsQuicWritableCallback p_Callback, void* p_Context)
+{
+    pthread_mutex_lock(&(p_Connection->p_StateMutex));
+    
+    p_Connection->p_WritableCallback = p_Callback;
+    p_Connection->p_WritableContext = p_Context;
+    
+    pthread_mutex_unlock(&(p_Connection->p_StateMutex));
+}
+
+void MRH_MsQuicAddSendBytes(MRH_MsQuicConnection* p_Connection, size_t us_Size)
+{
+    atomic_fetch_add(&(p_Connection->u64_SendInFlight), us_Size);
+}
+
+void MRH_MsQuicRemoveSendBytes(MRH_MsQuicConnection* p_Connection, size_t us_Size)
+{
+    uint64_t u64_Ideal = p_Connection->u64_SendIdeal;
+    uint64_t u64_Before = atomic_fetch_sub(&(p_Connection->u64_SendInFlight), us_Size);
+    
+    // Only notify when crossing the ideal size, not for every send
+    if (u64_Before >= u64_Ideal && u64_Before - us_Size < u64_Ideal)
+    {
+        MRH_MsQuicNotifyWritable(p_Connection);
+    }
+}
+
+void MRH_MsQuicAddInFlight(MRH_MsQuicMessage* p_Message, size_t us_Size)
+{
+    p_Message->us_InFlight = us_Size;
+    MRH_MsQuicAddSendBytes(p_Message->p_Connection, us_Size);
+}
+
+void MRH_MsQuicRemoveInFlight(MRH_MsQuicMessage* p_Message)
+{
+    size_t us_Size = p_Message->us_InFlight;
+    
+    if (us_Size > 0)
+    {
+        p_Message->us_InFlight = 0;
+        MRH_MsQuicRemoveSendBytes(p_Message->p_Connection, us_Size);
+    }
+}
+
+void MRH_MsQuicSetIdealSendSize(MRH_MsQuicConnection* p_Connection, uint64_t u64_Size)
+{
+    uint64_t u64_Previous = atomic_exchange(&(p_Connection->u64_SendIdeal), u64_Size);
+    uint64_t u64_InFlight = p_Connection->u64_SendInFlight;
+    
+    if (u64_InFlight >= u64_Previous && u64_InFlight < u64_Size)
+    {
+        MRH_MsQuicNotifyWritable(p_Connection);
+    }
+}
+
+// Every framed stream starts with the header to seperate it from a single message stream
+static uint8_t p_FrameHeaderByte[1] = { MRH_MSQ_STREAM_HEADER_FRAMED };
+static const QUIC_BUFFER c_FrameHeader = { 1, p_FrameHeaderByte };
+
+static int MRH_MsQuicAcquireFrameStream(MRH_MsQuicFrameStream* p_Frame)
+{
+    int i_Users = p_Frame->i_Users;
+    
+    // No users left means the stream is closed, never revive it
+    while (i_Users > 0)
+    {
+        if (atomic_compare_exchange_weak(&(p_Frame->i_Users), &i_Users, i_Users + 1))
+        {
+            // Shutdown might have started, the handle stays valid but is unusable
+            if (p_Frame->p_Stream != NULL)
+            {
+                return 0;
+            }
+            
+            MRH_MsQuicReleaseFrameStream(p_Frame);
+            return -1;
+        }
+    }
+    
+    return -1;
+}
+
+MRH_MsQuicFrameStream* MRH_MsQuicGetFrameStream(MRH_MsQuicConnection* p_Connection)
+{
+    HQUIC p_QuicConnection = p_Connection->p_Connection;
+    
+    if (p_QuicConnection == NULL)
+    {
+        return NULL;
+    }
+    
+    // Streams are used in turn to spread the messages
+    size_t us_Next = atomic_fetch_add(&(p_Connection->us_FrameSendNext), 1) % MRH_SRV_FRAME_STREAM_COUNT;
+    MRH_MsQuicFrameStream* p_Frame = &(p_Connection->p_FrameSend[us_Next]);
+    
+    if (MRH_MsQuicAcquireFrameStream(p_Frame) == 0)
+    {
+        return p_Frame;
+    }
+    
+    // Not open (yet or anymore), only one sender opens a new long-lived stream
+    pthread_mutex_lock(&(p_Connection->p_FrameMutex));
+    
+    if (MRH_MsQuicAcquireFrameStream(p_Frame) == 0)
+    {
+        pthread_mutex_unlock(&(p_Connection->p_FrameMutex));
+        return p_Frame;
+    }
+    else if (p_Frame->i_State != MRH_MSQ_MESSAGE_FREE)
+    {
+        // Still shutting down or in use by the last senders
+        pthread_mutex_unlock(&(p_Connection->p_FrameMutex));
+        return NULL;
+    }
+    
+    HQUIC p_Stream;
+    
+    if (QUIC_FAILED(p_Connection->p_MsQuicAPI->StreamOpen(p_QuicConnection,
+                                                          QUIC_STREAM_OPEN_FLAG_UNIDIRECTIONAL,
+                                                          MRH_MsQuicFrameStreamCallback,
+                                                          p_Frame,
+                                                          &p_Stream)))
+    {
+        pthread_mutex_unlock(&(p_Connection->p_FrameMutex));
+        return NULL;
+    }
+    
+    // Open reference, dropped by shutdown complete
+    // @NOTE: Set before starting, the callback might run right away
+    p_Frame->p_Handle = p_Stream;
+    p_Frame->i_State = MRH_MSQ_MESSAGE_IN_USE;
+    p_Frame->i_Users = 1;
+    
+    if (QUIC_FAILED(p_Connection->p_MsQuicAPI->StreamStart(p_Stream,
+                                                           QUIC_STREAM_START_FLAG_SHUTDOWN_ON_FAIL)))
+    {
+        p_Frame->i_Users = 0;
+        p_Frame->p_Handle = NULL;
+        p_Connection->p_MsQuicAPI->StreamClose(p_Stream);
+        p_Frame->i_State = MRH_MSQ_MESSAGE_FREE;
+        pthread_mutex_unlock(&(p_Connection->p_FrameMutex));
+        return NULL;
+    }
+    
+    // Header has to be queued before any frame, publish afterwards
+    if (QUIC_FAILED(p_Connection->p_MsQuicAPI->StreamSend(p_Stream,
+                                                          &c_FrameHeader,
+                                                          1,
+                                                          QUIC_SEND_FLAG_NONE,
+                                                          NULL)))
+    {
+        // Shutdown complete will close the stream
+        p_Connection->p_MsQuicAPI->StreamShutdown(p_Stream,
+                                                  QUIC_STREAM_SHUTDOWN_FLAG_ABORT,
+                                                  0);
+        pthread_mutex_unlock(&(p_Connection->p_FrameMutex));
+        return NULL;
+    }
+    
+    p_Frame->i_Users += 1; // Our own reference
+    p_Frame->p_Stream = p_Stream;
+    
+    pthread_mutex_unlock(&(p_Connection->p_FrameMutex));
+    
+    return p_Frame;
+}
+
+void MRH_MsQuicReleaseFrameStream(MRH_MsQuicFrameStream* p_Frame)
+{
+    if (atomic_fetch_sub(&(p_Frame->i_Users), 1) != 1)
+    {
+        return;
+    }
+    
+    // Shutdown completed while sending, closing was left to us
+    HQUIC p_Stream = p_Frame->p_Handle;
+    
+    p_Frame->p_Handle = NULL;
+    p_Frame->p_MsQuicAPI->StreamClose(p_Stream);
+    p_Frame->i_State = MRH_MSQ_MESSAGE_FREE;
+}
@@ -26,18 +26,60 @@
 
 // C
 #include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
 
 // External
 #include <msquic.h>
 
 // Project
+#include "../../../../include/libmrhsrv/libmrhsrv/Communication/MRH_NetMessage.h"
 #include "../../../../include/libmrhsrv/libmrhsrv/MRH_ServerSizes.h"
+#include "../../../../include/libmrhsrv/libmrhsrv/MRH_ServerTypes.h"
+#include "./MRH_MsQuicTicket.h"
+#include "./MRH_MsQuicRing.h"
+#include "./MRH_MsQuicTransfer.h"
 
 // Pre-defined
 #ifndef MRH_SRV_MESSAGE_BUFFER_COUNT
     #define MRH_SRV_MESSAGE_BUFFER_COUNT 32
 #endif
+#ifndef MRH_SRV_FRAME_STREAM_COUNT
+    #define MRH_SRV_FRAME_STREAM_COUNT 4
+#endif
+#ifndef MRH_SRV_SEND_LIMIT_DEFAULT
+    #define MRH_SRV_SEND_LIMIT_DEFAULT 256
+#endif
+
+#define MRH_MSQ_SEND_IDEAL_DEFAULT 131072 // MsQuic default ideal send buffer, used until the first update
+#define MRH_MSQ_SEND_CHUNK_COUNT ((MRH_SRV_SIZE_SEND_MESSAGE_MAX + MRH_SRV_MESSAGE_BUFFER_COUNT - 1) / MRH_SRV_MESSAGE_BUFFER_COUNT) // Send pool grows by MRH_SRV_MESSAGE_BUFFER_COUNT
+
+#define MRH_MSQ_SEQUENCE_FLAG 0x80 // Set on the message id if followed by a sequence number
+#define MRH_MSQ_SEQUENCE_SIZE 4 // Sequenced messages are [Id | Flag][Sequence (uint32_t, LE)][Message Data]
+#define MRH_MSQ_SEQUENCE_WINDOW (MRH_SRV_MESSAGE_BUFFER_COUNT / 2) // Recieve messages held for reordering, the rest stays free for the missing ones
+
+#if MRH_MSQ_SEQUENCE_WINDOW < 2
+    #error "Too few recieve messages to reorder sequenced messages!"
+#endif
+
+#define MRH_MSQ_RECIEVE_SIZE_MAX (MRH_SRV_SIZE_MESSAGE_BUFFER_MAX + 24 + 16 + MRH_MSQ_SEQUENCE_SIZE) // Largest encrypted message (crypto_secretbox_NONCEBYTES + crypto_secretbox_MACBYTES, equals the AEAD nonce and tag)
 
+#define MRH_MSQ_STREAM_HEADER_FRAMED 0xFF // First byte on a framed stream, no net message uses this id
+#define MRH_MSQ_FRAME_LENGTH_SIZE 2 // Frames are [Length (uint16_t, LE)][Message]
+
+
+//*************************************************************************************
+// Shared Data
+//*************************************************************************************
+
+typedef struct MRH_MsQuicShared_t
+{
+    _Atomic(size_t) us_RefCount;
+    
+    size_t us_Size;
+    uint8_t p_Buffer[]; // Message data sent to multiple connections
+    
+}MRH_MsQuicShared;
 
 //*************************************************************************************
 // Message
@@ -47,34 +89,186 @@ typedef enum
 {
     MRH_MSQ_MESSAGE_FREE = 0,
     MRH_MSQ_MESSAGE_IN_USE = 1,
-    MRH_MSQ_MESSAGE_COMPLETE = 2
+    MRH_MSQ_MESSAGE_COMPLETE = 2,
+    MRH_MSQ_MESSAGE_REPLAY = 3 // Send buffer kept for the next connection
     
 }MRH_MSQ_MessageState;
 
+typedef enum
+{
+    MRH_MSQ_BORROW_NONE = 0, // Message owns the recieved bytes
+    MRH_MSQ_BORROW_PENDING = 1, // Bytes are held by MsQuic
+    MRH_MSQ_BORROW_READING = 2, // Bytes held by MsQuic are being read
+    MRH_MSQ_BORROW_CLOSED = 3, // Stream was closed, bytes are invalid
+    MRH_MSQ_BORROW_CLOSE_PENDING = 4 // Stream shutdown completed while reading, closed on release
+    
+}MRH_MSQ_BorrowState;
+
+struct MRH_MsQuicConnection_t;
+
 typedef struct MRH_MsQuicMessage_t
 {
     const QUIC_API_TABLE* p_MsQuicAPI;
+    struct MRH_MsQuicConnection_t* p_Connection;
     
     uint8_t* p_Buffer;
     size_t us_SizeCur;
     size_t us_SizeMax;
     
+    // Recieve buffer borrowed from MsQuic
+    const uint8_t* p_Borrowed;
+    HQUIC p_Stream; // Only set by the worker
+    _Atomic(int) i_Borrow;
+    
+    // Send replay info
+    int i_Framed; // 0 if the buffer contains frames
+    uint64_t u64_Queued; // Send order
+    uint16_t u16_Priority; // Stream priority for single message streams
+    
+    struct MRH_MsQuicMessage_t* p_Next; // Free send message list
+    size_t us_InFlight; // Bytes handed to MsQuic and not yet completed
+    MRH_MsQuicShared* p_Shared; // Sent after the buffer bytes as a second QUIC_BUFFER
+    
+    // Recieve order
+    size_t us_Offset; // Start of the message bytes in the buffer
+    int i_Sequenced; // 0 if the message has a sequence number
+    uint32_t u32_Sequence;
+    uint32_t u32_Epoch; // Connection the message was recieved on
+    
     _Atomic(int) i_State;
     
 }MRH_MsQuicMessage;
 
+//*************************************************************************************
+// Frame Stream
+//*************************************************************************************
+
+struct MRH_MsQuicConnection_t;
+
+typedef struct MRH_MsQuicFrameStream_t
+{
+    const QUIC_API_TABLE* p_MsQuicAPI;
+    struct MRH_MsQuicConnection_t* p_Connection;
+    
+    _Atomic(HQUIC) p_Stream; // Published once the stream header was sent
+    
+    // Send stream lifetime
+    HQUIC p_Handle;
+    _Atomic(int) i_Users; // Senders using the handle, +1 while the stream is open
+    
+    // Recieve frame parsing
+    MRH_MsQuicMessage* p_Message;
+    uint8_t p_Length[MRH_MSQ_FRAME_LENGTH_SIZE];
+    size_t us_LengthCur;
+    size_t us_FrameSize;
+    _Atomic(int) i_Paused;
+    
+    _Atomic(int) i_State;
+    
+}MRH_MsQuicFrameStream;
+
 //*************************************************************************************
 // Connection
 //*************************************************************************************
 
+typedef enum
+{
+    MRH_MSQ_TRANSPORT_STREAM_PER_MESSAGE = 0,
+    MRH_MSQ_TRANSPORT_FRAMED = 1
+    
+}MRH_MSQ_Transport;
+
+struct MRH_MsQuicListener_t;
+
+typedef void (*MRH_MsQuicConnectCallback)(void* p_Context, int i_Result);
+typedef void (*MRH_MsQuicWritableCallback)(void* p_Context);
+
 typedef struct MRH_MsQuicConnection_t
 {
     const QUIC_API_TABLE* p_MsQuicAPI;
     
-    _Atomic(HQUIC) p_Connection;
+    _Atomic(HQUIC) p_Connection; // Set once connected
+    _Atomic(HQUIC) p_Handle; // Set while opened, until shutdown completed
+    
+    pthread_mutex_t p_StateMutex;
+    pthread_cond_t p_StateCond; // Signaled on connection and shutdown
+    
+    _Atomic(MRH_MsQuicConnectCallback) p_ConnectCallback; // Called once, on connection or shutdown
+    void* p_ConnectContext;
+    
+    struct MRH_MsQuicListener_t* p_Listener; // Listener which accepted the connection, NULL for outgoing connections
+    
+    MRH_MsQuicTicketCache* p_Tickets; // Shared by all connections of a context
+    const char* p_TicketAddress;
+    int i_TicketPort;
+    _Atomic(int) i_ZeroRTT; // 0 if the first message may use 0-RTT
+    
+    _Atomic(int) i_Replay; // 0 if cancelled and disconnected sends are kept
+    _Atomic(int) i_Replaying; // 1 while reconnecting, 0 while kept sends are submitted again and new sends wait
+    _Atomic(int) i_Shutdown; // 0 once the connection started shutting down
+    _Atomic(uint64_t) u64_SendCount;
     
     struct MRH_MsQuicMessage_t p_Recieved[MRH_SRV_MESSAGE_BUFFER_COUNT];
-    struct MRH_MsQuicMessage_t p_Send[MRH_SRV_MESSAGE_BUFFER_COUNT];
+    uint8_t* p_RecieveSlab; // Buffers of all recieve messages, MRH_MSQ_RECIEVE_SIZE_MAX each
+    
+    // Send pool, grows in chunks until the send limit is reached
+    pthread_mutex_t p_SendMutex;
+    pthread_cond_t p_SendCond; // Signaled when a send message was freed
+    struct MRH_MsQuicMessage_t* p_SendChunk[MRH_MSQ_SEND_CHUNK_COUNT];
+    _Atomic(size_t) us_SendChunkCount; // Chunks are never freed before destruction
+    struct MRH_MsQuicMessage_t* p_SendFree;
+    size_t us_SendUsed;
+    size_t us_SendLimit;
+    
+    // Send flow control
+    // @NOTE: The ideal send buffer follows the connection congestion window,
+    //        so the last value of any stream is used for the connection
+    _Atomic(uint64_t) u64_SendIdeal;
+    _Atomic(uint64_t) u64_SendInFlight;
+    MRH_MsQuicWritableCallback p_WritableCallback; // Called once in flight bytes drop below the ideal size, guarded by p_StateMutex
+    void* p_WritableContext; // Guarded by p_StateMutex
+    
+    // Recieve queues, MsQuic handles all connection events on one worker
+    MRH_MsQuicRing c_RecieveComplete; // Worker to application, in recieve order
+    MRH_MsQuicRing c_RecieveFree; // Application to worker, released messages
+    struct MRH_MsQuicMessage_t* p_RecieveSpare[MRH_SRV_MESSAGE_BUFFER_COUNT]; // Messages dropped by the worker
+    size_t us_RecieveSpare;
+    
+    _Atomic(int) i_Transport;
+    _Atomic(int) i_RecieveBorrow;
+    
+    // Sequence numbers, restarted for each connection
+    _Atomic(int) i_SendSequence; // 0 if sent messages are sequenced
+    _Atomic(uint32_t) u32_SendSequence;
+    pthread_mutex_t p_SequenceMutex; // Held while sequenced messages are numbered and submitted, never by the MsQuic worker
+    uint32_t u32_RecieveEpoch; // Counts connections, only used by the MsQuic worker
+    
+    // Recieve reordering, only used by the reading thread
+    _Atomic(int) i_RecieveOrder; // 0 if sequenced messages are delivered in order
+    _Atomic(int) i_RecieveGapMS; // Time to wait for a missing sequence number
+    struct MRH_MsQuicMessage_t* p_OrderWindow[MRH_MSQ_SEQUENCE_WINDOW]; // Indexed by sequence number
+    struct MRH_MsQuicMessage_t* p_OrderDeferred; // Taken from the complete ring but not yet placed
+    size_t us_OrderHeld;
+    uint32_t u32_OrderNext; // Next sequence number to deliver
+    uint32_t u32_OrderEpoch;
+    uint64_t u64_OrderGapSince; // CLOCK_MONOTONIC milliseconds the next sequence number is missing since
+    uint64_t u64_GapCount; // Gaps skipped after the gap timeout
+    uint64_t u64_GapMissing; // Sequence numbers skipped
+    uint32_t u32_GapLast; // First sequence number of the last skipped gap
+    
+    struct MRH_MsQuicTransfer_t* p_TransferPending; // Recieved transfers, guarded by the state mutex
+    size_t us_TransferPending;
+    
+    struct MRH_MsQuicFrameStream_t p_FrameRecieved[MRH_SRV_FRAME_STREAM_COUNT];
+    struct MRH_MsQuicFrameStream_t p_FrameSend[MRH_SRV_FRAME_STREAM_COUNT];
+    _Atomic(size_t) us_FrameSendNext;
+    pthread_mutex_t p_FrameMutex; // Held while opening a frame send stream, never by the MsQuic worker
+    
+    _Atomic(int) i_DatagramSend;
+    _Atomic(size_t) us_DatagramSizeMax;
+    _Atomic(uint32_t) u32_DatagramMessages; // Bit per net message sent as datagram
+    
+    _Atomic(uint16_t) p_Priority[MRH_SRV_NET_MESSAGE_COUNT]; // Stream priority per net message
     
 }MRH_MsQuicConnection;
 
@@ -98,5 +292,278 @@ extern MRH_MsQuicConnection* MRH_MsQuicCreateConnection(const QUIC_API_TABLE* p_
 
 extern MRH_MsQuicConnection* MRH_MsQuicDestroyConnection(MRH_MsQuicConnection* p_Connection);
 
+/**
+ *  Set the connection state and wake all waiting threads.
+ *
+ *  \param p_Connection The connection to update.
+ *  \param p_QuicConnection The connected MsQuic connection, NULL if shut down.
+ */
+
+extern void MRH_MsQuicSignalConnection(MRH_MsQuicConnection* p_Connection, HQUIC p_QuicConnection);
+
+/**
+ *  Free all send messages kept for replaying.
+ *
+ *  \param p_Connection The connection to drop the messages for.
+ */
+
+extern void MRH_MsQuicDropReplay(MRH_MsQuicConnection* p_Connection);
+
+/**
+ *  Set the number of send messages which can be in use at the same time.
+ *
+ *  \param p_Connection The connection to set the limit for.
+ *  \param us_Limit The new limit, at most MRH_SRV_SIZE_SEND_MESSAGE_MAX.
+ */
+
+extern void MRH_MsQuicSetSendLimit(MRH_MsQuicConnection* p_Connection, size_t us_Limit);
+
+/**
+ *  Get a CLOCK_MONOTONIC deadline for timed waits.
+ *
+ *  \param p_Deadline The deadline to set.
+ *  \param i_TimeoutMS The time until the deadline in milliseconds.
+ */
+
+extern void MRH_MsQuicGetDeadline(struct timespec* p_Deadline, int i_TimeoutMS);
+
+/**
+ *  Wait for a connection to be connected or fully shut down.
+ *
+ *  \param p_Connection The connection to wait for.
+ *  \param i_Connected 0 to wait for a connection, -1 to wait for the shutdown.
+ *  \param i_TimeoutMS The maximum time to wait in milliseconds. Negative values
+ *                     wait without a timeout.
+ *
+ *  \return 0 if the state was reached, -1 on timeout.
+ */
+
+extern int MRH_MsQuicWaitConnection(MRH_MsQuicConnection* p_Connection, int i_Connected, int i_TimeoutMS);
+
+/**
+ *  Grab a free recieve message and mark it as in use. Only called by the
+ *  MsQuic worker.
+ *
+ *  \param p_Connection The connection to grab the message from.
+ *
+ *  \return The recieve message on success, NULL on failure.
+ */
+
+extern MRH_MsQuicMessage* MRH_MsQuicGetRecieveMessage(MRH_MsQuicConnection* p_Connection);
+
+/**
+ *  Queue a fully recieved message for reading. Only called by the MsQuic worker.
+ *
+ *  \param p_Message The recieved message.
+ */
+
+extern void MRH_MsQuicCompleteRecieveMessage(MRH_MsQuicMessage* p_Message);
+
+/**
+ *  Drop a message which could not be recieved. Only called by the MsQuic worker.
+ *
+ *  \param p_Message The message to drop.
+ */
+
+extern void MRH_MsQuicDropRecieveMessage(MRH_MsQuicMessage* p_Message);
+
+/**
+ *  Grab the oldest recieved message. Sequenced messages are held until all
+ *  previous sequence numbers were delivered or the gap timeout passed if
+ *  ordering is enabled. Only called by the reading thread.
+ *
+ *  \param p_Connection The connection to grab the message from.
+ *
+ *  \return The recieved message, NULL if nothing was recieved.
+ */
+
+extern MRH_MsQuicMessage* MRH_MsQuicNextRecieveMessage(MRH_MsQuicConnection* p_Connection);
+
+/**
+ *  Start reading a completed recieve message.
+ *
+ *  \param p_Message The message to read.
+ *
+ *  \return The message bytes on success, NULL if the message bytes are no longer
+ *          available.
+ */
+
+extern const uint8_t* MRH_MsQuicReadRecieveMessage(MRH_MsQuicMessage* p_Message);
+
+/**
+ *  Release a read recieve message. Borrowed MsQuic buffers are returned.
+ *
+ *  \param p_Message The message to release.
+ */
+
+extern void MRH_MsQuicReleaseRecieveMessage(MRH_MsQuicMessage* p_Message);
+
+/**
+ *  Invalidate all recieve messages borrowing from a closing stream. Never
+ *  waits, a stream which is being read is closed once the message is released.
+ *
+ *  \param p_Connection The connection the stream belongs to.
+ *  \param p_Stream The closing stream.
+ *
+ *  \return 0 if the stream can be closed, -1 if the reader closes it.
+ */
+
+extern int MRH_MsQuicCloseBorrowed(MRH_MsQuicConnection* p_Connection, HQUIC p_Stream);
+
+/**
+ *  Resume all framed recieve streams which were paused because no recieve
+ *  message was free.
+ *
+ *  \param p_Connection The connection to resume.
+ */
+
+extern void MRH_MsQuicResumeFrameStreams(MRH_MsQuicConnection* p_Connection);
+
+/**
+ *  Grab a free send message and mark it as in use. The send pool grows if no
+ *  message is free and the send limit was not reached.
+ *
+ *  \param p_Connection The connection to grab the message from.
+ *  \param i_TimeoutMS The maximum time to wait for a free message in milliseconds.
+ *                     0 returns immediately, negative values wait without a timeout.
+ *
+ *  \return The send message on success, NULL on failure.
+ */
+
+extern MRH_MsQuicMessage* MRH_MsQuicGetSendMessage(MRH_MsQuicConnection* p_Connection, int i_TimeoutMS);
+
+/**
+ *  Get the number of send messages which can be grabbed before reaching the
+ *  send limit.
+ *
+ *  \param p_Connection The connection to check.
+ *
+ *  \return The number of available send messages.
+ */
+
+extern size_t MRH_MsQuicGetSendFree(MRH_MsQuicConnection* p_Connection);
+
+/**
+ *  Return a send message to the send pool.
+ *
+ *  \param p_Message The message to free.
+ */
+
+extern void MRH_MsQuicFreeSendMessage(MRH_MsQuicMessage* p_Message);
+
+/**
+ *  Handle a cancelled send message. The message is kept for replaying if
+ *  the connection is shutting down and will be restored, freed otherwise.
+ *
+ *  \param p_Message The cancelled message.
+ */
+
+extern void MRH_MsQuicCancelSendMessage(MRH_MsQuicMessage* p_Message);
+
+/**
+ *  Create shared message data. The creator holds the first reference.
+ *
+ *  \param us_Size The size of the data in bytes.
+ *
+ *  \return The shared data on success, NULL on failure.
+ */
+
+extern MRH_MsQuicShared* MRH_MsQuicCreateShared(size_t us_Size);
+
+/**
+ *  Add a reference to shared message data for a send message. The reference is
+ *  released once the send message is freed.
+ *
+ *  \param p_Message The send message to add the data to.
+ *  \param p_Shared The shared data to add.
+ */
+
+extern void MRH_MsQuicAttachShared(MRH_MsQuicMessage* p_Message, MRH_MsQuicShared* p_Shared);
+
+/**
+ *  Release a reference to shared message data. The data is freed with the last
+ *  reference.
+ *
+ *  \param p_Shared The shared data to release.
+ *
+ *  \return Always NULL.
+ */
+
+extern MRH_MsQuicShared* MRH_MsQuicReleaseShared(MRH_MsQuicShared* p_Shared);
+
+/**
+ *  Add bytes handed to MsQuic to the bytes in flight.
+ *
+ *  \param p_Connection The connection sending the bytes.
+ *  \param us_Size The number of bytes sent.
+ */
+
+extern void MRH_MsQuicAddSendBytes(MRH_MsQuicConnection* p_Connection, size_t us_Size);
+
+/**
+ *  Remove completed bytes from the bytes in flight.
+ *
+ *  \param p_Connection The connection which sent the bytes.
+ *  \param us_Size The number of bytes completed.
+ */
+
+extern void MRH_MsQuicRemoveSendBytes(MRH_MsQuicConnection* p_Connection, size_t us_Size);
+
+/**
+ *  Add a message to the bytes in flight before handing it to MsQuic.
+ *
+ *  \param p_Message The message to send.
+ *  \param us_Size The number of bytes sent.
+ */
+
+extern void MRH_MsQuicAddInFlight(MRH_MsQuicMessage* p_Message, size_t us_Size);
+
+/**
+ *  Remove a sent or failed message from the bytes in flight.
+ *
+ *  \param p_Message The message which was sent.
+ */
+
+extern void MRH_MsQuicRemoveInFlight(MRH_MsQuicMessage* p_Message);
+
+/**
+ *  Update the ideal send buffer size reported by MsQuic.
+ *
+ *  \param p_Connection The connection to update.
+ *  \param u64_Size The ideal send buffer size in bytes.
+ */
+
+extern void MRH_MsQuicSetIdealSendSize(MRH_MsQuicConnection* p_Connection, uint64_t u64_Size);
+
+/**
+ *  Set the callback to inform once the bytes in flight dropped below the
+ *  ideal send buffer size.
+ *
+ *  \param p_Connection The connection to set the callback for.
+ *  \param p_Callback The callback to use. NULL removes the callback.
+ *  \param p_Context The context given to the callback.
+ */
+
+extern void MRH_MsQuicSetWritableCallback(MRH_MsQuicConnection* p_Connection, MRH_MsQuicWritableCallback p_Callback, void* p_Context);
+
+/**
+ *  Get a open framed send stream. The stream will be opened if needed. The
+ *  stream handle stays valid until the stream is released.
+ *
+ *  \param p_Connection The connection to get the stream for.
+ *
+ *  \return The frame stream on success, NULL on failure.
+ */
+
+extern MRH_MsQuicFrameStream* MRH_MsQuicGetFrameStream(MRH_MsQuicConnection* p_Connection);
+
+/**
+ *  Release a framed send stream. The last user closes a shut down stream.
+ *
+ *  \param p_Frame The frame stream to release.
+ */
+
+extern void MRH_MsQuicReleaseFrameStream(MRH_MsQuicFrameStream* p_Frame);
+
 
 #endif /* MRH_MsQuicContext_h */
@@ -0,0 +1,255 @@
+/**
+ *  libmrhsrv
+ *  Copyright (C) 2021 - 2022 Jens Brörken
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty.  In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any source distribution.
+ */
+
+// C
+#include <stdlib.h>
+
+// External
+
+// Project
+#include "./MRH_MsQuicListener.h"
+#include "./MRH_MsQuic.h"
+
+
+//*************************************************************************************
+// Listener
+//*************************************************************************************
+
+MRH_MsQuicListener* MRH_MsQuicCreateListener(const QUIC_API_TABLE* p_MsQuicAPI, HQUIC p_Registration, HQUIC p_Configuration, const QUIC_BUFFER* p_Alpn, const char* p_Address, int i_Port, size_t us_Backlog)
+{
+    MRH_MsQuicListener* p_Listener = (MRH_MsQuicListener*)malloc(sizeof(MRH_MsQuicListener));
+    
+    if (p_Listener == NULL)
+    {
+        return NULL;
+    }
+    else if ((p_Listener->p_Accepted = (MRH_MsQuicConnection**)malloc(sizeof(MRH_MsQuicConnection*) * us_Backlog)) == NULL)
+    {
+        free(p_Listener);
+        return NULL;
+    }
+    
+    pthread_condattr_t p_CondAttr;
+    
+    if (pthread_condattr_init(&p_CondAttr) != 0)
+    {
+        free(p_Listener->p_Accepted);
+        free(p_Listener);
+        return NULL;
+    }
+    else if (pthread_condattr_setclock(&p_CondAttr, CLOCK_MONOTONIC) != 0 ||
+             pthread_mutex_init(&(p_Listener->p_Mutex), NULL) != 0)
+    {
+        pthread_condattr_destroy(&p_CondAttr);
+        free(p_Listener->p_Accepted);
+        free(p_Listener);
+        return NULL;
+    }
+    else if (pthread_cond_init(&(p_Listener->p_Cond), &p_CondAttr) != 0)
+    {
+        pthread_mutex_destroy(&(p_Listener->p_Mutex));
+        pthread_condattr_destroy(&p_CondAttr);
+        free(p_Listener->p_Accepted);
+        free(p_Listener);
+        return NULL;
+    }
+    
+    pthread_condattr_destroy(&p_CondAttr);
+    
+    p_Listener->p_MsQuicAPI = p_MsQuicAPI;
+    p_Listener->p_Configuration = p_Configuration;
+    p_Listener->p_Listener = NULL;
+    p_Listener->us_AcceptedHead = 0;
+    p_Listener->us_AcceptedCount = 0;
+    p_Listener->us_Handshake = 0;
+    p_Listener->us_Backlog = us_Backlog;
+    p_Listener->i_Stopped = -1;
+    
+    // Build the local address, unspecified listens on all addresses
+    QUIC_ADDR c_Address = { 0 };
+    
+    if (p_Address == NULL)
+    {
+        QuicAddrSetFamily(&c_Address, QUIC_ADDRESS_FAMILY_UNSPEC);
+        QuicAddrSetPort(&c_Address, (uint16_t)i_Port);
+    }
+    else if (QuicAddrFromString(p_Address, (uint16_t)i_Port, &c_Address) == FALSE)
+    {
+        return MRH_MsQuicDestroyListener(p_Listener);
+    }
+    
+    if (QUIC_FAILED(p_MsQuicAPI->ListenerOpen(p_Registration,
+                                              (void*)MRH_MsQuicListenerCallback,
+                                              p_Listener,
+                                              &(p_Listener->p_Listener))))
+    {
+        p_Listener->p_Listener = NULL;
+        return MRH_MsQuicDestroyListener(p_Listener);
+    }
+    else if (QUIC_FAILED(p_MsQuicAPI->ListenerStart(p_Listener->p_Listener,
+                                                    p_Alpn,
+                                                    1,
+                                                    &c_Address)))
+    {
+        return MRH_MsQuicDestroyListener(p_Listener);
+    }
+    
+    return p_Listener;
+}
+
+MRH_MsQuicListener* MRH_MsQuicDestroyListener(MRH_MsQuicListener* p_Listener)
+{
+    // @NOTE: Closing stops the listener and waits for all listener callbacks
+    if (p_Listener->p_Listener != NULL)
+    {
+        p_Listener->p_MsQuicAPI->ListenerClose(p_Listener->p_Listener);
+    }
+    
+    pthread_mutex_lock(&(p_Listener->p_Mutex));
+    
+    p_Listener->i_Stopped = 0;
+    pthread_cond_broadcast(&(p_Listener->p_Cond));
+    
+    // Handshakes still use the listener, wait until they connected or failed
+    while (p_Listener->us_Handshake > 0)
+    {
+        pthread_cond_wait(&(p_Listener->p_Cond), &(p_Listener->p_Mutex));
+    }
+    
+    pthread_mutex_unlock(&(p_Listener->p_Mutex));
+    
+    // Nobody took these, disconnect and remove
+    for (size_t i = 0; i < p_Listener->us_AcceptedCount; ++i)
+    {
+        MRH_MsQuicDestroyConnection(p_Listener->p_Accepted[(p_Listener->us_AcceptedHead + i) % p_Listener->us_Backlog]);
+    }
+    
+    pthread_cond_destroy(&(p_Listener->p_Cond));
+    pthread_mutex_destroy(&(p_Listener->p_Mutex));
+    
+    free(p_Listener->p_Accepted);
+    free(p_Listener);
+    
+    return NULL;
+}
+
+//*************************************************************************************
+// Accept
+//*************************************************************************************
+
+int MRH_MsQuicReserveAccept(MRH_MsQuicListener* p_Listener)
+{
+    int i_Result = -1;
+    
+    pthread_mutex_lock(&(p_Listener->p_Mutex));
+    
+    if (p_Listener->i_Stopped != 0 &&
+        (p_Listener->us_Handshake + p_Listener->us_AcceptedCount) < p_Listener->us_Backlog)
+    {
+        p_Listener->us_Handshake += 1;
+        i_Result = 0;
+    }
+    
+    pthread_mutex_unlock(&(p_Listener->p_Mutex));
+    
+    return i_Result;
+}
+
+void MRH_MsQuicCancelAccept(MRH_MsQuicListener* p_Listener)
+{
+    pthread_mutex_lock(&(p_Listener->p_Mutex));
+    
+    p_Listener->us_Handshake -= 1;
+    
+    pthread_cond_broadcast(&(p_Listener->p_Cond));
+    pthread_mutex_unlock(&(p_Listener->p_Mutex));
+}
+
+void MRH_MsQuicCompleteAccept(void* p_Context, int i_Result)
+{
+    // @NOTE: Failed handshakes are dropped once the shutdown completed
+    if (i_Result != 0)
+    {
+        return;
+    }
+    
+    MRH_MsQuicConnection* p_Connection = (MRH_MsQuicConnection*)p_Context;
+    MRH_MsQuicListener* p_Listener = p_Connection->p_Listener;
+    
+    pthread_mutex_lock(&(p_Listener->p_Mutex));
+    
+    // The backlog entry was reserved on creation, there is always space
+    size_t us_Pos = (p_Listener->us_AcceptedHead + p_Listener->us_AcceptedCount) % p_Listener->us_Backlog;
+    
+    p_Listener->p_Accepted[us_Pos] = p_Connection;
+    p_Listener->us_AcceptedCount += 1;
+    p_Listener->us_Handshake -= 1;
+    
+    pthread_cond_broadcast(&(p_Listener->p_Cond));
+    pthread_mutex_unlock(&(p_Listener->p_Mutex));
+}
+
+void MRH_MsQuicDropAccept(MRH_MsQuicConnection* p_Connection)
+{
+    MRH_MsQuicListener* p_Listener = p_Connection->p_Listener;
+    
+    MRH_MsQuicDestroyConnection(p_Connection);
+    MRH_MsQuicCancelAccept(p_Listener);
+}
+
+MRH_MsQuicConnection* MRH_MsQuicTakeConnection(MRH_MsQuicListener* p_Listener, int i_TimeoutMS)
+{
+    struct timespec s_End;
+    
+    if (i_TimeoutMS > 0)
+    {
+        MRH_MsQuicGetDeadline(&s_End, i_TimeoutMS);
+    }
+    
+    MRH_MsQuicConnection* p_Connection = NULL;
+    
+    pthread_mutex_lock(&(p_Listener->p_Mutex));
+    
+    while (p_Listener->us_AcceptedCount == 0 && p_Listener->i_Stopped != 0 && i_TimeoutMS != 0)
+    {
+        if (i_TimeoutMS < 0)
+        {
+            pthread_cond_wait(&(p_Listener->p_Cond), &(p_Listener->p_Mutex));
+        }
+        else if (pthread_cond_timedwait(&(p_Listener->p_Cond), &(p_Listener->p_Mutex), &s_End) != 0)
+        {
+            break;
+        }
+    }
+    
+    if (p_Listener->us_AcceptedCount > 0)
+    {
+        p_Connection = p_Listener->p_Accepted[p_Listener->us_AcceptedHead];
+        p_Listener->us_AcceptedHead = (p_Listener->us_AcceptedHead + 1) % p_Listener->us_Backlog;
+        p_Listener->us_AcceptedCount -= 1;
+    }
+    
+    pthread_mutex_unlock(&(p_Listener->p_Mutex));
+    
+    return p_Connection;
+}
@@ -0,0 +1,142 @@
+/**
+ *  libmrhsrv
+ *  Copyright (C) 2021 - 2022 Jens Brörken
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty.  In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any source distribution.
+ */
+
+#ifndef MRH_MsQuicListener_h
+#define MRH_MsQuicListener_h
+
+// C
+#include <stdatomic.h>
+#include <pthread.h>
+
+// External
+#include <msquic.h>
+
+// Project
+#include "./MRH_MsQuicContext.h"
+
+
+//*************************************************************************************
+// Listener
+//*************************************************************************************
+
+typedef struct MRH_MsQuicListener_t
+{
+    const QUIC_API_TABLE* p_MsQuicAPI;
+    HQUIC p_Configuration; // Set on every accepted connection
+    HQUIC p_Listener;
+    
+    pthread_mutex_t p_Mutex;
+    pthread_cond_t p_Cond; // Signaled on accepted connections and handshake results
+    
+    // Connected connections which were not yet taken, in connection order
+    MRH_MsQuicConnection** p_Accepted;
+    size_t us_AcceptedHead;
+    size_t us_AcceptedCount;
+    
+    size_t us_Handshake; // Connections in the handshake, each holds a backlog entry
+    size_t us_Backlog; // Connections in the handshake and accepted connections
+    
+    int i_Stopped; // 0 once stopping, new connections are refused
+    
+}MRH_MsQuicListener;
+
+/**
+ *  Create and start a listener.
+ *
+ *  \param p_MsQuicAPI The MsQuic api to use.
+ *  \param p_Registration The registration to listen with.
+ *  \param p_Configuration The server configuration for accepted connections.
+ *  \param p_Alpn The application protocol to accept.
+ *  \param p_Address The address to listen on. NULL listens on all addresses.
+ *  \param i_Port The port to listen on.
+ *  \param us_Backlog The number of connections which can be in the handshake
+ *                    or wait to be taken at the same time.
+ *
+ *  \return The listener on success, NULL on failure.
+ */
+
+extern MRH_MsQuicListener* MRH_MsQuicCreateListener(const QUIC_API_TABLE* p_MsQuicAPI, HQUIC p_Registration, HQUIC p_Configuration, const QUIC_BUFFER* p_Alpn, const char* p_Address, int i_Port, size_t us_Backlog);
+
+/**
+ *  Destroy a listener. Waits for connections in the handshake, connections
+ *  which were not taken are disconnected and destroyed.
+ *
+ *  \param p_Listener The listener to destroy.
+ *
+ *  \return Always NULL.
+ */
+
+extern MRH_MsQuicListener* MRH_MsQuicDestroyListener(MRH_MsQuicListener* p_Listener);
+
+/**
+ *  Reserve a backlog entry for a new connection. Only called by the MsQuic worker.
+ *
+ *  \param p_Listener The listener recieving the connection.
+ *
+ *  \return 0 if the connection can be accepted, -1 if not.
+ */
+
+extern int MRH_MsQuicReserveAccept(MRH_MsQuicListener* p_Listener);
+
+/**
+ *  Release a reserved backlog entry of a connection which was never created.
+ *  Only called by the MsQuic worker.
+ *
+ *  \param p_Listener The listener the entry was reserved for.
+ */
+
+extern void MRH_MsQuicCancelAccept(MRH_MsQuicListener* p_Listener);
+
+/**
+ *  Queue a connection for taking once it connected. Used as the connect
+ *  callback of accepted connections.
+ *
+ *  \param p_Context The accepted connection.
+ *  \param i_Result 0 if connected, -1 if not.
+ */
+
+extern void MRH_MsQuicCompleteAccept(void* p_Context, int i_Result);
+
+/**
+ *  Destroy a accepted connection which never connected. Only called by the
+ *  MsQuic worker once the connection shutdown completed.
+ *
+ *  \param p_Connection The connection to destroy.
+ */
+
+extern void MRH_MsQuicDropAccept(MRH_MsQuicConnection* p_Connection);
+
+/**
+ *  Take the oldest connected connection. The caller owns the connection.
+ *
+ *  \param p_Listener The listener to take from.
+ *  \param i_TimeoutMS The maximum time to wait for a connection in milliseconds.
+ *                     0 returns immediately, negative values wait without a timeout.
+ *
+ *  \return The connection on success, NULL if none was connected.
+ */
+
+extern MRH_MsQuicConnection* MRH_MsQuicTakeConnection(MRH_MsQuicListener* p_Listener, int i_TimeoutMS);
+
+
+#endif /* MRH_MsQuicListener_h */
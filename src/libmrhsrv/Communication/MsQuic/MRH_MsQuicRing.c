@@ -0,0 +1,82 @@
+/**
+ *  libmrhsrv
+ *  Copyright (C) 2021 - 2022 Jens Brörken
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty.  In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any source distribution.
+ */
+
+
+// C
+
+// External
+
+// Project
+#include "./MRH_MsQuicRing.h"
+
+
+//*************************************************************************************
+// Ring
+//*************************************************************************************
+
+void MRH_MsQuicRingReset(MRH_MsQuicRing* p_Ring)
+{
+    atomic_init(&(p_Ring->us_Head), 0);
+    atomic_init(&(p_Ring->us_Tail), 0);
+    
+    for (size_t i = 0; i < MRH_SRV_MESSAGE_BUFFER_COUNT; ++i)
+    {
+        p_Ring->p_Entry[i] = NULL;
+    }
+}
+
+int MRH_MsQuicRingPush(MRH_MsQuicRing* p_Ring, struct MRH_MsQuicMessage_t* p_Message)
+{
+    size_t us_Tail = atomic_load_explicit(&(p_Ring->us_Tail), memory_order_relaxed);
+    size_t us_Head = atomic_load_explicit(&(p_Ring->us_Head), memory_order_acquire);
+    
+    if (us_Tail - us_Head == MRH_SRV_MESSAGE_BUFFER_COUNT)
+    {
+        return -1;
+    }
+    
+    p_Ring->p_Entry[us_Tail % MRH_SRV_MESSAGE_BUFFER_COUNT] = p_Message;
+    
+    // Publish the entry to the consumer
+    atomic_store_explicit(&(p_Ring->us_Tail), us_Tail + 1, memory_order_release);
+    
+    return 0;
+}
+
+struct MRH_MsQuicMessage_t* MRH_MsQuicRingPop(MRH_MsQuicRing* p_Ring)
+{
+    size_t us_Head = atomic_load_explicit(&(p_Ring->us_Head), memory_order_relaxed);
+    size_t us_Tail = atomic_load_explicit(&(p_Ring->us_Tail), memory_order_acquire);
+    
+    if (us_Head == us_Tail)
+    {
+        return NULL;
+    }
+    
+    struct MRH_MsQuicMessage_t* p_Message = p_Ring->p_Entry[us_Head % MRH_SRV_MESSAGE_BUFFER_COUNT];
+    
+    // Entry is free for the producer again
+    atomic_store_explicit(&(p_Ring->us_Head), us_Head + 1, memory_order_release);
+    
+    return p_Message;
+}
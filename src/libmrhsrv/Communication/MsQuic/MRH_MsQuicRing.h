@@ -0,0 +1,99 @@
+/**
+ *  libmrhsrv
+ *  Copyright (C) 2021 - 2022 Jens Brörken
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty.  In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any source distribution.
+ */
+
+#ifndef MRH_MsQuicRing_h
+#define MRH_MsQuicRing_h
+
+// C
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// External
+
+// Project
+#include "../../../../include/libmrhsrv/libmrhsrv/MRH_ServerSizes.h"
+
+// Pre-defined
+#ifndef MRH_SRV_MESSAGE_BUFFER_COUNT
+    #define MRH_SRV_MESSAGE_BUFFER_COUNT 32
+#endif
+
+#define MRH_MSQ_CACHE_LINE_SIZE 64
+
+
+//*************************************************************************************
+// Ring
+//*************************************************************************************
+
+struct MRH_MsQuicMessage_t;
+
+/**
+ *  Bounded single producer, single consumer message queue. Messages leave the
+ *  ring in the order they were added.
+ */
+
+typedef struct MRH_MsQuicRing_t
+{
+    // @NOTE: Split, producer and consumer don't share a cache line
+    _Atomic(size_t) us_Head; // Next pop, written by the consumer
+    uint8_t p_HeadPad[MRH_MSQ_CACHE_LINE_SIZE - sizeof(size_t)];
+    
+    _Atomic(size_t) us_Tail; // Next push, written by the producer
+    uint8_t p_TailPad[MRH_MSQ_CACHE_LINE_SIZE - sizeof(size_t)];
+    
+    struct MRH_MsQuicMessage_t* p_Entry[MRH_SRV_MESSAGE_BUFFER_COUNT];
+    
+}MRH_MsQuicRing;
+
+/**
+ *  Reset a ring to be empty.
+ *
+ *  \param p_Ring The ring to reset.
+ */
+
+extern void MRH_MsQuicRingReset(MRH_MsQuicRing* p_Ring);
+
+/**
+ *  Add a message to the ring. Only called by the producer.
+ *
+ *  \param p_Ring The ring to add to.
+ *  \param p_Message The message to add.
+ *
+ *  \return 0 on success, -1 if the ring is full.
+ */
+
+extern int MRH_MsQuicRingPush(MRH_MsQuicRing* p_Ring, struct MRH_MsQuicMessage_t* p_Message);
+
+/**
+ *  Remove the oldest message from the ring. Only called by the consumer.
+ *
+ *  \param p_Ring The ring to remove from.
+ *
+ *  \return The message on success, NULL if the ring is empty.
+ */
+
+extern struct MRH_MsQuicMessage_t* MRH_MsQuicRingPop(MRH_MsQuicRing* p_Ring);
+
+
+#endif /* MRH_MsQuicRing_h */
@@ -0,0 +1,467 @@
+/**
+ *  libmrhsrv
+ *  Copyright (C) 2021 - 2022 Jens Brörken
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty.  In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any source distribution.
+ */
+
+
+// C
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// External
+
+// Project
+#include "./MRH_MsQuicTicket.h"
+
+
+//*************************************************************************************
+// Cache
+//*************************************************************************************
+
+MRH_MsQuicTicketCache* MRH_MsQuicCreateTicketCache(void)
+{
+    MRH_MsQuicTicketCache* p_Cache = (MRH_MsQuicTicketCache*)malloc(sizeof(MRH_MsQuicTicketCache));
+    
+    if (p_Cache == NULL)
+    {
+        return NULL;
+    }
+    else if (pthread_mutex_init(&(p_Cache->p_Mutex), NULL) != 0)
+    {
+        free(p_Cache);
+        return NULL;
+    }
+    else if (pthread_mutex_init(&(p_Cache->p_SaveMutex), NULL) != 0)
+    {
+        pthread_mutex_destroy(&(p_Cache->p_Mutex));
+        free(p_Cache);
+        return NULL;
+    }
+    
+    for (size_t i = 0; i < MRH_SRV_TICKET_CACHE_COUNT; ++i)
+    {
+        memset(p_Cache->p_Ticket[i].p_Address, '\0', MRH_SRV_SIZE_SERVER_ADDRESS);
+        p_Cache->p_Ticket[i].i_Port = -1;
+        p_Cache->p_Ticket[i].p_Ticket = NULL;
+        p_Cache->p_Ticket[i].u32_Size = 0;
+        p_Cache->p_Ticket[i].u64_LastUse = 0;
+    }
+    
+    p_Cache->u64_Use = 0;
+    p_Cache->p_StorePath = NULL;
+    p_Cache->i_Dirty = -1;
+    
+    return p_Cache;
+}
+
+MRH_MsQuicTicketCache* MRH_MsQuicDestroyTicketCache(MRH_MsQuicTicketCache* p_Cache)
+{
+    MRH_MsQuicSaveTickets(p_Cache);
+    
+    for (size_t i = 0; i < MRH_SRV_TICKET_CACHE_COUNT; ++i)
+    {
+        if (p_Cache->p_Ticket[i].p_Ticket != NULL)
+        {
+            free(p_Cache->p_Ticket[i].p_Ticket);
+        }
+    }
+    
+    if (p_Cache->p_StorePath != NULL)
+    {
+        free(p_Cache->p_StorePath);
+    }
+    
+    pthread_mutex_destroy(&(p_Cache->p_SaveMutex));
+    pthread_mutex_destroy(&(p_Cache->p_Mutex));
+    free(p_Cache);
+    
+    return NULL;
+}
+
+//*************************************************************************************
+// Ticket
+//*************************************************************************************
+
+static MRH_MsQuicTicket* MRH_MsQuicFindTicket(MRH_MsQuicTicketCache* p_Cache, const char* p_Address, int i_Port)
+{
+    for (size_t i = 0; i < MRH_SRV_TICKET_CACHE_COUNT; ++i)
+    {
+        MRH_MsQuicTicket* p_Ticket = &(p_Cache->p_Ticket[i]);
+        
+        if (p_Ticket->p_Ticket != NULL &&
+            p_Ticket->i_Port == i_Port &&
+            strncmp(p_Ticket->p_Address, p_Address, MRH_SRV_SIZE_SERVER_ADDRESS) == 0)
+        {
+            return p_Ticket;
+        }
+    }
+    
+    return NULL;
+}
+
+static int MRH_MsQuicSetTicket(MRH_MsQuicTicketCache* p_Cache, const char* p_Address, int i_Port, const uint8_t* p_Ticket, uint32_t u32_Size)
+{
+    if (u32_Size == 0 || u32_Size > MRH_SRV_TICKET_SIZE_MAX)
+    {
+        return -1;
+    }
+    
+    MRH_MsQuicTicket* p_Entry = MRH_MsQuicFindTicket(p_Cache, p_Address, i_Port);
+    
+    if (p_Entry == NULL)
+    {
+        // Use a free entry or replace the oldest one
+        p_Entry = &(p_Cache->p_Ticket[0]);
+        
+        for (size_t i = 0; i < MRH_SRV_TICKET_CACHE_COUNT; ++i)
+        {
+            if (p_Cache->p_Ticket[i].p_Ticket == NULL)
+            {
+                p_Entry = &(p_Cache->p_Ticket[i]);
+                break;
+            }
+            else if (p_Cache->p_Ticket[i].u64_LastUse < p_Entry->u64_LastUse)
+            {
+                p_Entry = &(p_Cache->p_Ticket[i]);
+            }
+        }
+    }
+    
+    uint8_t* p_Copy = (uint8_t*)realloc(p_Entry->p_Ticket, u32_Size);
+    
+    if (p_Copy == NULL)
+    {
+        return -1;
+    }
+    
+    memcpy(p_Copy, p_Ticket, u32_Size);
+    
+    if (p_Entry->p_Address != p_Address)
+    {
+        strncpy(p_Entry->p_Address, p_Address, MRH_SRV_SIZE_SERVER_ADDRESS - 1);
+        p_Entry->p_Address[MRH_SRV_SIZE_SERVER_ADDRESS - 1] = '\0';
+    }
+    
+    p_Entry->i_Port = i_Port;
+    p_Entry->p_Ticket = p_Copy;
+    p_Entry->u32_Size = u32_Size;
+    p_Entry->u64_LastUse = ++(p_Cache->u64_Use);
+    
+    return 0;
+}
+
+//*************************************************************************************
+// Store
+//*************************************************************************************
+
+/**
+ *  Store file layout, repeated for each ticket:
+ *  [Address Length (uint16_t)][Address][Port (int32_t)][Ticket Size (uint32_t)][Ticket]
+ *  All values are little endian.
+ */
+
+static int MRH_MsQuicReadValue(FILE* p_File, uint64_t* p_Value, size_t us_Size)
+{
+    uint8_t p_Buffer[sizeof(uint64_t)];
+    
+    if (fread(p_Buffer, 1, us_Size, p_File) != us_Size)
+    {
+        return -1;
+    }
+    
+    *p_Value = 0;
+    
+    for (size_t i = 0; i < us_Size; ++i)
+    {
+        *p_Value |= ((uint64_t)p_Buffer[i]) << (i * 8);
+    }
+    
+    return 0;
+}
+
+static size_t MRH_MsQuicWriteValue(uint8_t* p_Buffer, uint64_t u64_Value, size_t us_Size)
+{
+    for (size_t i = 0; i < us_Size; ++i)
+    {
+        p_Buffer[i] = (uint8_t)((u64_Value >> (i * 8)) & 0xFF);
+    }
+    
+    return us_Size;
+}
+
+static void MRH_MsQuicLoadTickets(MRH_MsQuicTicketCache* p_Cache)
+{
+    FILE* p_File = fopen(p_Cache->p_StorePath, "rb");
+    
+    if (p_File == NULL)
+    {
+        // No tickets stored yet
+        return;
+    }
+    
+    char p_Address[MRH_SRV_SIZE_SERVER_ADDRESS];
+    uint8_t* p_Ticket = (uint8_t*)malloc(MRH_SRV_TICKET_SIZE_MAX);
+    uint64_t u64_Length;
+    uint64_t u64_Port;
+    uint64_t u64_Size;
+    
+    while (p_Ticket != NULL &&
+           MRH_MsQuicReadValue(p_File, &u64_Length, sizeof(uint16_t)) == 0 &&
+           u64_Length < MRH_SRV_SIZE_SERVER_ADDRESS &&
+           fread(p_Address, 1, u64_Length, p_File) == u64_Length &&
+           MRH_MsQuicReadValue(p_File, &u64_Port, sizeof(int32_t)) == 0 &&
+           MRH_MsQuicReadValue(p_File, &u64_Size, sizeof(uint32_t)) == 0 &&
+           u64_Size <= MRH_SRV_TICKET_SIZE_MAX &&
+           fread(p_Ticket, 1, u64_Size, p_File) == u64_Size)
+    {
+        p_Address[u64_Length] = '\0';
+        MRH_MsQuicSetTicket(p_Cache, p_Address, (int)((int32_t)u64_Port), p_Ticket, (uint32_t)u64_Size);
+    }
+    
+    if (p_Ticket != NULL)
+    {
+        free(p_Ticket);
+    }
+    
+    fclose(p_File);
+}
+
+static uint8_t* MRH_MsQuicWriteTickets(MRH_MsQuicTicketCache* p_Cache, size_t* p_Size)
+{
+    // @NOTE: Cache mutex is held by the caller
+    size_t us_Size = 0;
+    
+    for (size_t i = 0; i < MRH_SRV_TICKET_CACHE_COUNT; ++i)
+    {
+        MRH_MsQuicTicket* p_Ticket = &(p_Cache->p_Ticket[i]);
+        
+        if (p_Ticket->p_Ticket != NULL)
+        {
+            us_Size += sizeof(uint16_t) + strnlen(p_Ticket->p_Address, MRH_SRV_SIZE_SERVER_ADDRESS - 1) +
+                       sizeof(int32_t) + sizeof(uint32_t) + p_Ticket->u32_Size;
+        }
+    }
+    
+    uint8_t* p_Buffer = (uint8_t*)malloc(us_Size + 1);
+    
+    if (p_Buffer == NULL)
+    {
+        return NULL;
+    }
+    
+    size_t us_Pos = 0;
+    
+    for (size_t i = 0; i < MRH_SRV_TICKET_CACHE_COUNT; ++i)
+    {
+        MRH_MsQuicTicket* p_Ticket = &(p_Cache->p_Ticket[i]);
+        
+        if (p_Ticket->p_Ticket == NULL)
+        {
+            continue;
+        }
+        
+        size_t us_Length = strnlen(p_Ticket->p_Address, MRH_SRV_SIZE_SERVER_ADDRESS - 1);
+        
+        us_Pos += MRH_MsQuicWriteValue(&(p_Buffer[us_Pos]), us_Length, sizeof(uint16_t));
+        memcpy(&(p_Buffer[us_Pos]), p_Ticket->p_Address, us_Length);
+        us_Pos += us_Length;
+        us_Pos += MRH_MsQuicWriteValue(&(p_Buffer[us_Pos]), (uint32_t)((int32_t)p_Ticket->i_Port), sizeof(int32_t));
+        us_Pos += MRH_MsQuicWriteValue(&(p_Buffer[us_Pos]), p_Ticket->u32_Size, sizeof(uint32_t));
+        memcpy(&(p_Buffer[us_Pos]), p_Ticket->p_Ticket, p_Ticket->u32_Size);
+        us_Pos += p_Ticket->u32_Size;
+    }
+    
+    *p_Size = us_Size;
+    return p_Buffer;
+}
+
+static int MRH_MsQuicWriteStore(const char* p_StorePath, const uint8_t* p_Buffer, size_t us_Size)
+{
+    // @NOTE: Write to a temporary file first, a crash should not lose all tickets
+    size_t us_PathSize = strlen(p_StorePath) + 5;
+    char* p_TempPath = (char*)malloc(us_PathSize);
+    
+    if (p_TempPath == NULL)
+    {
+        return -1;
+    }
+    
+    snprintf(p_TempPath, us_PathSize, "%s.tmp", p_StorePath);
+    
+    // Tickets allow resuming sessions, only readable by the owner
+    int i_FD = open(p_TempPath, O_CREAT | O_WRONLY | O_TRUNC, 0600);
+    FILE* p_File = (i_FD < 0) ? NULL : fdopen(i_FD, "wb");
+    int i_Result = -1;
+    
+    if (p_File == NULL)
+    {
+        if (i_FD >= 0)
+        {
+            close(i_FD);
+        }
+    }
+    else
+    {
+        i_Result = (fwrite(p_Buffer, 1, us_Size, p_File) == us_Size) ? 0 : -1;
+        
+        if (fclose(p_File) != 0)
+        {
+            i_Result = -1;
+        }
+    }
+    
+    if (i_Result == 0 && rename(p_TempPath, p_StorePath) != 0)
+    {
+        i_Result = -1;
+    }
+    
+    if (i_Result != 0 && i_FD >= 0)
+    {
+        remove(p_TempPath);
+    }
+    
+    free(p_TempPath);
+    return i_Result;
+}
+
+int MRH_MsQuicSaveTickets(MRH_MsQuicTicketCache* p_Cache)
+{
+    // Only one writer for the store file
+    pthread_mutex_lock(&(p_Cache->p_SaveMutex));
+    pthread_mutex_lock(&(p_Cache->p_Mutex));
+    
+    if (p_Cache->i_Dirty != 0 || p_Cache->p_StorePath == NULL)
+    {
+        pthread_mutex_unlock(&(p_Cache->p_Mutex));
+        pthread_mutex_unlock(&(p_Cache->p_SaveMutex));
+        return 0;
+    }
+    
+    // Copy the tickets, the file is written without blocking the MsQuic worker
+    char* p_StorePath = strdup(p_Cache->p_StorePath);
+    size_t us_Size = 0;
+    uint8_t* p_Buffer = (p_StorePath != NULL) ? MRH_MsQuicWriteTickets(p_Cache, &us_Size) : NULL;
+    
+    if (p_Buffer != NULL)
+    {
+        p_Cache->i_Dirty = -1;
+    }
+    
+    pthread_mutex_unlock(&(p_Cache->p_Mutex));
+    
+    int i_Result = -1;
+    
+    if (p_Buffer != NULL)
+    {
+        if ((i_Result = MRH_MsQuicWriteStore(p_StorePath, p_Buffer, us_Size)) != 0)
+        {
+            // Retry with the next save
+            pthread_mutex_lock(&(p_Cache->p_Mutex));
+            p_Cache->i_Dirty = 0;
+            pthread_mutex_unlock(&(p_Cache->p_Mutex));
+        }
+        
+        free(p_Buffer);
+    }
+    
+    if (p_StorePath != NULL)
+    {
+        free(p_StorePath);
+    }
+    
+    pthread_mutex_unlock(&(p_Cache->p_SaveMutex));
+    
+    return i_Result;
+}
+
+int MRH_MsQuicSetTicketStore(MRH_MsQuicTicketCache* p_Cache, const char* p_FilePath)
+{
+    char* p_StorePath = NULL;
+    
+    if (p_FilePath != NULL && (p_StorePath = strdup(p_FilePath)) == NULL)
+    {
+        return -1;
+    }
+    
+    pthread_mutex_lock(&(p_Cache->p_Mutex));
+    
+    if (p_Cache->p_StorePath != NULL)
+    {
+        free(p_Cache->p_StorePath);
+    }
+    
+    p_Cache->p_StorePath = p_StorePath;
+    
+    if (p_StorePath != NULL)
+    {
+        MRH_MsQuicLoadTickets(p_Cache);
+        
+        // Tickets recieved before are added to the new file
+        p_Cache->i_Dirty = 0;
+    }
+    
+    pthread_mutex_unlock(&(p_Cache->p_Mutex));
+    
+    return 0;
+}
+
+//*************************************************************************************
+// Usage
+//*************************************************************************************
+
+void MRH_MsQuicStoreTicket(MRH_MsQuicTicketCache* p_Cache, const char* p_Address, int i_Port, const uint8_t* p_Ticket, uint32_t u32_Size)
+{
+    pthread_mutex_lock(&(p_Cache->p_Mutex));
+    
+    // @NOTE: Called by the MsQuic worker, saving is done by the application
+    if (MRH_MsQuicSetTicket(p_Cache, p_Address, i_Port, p_Ticket, u32_Size) == 0)
+    {
+        p_Cache->i_Dirty = 0;
+    }
+    
+    pthread_mutex_unlock(&(p_Cache->p_Mutex));
+}
+
+int MRH_MsQuicApplyTicket(MRH_MsQuicTicketCache* p_Cache, const QUIC_API_TABLE* p_MsQuicAPI, HQUIC p_Connection, const char* p_Address, int i_Port)
+{
+    int i_Result = -1;
+    
+    pthread_mutex_lock(&(p_Cache->p_Mutex));
+    
+    MRH_MsQuicTicket* p_Ticket = MRH_MsQuicFindTicket(p_Cache, p_Address, i_Port);
+    
+    if (p_Ticket != NULL &&
+        QUIC_SUCCEEDED(p_MsQuicAPI->SetParam(p_Connection,
+                                             QUIC_PARAM_CONN_RESUMPTION_TICKET,
+                                             p_Ticket->u32_Size,
+                                             p_Ticket->p_Ticket)))
+    {
+        p_Ticket->u64_LastUse = ++(p_Cache->u64_Use);
+        i_Result = 0;
+    }
+    
+    pthread_mutex_unlock(&(p_Cache->p_Mutex));
+    
+    return i_Result;
+}
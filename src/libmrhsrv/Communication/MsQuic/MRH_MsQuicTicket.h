@@ -0,0 +1,149 @@
+/**
+ *  libmrhsrv
+ *  Copyright (C) 2021 - 2022 Jens Brörken
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty.  In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any source distribution.
+ */
+
+#ifndef MRH_MsQuicTicket_h
+#define MRH_MsQuicTicket_h
+
+// C
+#include <pthread.h>
+
+// External
+#include <msquic.h>
+
+// Project
+#include "../../../../include/libmrhsrv/libmrhsrv/MRH_ServerSizes.h"
+
+// Pre-defined
+#ifndef MRH_SRV_TICKET_CACHE_COUNT
+    #define MRH_SRV_TICKET_CACHE_COUNT 16
+#endif
+#ifndef MRH_SRV_TICKET_SIZE_MAX
+    #define MRH_SRV_TICKET_SIZE_MAX 8192
+#endif
+
+
+//*************************************************************************************
+// Ticket
+//*************************************************************************************
+
+typedef struct MRH_MsQuicTicket_t
+{
+    char p_Address[MRH_SRV_SIZE_SERVER_ADDRESS];
+    int i_Port;
+    
+    uint8_t* p_Ticket; // NULL if unused
+    uint32_t u32_Size;
+    
+    uint64_t u64_LastUse; // Oldest ticket is replaced if full
+    
+}MRH_MsQuicTicket;
+
+//*************************************************************************************
+// Cache
+//*************************************************************************************
+
+typedef struct MRH_MsQuicTicketCache_t
+{
+    pthread_mutex_t p_Mutex;
+    
+    MRH_MsQuicTicket p_Ticket[MRH_SRV_TICKET_CACHE_COUNT];
+    uint64_t u64_Use;
+    
+    char* p_StorePath; // NULL if tickets are kept in memory only
+    int i_Dirty; // 0 if tickets changed since the last save
+    
+    pthread_mutex_t p_SaveMutex; // Held while writing the store file, never by the MsQuic worker
+    
+}MRH_MsQuicTicketCache;
+
+/**
+ *  Create a new empty ticket cache.
+ *
+ *  \return The ticket cache on success, NULL on failure.
+ */
+
+extern MRH_MsQuicTicketCache* MRH_MsQuicCreateTicketCache(void);
+
+/**
+ *  Destroy a ticket cache. Changed tickets are saved first.
+ *
+ *  \param p_Cache The ticket cache to destroy.
+ *
+ *  \return Always NULL.
+ */
+
+extern MRH_MsQuicTicketCache* MRH_MsQuicDestroyTicketCache(MRH_MsQuicTicketCache* p_Cache);
+
+/**
+ *  Set the file used to keep tickets between runs. Existing tickets in the file
+ *  are loaded.
+ *
+ *  \param p_Cache The ticket cache to use.
+ *  \param p_FilePath The full file path. NULL keeps tickets in memory only.
+ *
+ *  \return 0 on success, -1 on failure.
+ */
+
+extern int MRH_MsQuicSetTicketStore(MRH_MsQuicTicketCache* p_Cache, const char* p_FilePath);
+
+/**
+ *  Save changed tickets to the store file. Must not be called by the MsQuic
+ *  worker.
+ *
+ *  \param p_Cache The ticket cache to save.
+ *
+ *  \return 0 on success or if nothing changed, -1 on failure.
+ */
+
+extern int MRH_MsQuicSaveTickets(MRH_MsQuicTicketCache* p_Cache);
+
+/**
+ *  Store a recieved resumption ticket for a server. The ticket is kept in
+ *  memory until the tickets are saved.
+ *
+ *  \param p_Cache The ticket cache to use.
+ *  \param p_Address The server address.
+ *  \param i_Port The server port.
+ *  \param p_Ticket The ticket bytes.
+ *  \param u32_Size The ticket size in bytes.
+ */
+
+extern void MRH_MsQuicStoreTicket(MRH_MsQuicTicketCache* p_Cache, const char* p_Address, int i_Port, const uint8_t* p_Ticket, uint32_t u32_Size);
+
+/**
+ *  Set the stored resumption ticket for a server on a connection which was
+ *  not started yet.
+ *
+ *  \param p_Cache The ticket cache to use.
+ *  \param p_MsQuicAPI The MsQuic api to use.
+ *  \param p_Connection The connection to set the ticket for.
+ *  \param p_Address The server address.
+ *  \param i_Port The server port.
+ *
+ *  \return 0 if a ticket was set, -1 if not.
+ */
+
+extern int MRH_MsQuicApplyTicket(MRH_MsQuicTicketCache* p_Cache, const QUIC_API_TABLE* p_MsQuicAPI, HQUIC p_Connection, const char* p_Address, int i_Port);
+
+
+#endif /* MRH_MsQuicTicket_h */
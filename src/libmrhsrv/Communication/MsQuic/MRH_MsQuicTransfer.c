@@ -0,0 +1,551 @@
+/**
+ *  libmrhsrv
+ *  Copyright (C) 2021 - 2022 Jens Brörken
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty.  In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any source distribution.
+ */
+
+
+// C
+#include <stdlib.h>
+#include <string.h>
+
+// External
+
+// Project
+#include "./MRH_MsQuic.h"
+
+
+//*************************************************************************************
+// Transfer
+//*************************************************************************************
+
+// Every transfer stream starts with the header to seperate it from messages
+static uint8_t p_TransferHeaderByte[1] = { MRH_MSQ_STREAM_HEADER_TRANSFER };
+static const QUIC_BUFFER c_TransferHeader = { 1, p_TransferHeaderByte };
+
+static MRH_MsQuicTransfer* MRH_MsQuicNewTransfer(MRH_MsQuicConnection* p_Connection, size_t us_BufferSize)
+{
+    MRH_MsQuicTransfer* p_Transfer = (MRH_MsQuicTransfer*)malloc(sizeof(MRH_MsQuicTransfer));
+    
+    if (p_Transfer == NULL)
+    {
+        return NULL;
+    }
+    
+    p_Transfer->p_Buffer = NULL;
+    
+    if (us_BufferSize > 0 && (p_Transfer->p_Buffer = (uint8_t*)malloc(us_BufferSize)) == NULL)
+    {
+        free(p_Transfer);
+        return NULL;
+    }
+    
+    pthread_condattr_t p_CondAttr;
+    
+    if (pthread_condattr_init(&p_CondAttr) != 0)
+    {
+        free(p_Transfer->p_Buffer);
+        free(p_Transfer);
+        return NULL;
+    }
+    else if (pthread_condattr_setclock(&p_CondAttr, CLOCK_MONOTONIC) != 0 ||
+             pthread_mutex_init(&(p_Transfer->p_Mutex), NULL) != 0)
+    {
+        pthread_condattr_destroy(&p_CondAttr);
+        free(p_Transfer->p_Buffer);
+        free(p_Transfer);
+        return NULL;
+    }
+    else if (pthread_cond_init(&(p_Transfer->p_Cond), &p_CondAttr) != 0)
+    {
+        pthread_mutex_destroy(&(p_Transfer->p_Mutex));
+        pthread_condattr_destroy(&p_CondAttr);
+        free(p_Transfer->p_Buffer);
+        free(p_Transfer);
+        return NULL;
+    }
+    
+    pthread_condattr_destroy(&p_CondAttr);
+    
+    p_Transfer->p_MsQuicAPI = p_Connection->p_MsQuicAPI;
+    p_Transfer->p_Connection = p_Connection;
+    atomic_init(&(p_Transfer->i_RefCount), 2);
+    p_Transfer->p_Stream = NULL;
+    p_Transfer->i_Finished = -1;
+    p_Transfer->i_Aborted = -1;
+    p_Transfer->u64_InFlight = 0;
+    p_Transfer->us_Read = 0;
+    p_Transfer->us_Write = 0;
+    p_Transfer->i_Paused = -1;
+    p_Transfer->p_Next = NULL;
+    
+    return p_Transfer;
+}
+
+MRH_MsQuicTransfer* MRH_MsQuicOpenTransfer(MRH_MsQuicConnection* p_Connection)
+{
+    HQUIC p_QuicConnection = p_Connection->p_Connection;
+    
+    if (p_QuicConnection == NULL)
+    {
+        return NULL;
+    }
+    
+    MRH_MsQuicTransfer* p_Transfer = MRH_MsQuicNewTransfer(p_Connection, 0);
+    HQUIC p_Stream;
+    
+    if (p_Transfer == NULL)
+    {
+        return NULL;
+    }
+    else if (QUIC_FAILED(p_Connection->p_MsQuicAPI->StreamOpen(p_QuicConnection,
+                                                               QUIC_STREAM_OPEN_FLAG_UNIDIRECTIONAL,
+                                                               MRH_MsQuicTransferCallback,
+                                                               p_Transfer,
+                                                               &p_Stream)))
+    {
+        p_Transfer->i_RefCount = 1;
+        MRH_MsQuicReleaseTransfer(p_Transfer);
+        return NULL;
+    }
+    
+    // @NOTE: Set before starting, the stream callback needs the handle
+    p_Transfer->p_Stream = p_Stream;
+    
+    if (QUIC_FAILED(p_Connection->p_MsQuicAPI->StreamStart(p_Stream,
+                                                           QUIC_STREAM_START_FLAG_SHUTDOWN_ON_FAIL)))
+    {
+        p_Connection->p_MsQuicAPI->StreamClose(p_Stream);
+        p_Transfer->i_RefCount = 1;
+        MRH_MsQuicReleaseTransfer(p_Transfer);
+        return NULL;
+    }
+    else if (QUIC_FAILED(p_Connection->p_MsQuicAPI->StreamSend(p_Stream,
+                                                               &c_TransferHeader,
+                                                               1,
+                                                               QUIC_SEND_FLAG_NONE,
+                                                               NULL)))
+    {
+        // Shutdown complete releases the stream reference
+        MRH_MsQuicShutdownTransfer(p_Transfer, 0);
+        MRH_MsQuicReleaseTransfer(p_Transfer);
+        return NULL;
+    }
+    
+    return p_Transfer;
+}
+
+MRH_MsQuicTransfer* MRH_MsQuicCreateTransfer(MRH_MsQuicConnection* p_Connection, HQUIC p_Stream)
+{
+    pthread_mutex_lock(&(p_Connection->p_StateMutex));
+    
+    if (p_Connection->us_TransferPending >= MRH_SRV_TRANSFER_PENDING_COUNT)
+    {
+        pthread_mutex_unlock(&(p_Connection->p_StateMutex));
+        return NULL;
+    }
+    
+    MRH_MsQuicTransfer* p_Transfer = MRH_MsQuicNewTransfer(p_Connection, MRH_SRV_TRANSFER_BUFFER_SIZE);
+    
+    if (p_Transfer != NULL)
+    {
+        p_Transfer->p_Stream = p_Stream;
+        
+        // Append, transfers are accepted in the order they were recieved
+        MRH_MsQuicTransfer** p_Last = &(p_Connection->p_TransferPending);
+        
+        while (*p_Last != NULL)
+        {
+            p_Last = &((*p_Last)->p_Next);
+        }
+        
+        *p_Last = p_Transfer;
+        p_Connection->us_TransferPending += 1;
+    }
+    
+    pthread_mutex_unlock(&(p_Connection->p_StateMutex));
+    
+    return p_Transfer;
+}
+
+void MRH_MsQuicReleaseTransfer(MRH_MsQuicTransfer* p_Transfer)
+{
+    if (atomic_fetch_sub(&(p_Transfer->i_RefCount), 1) != 1)
+    {
+        return;
+    }
+    
+    pthread_cond_destroy(&(p_Transfer->p_Cond));
+    pthread_mutex_destroy(&(p_Transfer->p_Mutex));
+    
+    if (p_Transfer->p_Buffer != NULL)
+    {
+        free(p_Transfer->p_Buffer);
+    }
+    
+    free(p_Transfer);
+}
+
+MRH_MsQuicTransfer* MRH_MsQuicAcceptTransfer(MRH_MsQuicConnection* p_Connection)
+{
+    pthread_mutex_lock(&(p_Connection->p_StateMutex));
+    
+    MRH_MsQuicTransfer* p_Transfer = p_Connection->p_TransferPending;
+    
+    if (p_Transfer != NULL)
+    {
+        p_Connection->p_TransferPending = p_Transfer->p_Next;
+        p_Connection->us_TransferPending -= 1;
+        p_Transfer->p_Next = NULL;
+    }
+    
+    pthread_mutex_unlock(&(p_Connection->p_StateMutex));
+    
+    return p_Transfer;
+}
+
+void MRH_MsQuicDropTransfers(MRH_MsQuicConnection* p_Connection)
+{
+    MRH_MsQuicTransfer* p_Transfer;
+    
+    while ((p_Transfer = MRH_MsQuicAcceptTransfer(p_Connection)) != NULL)
+    {
+        MRH_MsQuicShutdownTransfer(p_Transfer, 0);
+        MRH_MsQuicReleaseTransfer(p_Transfer);
+    }
+}
+
+//*************************************************************************************
+// Send
+//*************************************************************************************
+
+MRH_MSQ_TransferWait MRH_MsQuicReserveTransfer(MRH_MsQuicTransfer* p_Transfer, size_t us_Size, int i_TimeoutMS)
+{
+    MRH_MsQuicConnection* p_Connection = p_Transfer->p_Connection;
+    struct timespec s_End;
+    
+    if (i_TimeoutMS >= 0)
+    {
+        MRH_MsQuicGetDeadline(&s_End, i_TimeoutMS);
+    }
+    
+    pthread_mutex_lock(&(p_Transfer->p_Mutex));
+    
+    // Keep about one round trip of data queued, a single send always fits
+    while (p_Transfer->p_Stream != NULL &&
+           p_Transfer->u64_InFlight > 0 &&
+           p_Transfer->u64_InFlight + us_Size > p_Connection->u64_SendIdeal)
+    {
+        if (i_TimeoutMS < 0)
+        {
+            pthread_cond_wait(&(p_Transfer->p_Cond), &(p_Transfer->p_Mutex));
+        }
+        else if (pthread_cond_timedwait(&(p_Transfer->p_Cond), &(p_Transfer->p_Mutex), &s_End) != 0)
+        {
+            break;
+        }
+    }
+    
+    MRH_MSQ_TransferWait e_Result;
+    
+    if (p_Transfer->p_Stream == NULL)
+    {
+        e_Result = MRH_MSQ_TRANSFER_ABORTED;
+    }
+    else if (p_Transfer->u64_InFlight > 0 && p_Transfer->u64_InFlight + us_Size > p_Connection->u64_SendIdeal)
+    {
+        e_Result = MRH_MSQ_TRANSFER_TIMEOUT;
+    }
+    else
+    {
+        // Counted now, the send itself does not wait
+        p_Transfer->u64_InFlight += us_Size;
+        MRH_MsQuicAddSendBytes(p_Connection, us_Size);
+        e_Result = MRH_MSQ_TRANSFER_READY;
+    }
+    
+    pthread_mutex_unlock(&(p_Transfer->p_Mutex));
+    
+    return e_Result;
+}
+
+void MRH_MsQuicUnreserveTransfer(MRH_MsQuicTransfer* p_Transfer, size_t us_Size)
+{
+    pthread_mutex_lock(&(p_Transfer->p_Mutex));
+    
+    p_Transfer->u64_InFlight -= us_Size;
+    MRH_MsQuicRemoveSendBytes(p_Transfer->p_Connection, us_Size);
+    
+    // Other writers might fit now
+    pthread_cond_broadcast(&(p_Transfer->p_Cond));
+    pthread_mutex_unlock(&(p_Transfer->p_Mutex));
+}
+
+int MRH_MsQuicSendTransfer(MRH_MsQuicTransfer* p_Transfer, uint8_t* p_Buffer, size_t us_Size, int i_Fin)
+{
+    MRH_MsQuicConnection* p_Connection = p_Transfer->p_Connection;
+    
+    QUIC_BUFFER* p_QuicBuffer = (QUIC_BUFFER*)p_Buffer;
+    p_QuicBuffer->Buffer = &(p_Buffer[sizeof(QUIC_BUFFER)]);
+    p_QuicBuffer->Length = (uint32_t)us_Size;
+    
+    pthread_mutex_lock(&(p_Transfer->p_Mutex));
+    
+    int i_Result = -1;
+    
+    if (p_Transfer->p_Stream != NULL &&
+        QUIC_SUCCEEDED(p_Transfer->p_MsQuicAPI->StreamSend(p_Transfer->p_Stream,
+                                                           p_QuicBuffer,
+                                                           1,
+                                                           (i_Fin == 0) ? QUIC_SEND_FLAG_FIN : QUIC_SEND_FLAG_NONE,
+                                                           p_Buffer))) /* Send complete frees buffer */
+    {
+        i_Result = 0;
+    }
+    else
+    {
+        // Release the reserved bytes, nothing will complete them
+        p_Transfer->u64_InFlight -= us_Size;
+        MRH_MsQuicRemoveSendBytes(p_Connection, us_Size);
+    }
+    
+    pthread_mutex_unlock(&(p_Transfer->p_Mutex));
+    
+    if (i_Result < 0)
+    {
+        free(p_Buffer);
+    }
+    
+    return i_Result;
+}
+
+//*************************************************************************************
+// Recieve
+//*************************************************************************************
+
+MRH_MSQ_TransferWait MRH_MsQuicWaitTransfer(MRH_MsQuicTransfer* p_Transfer, size_t us_Size, int i_TimeoutMS)
+{
+    struct timespec s_End;
+    
+    if (i_TimeoutMS > 0)
+    {
+        MRH_MsQuicGetDeadline(&s_End, i_TimeoutMS);
+    }
+    
+    MRH_MSQ_TransferWait e_Result;
+    
+    pthread_mutex_lock(&(p_Transfer->p_Mutex));
+    
+    while (1)
+    {
+        if (p_Transfer->us_Write - p_Transfer->us_Read >= us_Size)
+        {
+            e_Result = MRH_MSQ_TRANSFER_READY;
+            break;
+        }
+        else if (p_Transfer->i_Finished == 0)
+        {
+            e_Result = MRH_MSQ_TRANSFER_FINISHED;
+            break;
+        }
+        else if (p_Transfer->i_Aborted == 0)
+        {
+            e_Result = MRH_MSQ_TRANSFER_ABORTED;
+            break;
+        }
+        else if (i_TimeoutMS == 0)
+        {
+            e_Result = MRH_MSQ_TRANSFER_TIMEOUT;
+            break;
+        }
+        else if (i_TimeoutMS < 0)
+        {
+            pthread_cond_wait(&(p_Transfer->p_Cond), &(p_Transfer->p_Mutex));
+        }
+        else if (pthread_cond_timedwait(&(p_Transfer->p_Cond), &(p_Transfer->p_Mutex), &s_End) != 0)
+        {
+            // Check the state one last time
+            i_TimeoutMS = 0;
+        }
+    }
+    
+    pthread_mutex_unlock(&(p_Transfer->p_Mutex));
+    
+    return e_Result;
+}
+
+size_t MRH_MsQuicReadTransfer(MRH_MsQuicTransfer* p_Transfer, uint8_t* p_Buffer, size_t us_Size)
+{
+    pthread_mutex_lock(&(p_Transfer->p_Mutex));
+    
+    size_t us_Read = p_Transfer->us_Write - p_Transfer->us_Read;
+    
+    if (us_Read > us_Size)
+    {
+        us_Read = us_Size;
+    }
+    
+    memcpy(p_Buffer, &(p_Transfer->p_Buffer[p_Transfer->us_Read]), us_Read);
+    p_Transfer->us_Read += us_Read;
+    
+    // Buffer has enough space again, continue recieving
+    if (p_Transfer->i_Paused == 0 &&
+        p_Transfer->p_Stream != NULL &&
+        p_Transfer->us_Write - p_Transfer->us_Read <= MRH_SRV_TRANSFER_BUFFER_SIZE / 2)
+    {
+        p_Transfer->i_Paused = -1;
+        p_Transfer->p_MsQuicAPI->StreamReceiveSetEnabled(p_Transfer->p_Stream, TRUE);
+    }
+    
+    pthread_mutex_unlock(&(p_Transfer->p_Mutex));
+    
+    return us_Read;
+}
+
+uint64_t MRH_MsQuicRecieveTransfer(MRH_MsQuicTransfer* p_Transfer, const QUIC_STREAM_EVENT* Event, uint64_t u64_Skip)
+{
+    uint64_t u64_Consumed = u64_Skip;
+    
+    pthread_mutex_lock(&(p_Transfer->p_Mutex));
+    
+    // Move unread bytes to the front to make space
+    if (p_Transfer->us_Read > 0)
+    {
+        memmove(p_Transfer->p_Buffer,
+                &(p_Transfer->p_Buffer[p_Transfer->us_Read]),
+                p_Transfer->us_Write - p_Transfer->us_Read);
+        
+        p_Transfer->us_Write -= p_Transfer->us_Read;
+        p_Transfer->us_Read = 0;
+    }
+    
+    for (uint32_t i = 0; i < Event->RECEIVE.BufferCount; ++i)
+    {
+        size_t us_Size = Event->RECEIVE.Buffers[i].Length;
+        
+        if (u64_Skip >= us_Size)
+        {
+            u64_Skip -= us_Size;
+            continue;
+        }
+        
+        size_t us_Copy = us_Size - (size_t)u64_Skip;
+        
+        if (us_Copy > MRH_SRV_TRANSFER_BUFFER_SIZE - p_Transfer->us_Write)
+        {
+            us_Copy = MRH_SRV_TRANSFER_BUFFER_SIZE - p_Transfer->us_Write;
+        }
+        
+        memcpy(&(p_Transfer->p_Buffer[p_Transfer->us_Write]),
+               &(Event->RECEIVE.Buffers[i].Buffer[u64_Skip]),
+               us_Copy);
+        
+        p_Transfer->us_Write += us_Copy;
+        u64_Consumed += us_Copy;
+        u64_Skip = 0;
+        
+        if (p_Transfer->us_Write == MRH_SRV_TRANSFER_BUFFER_SIZE)
+        {
+            break;
+        }
+    }
+    
+    // Full, reading resumes recieving
+    if (u64_Consumed < Event->RECEIVE.TotalBufferLength)
+    {
+        p_Transfer->i_Paused = 0;
+    }
+    
+    pthread_cond_broadcast(&(p_Transfer->p_Cond));
+    pthread_mutex_unlock(&(p_Transfer->p_Mutex));
+    
+    return u64_Consumed;
+}
+
+//*************************************************************************************
+// State
+//*************************************************************************************
+
+void MRH_MsQuicShutdownTransfer(MRH_MsQuicTransfer* p_Transfer, int i_Abort)
+{
+    pthread_mutex_lock(&(p_Transfer->p_Mutex));
+    
+    if (p_Transfer->p_Stream != NULL)
+    {
+        p_Transfer->p_MsQuicAPI->StreamShutdown(p_Transfer->p_Stream,
+                                                (i_Abort == 0) ? QUIC_STREAM_SHUTDOWN_FLAG_ABORT : QUIC_STREAM_SHUTDOWN_FLAG_GRACEFUL,
+                                                0);
+    }
+    
+    pthread_mutex_unlock(&(p_Transfer->p_Mutex));
+}
+
+void MRH_MsQuicUpdateTransfer(MRH_MsQuicTransfer* p_Transfer, const QUIC_STREAM_EVENT* Event)
+{
+    pthread_mutex_lock(&(p_Transfer->p_Mutex));
+    
+    switch (Event->Type)
+    {
+        case QUIC_STREAM_EVENT_SEND_COMPLETE:
+        {
+            // @NOTE: The stream header has no buffer
+            uint8_t* p_Buffer = (uint8_t*)(Event->SEND_COMPLETE.ClientContext);
+            
+            if (p_Buffer != NULL)
+            {
+                uint32_t u32_Size = ((QUIC_BUFFER*)p_Buffer)->Length;
+                
+                p_Transfer->u64_InFlight -= u32_Size;
+                MRH_MsQuicRemoveSendBytes(p_Transfer->p_Connection, u32_Size);
+                free(p_Buffer);
+            }
+            break;
+        }
+            
+        case QUIC_STREAM_EVENT_PEER_SEND_SHUTDOWN:
+        {
+            p_Transfer->i_Finished = 0;
+            break;
+        }
+            
+        case QUIC_STREAM_EVENT_PEER_SEND_ABORTED:
+        {
+            p_Transfer->i_Aborted = 0;
+            break;
+        }
+            
+        case QUIC_STREAM_EVENT_SHUTDOWN_COMPLETE:
+        {
+            // Streams closed before the peer finished lost data
+            if (p_Transfer->i_Finished != 0)
+            {
+                p_Transfer->i_Aborted = 0;
+            }
+            
+            p_Transfer->p_Stream = NULL;
+            break;
+        }
+            
+        default: { break; }
+    }
+    
+    pthread_cond_broadcast(&(p_Transfer->p_Cond));
+    pthread_mutex_unlock(&(p_Transfer->p_Mutex));
+}
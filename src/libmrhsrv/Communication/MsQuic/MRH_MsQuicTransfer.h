@@ -0,0 +1,235 @@
+/**
+ *  libmrhsrv
+ *  Copyright (C) 2021 - 2022 Jens Brörken
+ *
+ *  This software is provided 'as-is', without any express or implied
+ *  warranty.  In no event will the authors be held liable for any damages
+ *  arising from the use of this software.
+ *
+ *  Permission is granted to anyone to use this software for any purpose,
+ *  including commercial applications, and to alter it and redistribute it
+ *  freely, subject to the following restrictions:
+ *
+ *  1. The origin of this software must not be misrepresented; you must not
+ *     claim that you wrote the original software. If you use this software
+ *     in a product, an acknowledgment in the product documentation would be
+ *     appreciated but is not required.
+ *
+ *  2. Altered source versions must be plainly marked as such, and must not be
+ *     misrepresented as being the original software.
+ *
+ *  3. This notice may not be removed or altered from any source distribution.
+ */
+
+
+#ifndef MRH_MsQuicTransfer_h
+#define MRH_MsQuicTransfer_h
+
+// C
+#include <stdatomic.h>
+#include <pthread.h>
+
+// External
+#include <msquic.h>
+
+// Project
+
+// Pre-defined
+#ifndef MRH_SRV_TRANSFER_BUFFER_SIZE
+    #define MRH_SRV_TRANSFER_BUFFER_SIZE 262144 // Recieved bytes kept before pausing the stream
+#endif
+#ifndef MRH_SRV_TRANSFER_PENDING_COUNT
+    #define MRH_SRV_TRANSFER_PENDING_COUNT 8 // Recieved transfers waiting to be accepted
+#endif
+
+#define MRH_MSQ_STREAM_HEADER_TRANSFER 0xFE // First byte on a transfer stream, no net message uses this id
+
+
+//*************************************************************************************
+// Transfer
+//*************************************************************************************
+
+typedef enum
+{
+    MRH_MSQ_TRANSFER_READY = 0, // Requested bytes are available
+    MRH_MSQ_TRANSFER_TIMEOUT = 1, // Requested bytes not yet available
+    MRH_MSQ_TRANSFER_FINISHED = 2, // Peer finished sending, requested bytes won't arrive
+    MRH_MSQ_TRANSFER_ABORTED = 3 // Stream was aborted or lost
+    
+}MRH_MSQ_TransferWait;
+
+struct MRH_MsQuicConnection_t;
+
+typedef struct MRH_MsQuicTransfer_t
+{
+    const QUIC_API_TABLE* p_MsQuicAPI;
+    struct MRH_MsQuicConnection_t* p_Connection;
+    
+    pthread_mutex_t p_Mutex;
+    pthread_cond_t p_Cond; // Signaled on send completion, recieved bytes and shutdown
+    _Atomic(int) i_RefCount; // Stream and user each hold a reference
+    
+    HQUIC p_Stream; // NULL once the stream was closed
+    int i_Finished; // 0 if the peer finished sending
+    int i_Aborted; // 0 if the stream was aborted or lost
+    
+    // Send
+    uint64_t u64_InFlight;
+    
+    // Recieve
+    uint8_t* p_Buffer;
+    size_t us_Read;
+    size_t us_Write;
+    int i_Paused; // 0 if recieving was paused because the buffer is full
+    
+    struct MRH_MsQuicTransfer_t* p_Next; // Pending accept list
+    
+}MRH_MsQuicTransfer;
+
+/**
+ *  Open a new transfer stream for sending.
+ *
+ *  \param p_Connection The connection to open the stream on.
+ *
+ *  \return The transfer on success, NULL on failure.
+ */
+
+extern MRH_MsQuicTransfer* MRH_MsQuicOpenTransfer(struct MRH_MsQuicConnection_t* p_Connection);
+
+/**
+ *  Create a transfer for a recieved stream and add it to the pending transfers.
+ *  Only called by the MsQuic worker.
+ *
+ *  \param p_Connection The connection the stream belongs to.
+ *  \param p_Stream The recieved stream.
+ *
+ *  \return The transfer on success, NULL on failure.
+ */
+
+extern MRH_MsQuicTransfer* MRH_MsQuicCreateTransfer(struct MRH_MsQuicConnection_t* p_Connection, HQUIC p_Stream);
+
+/**
+ *  Release a reference to a transfer. The transfer is freed with the last
+ *  reference.
+ *
+ *  \param p_Transfer The transfer to release.
+ */
+
+extern void MRH_MsQuicReleaseTransfer(MRH_MsQuicTransfer* p_Transfer);
+
+/**
+ *  Grab the oldest pending recieved transfer.
+ *
+ *  \param p_Connection The connection to grab the transfer from.
+ *
+ *  \return The transfer, NULL if none is pending.
+ */
+
+extern MRH_MsQuicTransfer* MRH_MsQuicAcceptTransfer(struct MRH_MsQuicConnection_t* p_Connection);
+
+/**
+ *  Release all pending recieved transfers.
+ *
+ *  \param p_Connection The connection to release the transfers for.
+ */
+
+extern void MRH_MsQuicDropTransfers(struct MRH_MsQuicConnection_t* p_Connection);
+
+/**
+ *  Reserve bytes to send on a transfer stream. Waits until the bytes in flight
+ *  of the transfer fit the ideal send buffer size. Reserved bytes have to be
+ *  sent with MRH_MsQuicSendTransfer().
+ *
+ *  \param p_Transfer The transfer to send on.
+ *  \param us_Size The number of bytes to reserve.
+ *  \param i_TimeoutMS The maximum time to wait in milliseconds. Negative values
+ *                     wait without a timeout.
+ *
+ *  \return MRH_MSQ_TRANSFER_READY if reserved, MRH_MSQ_TRANSFER_TIMEOUT or
+ *          MRH_MSQ_TRANSFER_ABORTED if not.
+ */
+
+extern MRH_MSQ_TransferWait MRH_MsQuicReserveTransfer(MRH_MsQuicTransfer* p_Transfer, size_t us_Size, int i_TimeoutMS);
+
+/**
+ *  Release reserved bytes which will not be sent.
+ *
+ *  \param p_Transfer The transfer the bytes were reserved on.
+ *  \param us_Size The number of reserved bytes.
+ */
+
+extern void MRH_MsQuicUnreserveTransfer(MRH_MsQuicTransfer* p_Transfer, size_t us_Size);
+
+/**
+ *  Send reserved bytes on a transfer stream. Does not wait.
+ *
+ *  \param p_Transfer The transfer to send on.
+ *  \param p_Buffer The buffer to send, starting with a QUIC_BUFFER. The buffer is
+ *                  owned by the transfer afterwards.
+ *  \param us_Size The number of reserved bytes to send after the QUIC_BUFFER.
+ *  \param i_Fin 0 if this is the last send, -1 if not.
+ *
+ *  \return 0 on success, -1 on failure.
+ */
+
+extern int MRH_MsQuicSendTransfer(MRH_MsQuicTransfer* p_Transfer, uint8_t* p_Buffer, size_t us_Size, int i_Fin);
+
+/**
+ *  Wait for recieved bytes on a transfer stream.
+ *
+ *  \param p_Transfer The transfer to wait for.
+ *  \param us_Size The number of bytes to wait for, at most
+ *                 MRH_SRV_TRANSFER_BUFFER_SIZE.
+ *  \param i_TimeoutMS The maximum time to wait in milliseconds. Negative values
+ *                     wait without a timeout.
+ *
+ *  \return The wait result.
+ */
+
+extern MRH_MSQ_TransferWait MRH_MsQuicWaitTransfer(MRH_MsQuicTransfer* p_Transfer, size_t us_Size, int i_TimeoutMS);
+
+/**
+ *  Read recieved bytes from a transfer stream. Paused streams are resumed.
+ *
+ *  \param p_Transfer The transfer to read from.
+ *  \param p_Buffer The buffer to write to.
+ *  \param us_Size The maximum number of bytes to read.
+ *
+ *  \return The number of bytes read.
+ */
+
+extern size_t MRH_MsQuicReadTransfer(MRH_MsQuicTransfer* p_Transfer, uint8_t* p_Buffer, size_t us_Size);
+
+/**
+ *  Copy recieved stream bytes into the transfer buffer. Only called by the
+ *  MsQuic worker.
+ *
+ *  \param p_Transfer The transfer which recieved the bytes.
+ *  \param Event The recieve event.
+ *  \param u64_Skip The number of bytes to skip at the start.
+ *
+ *  \return The number of bytes consumed, including skipped bytes.
+ */
+
+extern uint64_t MRH_MsQuicRecieveTransfer(MRH_MsQuicTransfer* p_Transfer, const QUIC_STREAM_EVENT* Event, uint64_t u64_Skip);
+
+/**
+ *  Shut down a transfer stream.
+ *
+ *  \param p_Transfer The transfer to shut down.
+ *  \param i_Abort 0 to abort the stream, -1 to shut down gracefully.
+ */
+
+extern void MRH_MsQuicShutdownTransfer(MRH_MsQuicTransfer* p_Transfer, int i_Abort);
+
+/**
+ *  Update the transfer state for a stream event. Only called by the MsQuic worker.
+ *
+ *  \param p_Transfer The transfer to update.
+ *  \param Event The stream event.
+ */
+
+extern void MRH_MsQuicUpdateTransfer(MRH_MsQuicTransfer* p_Transfer, const QUIC_STREAM_EVENT* Event);
+
+
+#endif /* MRH_MsQuicTransfer_h */
@@ -63,6 +63,45 @@ size_t FROM_MRH_SRV_MSG_AUTH_REQUEST(uint8_t* p_Buffer, const MRH_SRV_MSG_AUTH_R
     return (MRH_SRV_SIZE_ACCOUNT_MAIL + MRH_SRV_SIZE_DEVICE_KEY + 2);
 }
 
+void TO_MRH_SRV_MSG_AUTH_REQUEST(MRH_SRV_MSG_AUTH_REQUEST_DATA* p_NetMessage, const uint8_t* p_Buffer)
+{
+    memcpy(&(p_NetMessage->p_Mail[0]),
+           p_Buffer,
+           MRH_SRV_SIZE_ACCOUNT_MAIL);
+    memcpy(&(p_NetMessage->p_DeviceKey[0]),
+           &(p_Buffer[MRH_SRV_SIZE_ACCOUNT_MAIL]),
+           MRH_SRV_SIZE_DEVICE_KEY);
+    
+    p_NetMessage->u8_ClientType = p_Buffer[MRH_SRV_SIZE_ACCOUNT_MAIL + MRH_SRV_SIZE_DEVICE_KEY];
+    p_NetMessage->u8_Version = p_Buffer[MRH_SRV_SIZE_ACCOUNT_MAIL + MRH_SRV_SIZE_DEVICE_KEY + 1];
+}
+
+size_t FROM_MRH_SRV_MSG_AUTH_CHALLENGE(uint8_t* p_Buffer, const MRH_SRV_MSG_AUTH_CHALLENGE_DATA* p_NetMessage)
+{
+    memcpy(p_Buffer,
+           &(p_NetMessage->p_Salt[0]),
+           MRH_SRV_SIZE_ACCOUNT_PASSWORD_SALT);
+    
+    if (IS_BIG_ENDIAN)
+    {
+        uint32_t u32_Nonce = bswap_32(p_NetMessage->u32_Nonce);
+        
+        memcpy(&(p_Buffer[MRH_SRV_SIZE_ACCOUNT_PASSWORD_SALT]),
+               &u32_Nonce,
+               sizeof(uint32_t));
+    }
+    else
+    {
+        memcpy(&(p_Buffer[MRH_SRV_SIZE_ACCOUNT_PASSWORD_SALT]),
+               &(p_NetMessage->u32_Nonce),
+               sizeof(uint32_t));
+    }
+    
+    p_Buffer[MRH_SRV_SIZE_ACCOUNT_PASSWORD_SALT + sizeof(uint32_t)] = p_NetMessage->u8_HashType;
+    
+    return (MRH_SRV_SIZE_ACCOUNT_PASSWORD_SALT + sizeof(uint32_t) + 1);
+}
+
 void TO_MRH_SRV_MSG_AUTH_CHALLENGE(MRH_SRV_MSG_AUTH_CHALLENGE_DATA* p_NetMessage, const uint8_t* p_Buffer)
 {
     memcpy(&(p_NetMessage->p_Salt[0]),
@@ -89,6 +128,20 @@ size_t FROM_MRH_SRV_MSG_AUTH_PROOF(uint8_t* p_Buffer, const MRH_SRV_MSG_AUTH_PRO
     return MRH_SRV_SIZE_NONCE_HASH;
 }
 
+void TO_MRH_SRV_MSG_AUTH_PROOF(MRH_SRV_MSG_AUTH_PROOF_DATA* p_NetMessage, const uint8_t* p_Buffer)
+{
+    memcpy(&(p_NetMessage->p_NonceHash[0]),
+           p_Buffer,
+           MRH_SRV_SIZE_NONCE_HASH);
+}
+
+size_t FROM_MRH_SRV_MSG_AUTH_RESULT(uint8_t* p_Buffer, const MRH_SRV_MSG_AUTH_RESULT_DATA* p_NetMessage)
+{
+    p_Buffer[0] = p_NetMessage->u8_Result;
+    
+    return 1;
+}
+
 void TO_MRH_SRV_MSG_AUTH_RESULT(MRH_SRV_MSG_AUTH_RESULT_DATA* p_NetMessage, const uint8_t* p_Buffer)
 {
     p_NetMessage->u8_Result = p_Buffer[0];
@@ -241,6 +294,15 @@ size_t FROM_MRH_SRV_MSG_NOTIFICATION(uint8_t* p_Buffer, const MRH_SRV_MSG_NOTIFI
     return us_StringLen;
 }
 
+void TO_MRH_SRV_MSG_NOTIFICATION(MRH_SRV_MSG_NOTIFICATION_DATA* p_NetMessage, const uint8_t* p_Buffer)
+{
+    size_t us_StringLen = strnlen((const char*)p_Buffer, MRH_SRV_SIZE_NOTIFICATION_STRING);
+    
+    memcpy(&(p_NetMessage->p_String[0]),
+           p_Buffer,
+           us_StringLen);
+}
+
 size_t FROM_MRH_SRV_MSG_CUSTOM(uint8_t* p_Buffer, const MRH_SRV_MSG_CUSTOM_DATA* p_NetMessage)
 {
     memcpy(p_Buffer,
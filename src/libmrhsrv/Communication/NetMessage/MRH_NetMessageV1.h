@@ -47,6 +47,26 @@
 
 extern size_t FROM_MRH_SRV_MSG_AUTH_REQUEST(uint8_t* p_Buffer, const MRH_SRV_MSG_AUTH_REQUEST_DATA* p_NetMessage);
 
+/**
+ *  Set the data for a given MRH_SRV_MSG_AUTH_REQUEST net message with a given buffer.
+ *
+ *  \param p_NetMessage The net message to set.
+ *  \param p_Buffer The buffer to use.
+ */
+
+extern void TO_MRH_SRV_MSG_AUTH_REQUEST(MRH_SRV_MSG_AUTH_REQUEST_DATA* p_NetMessage, const uint8_t* p_Buffer);
+
+/**
+ *  Set the message buffer for a given MRH_SRV_MSG_AUTH_CHALLENGE net message.
+ *
+ *  \param p_Buffer The buffer to set.
+ *  \param p_NetMessage The net message to use.
+ *
+ *  \return The message buffer size in bytes.
+ */
+
+extern size_t FROM_MRH_SRV_MSG_AUTH_CHALLENGE(uint8_t* p_Buffer, const MRH_SRV_MSG_AUTH_CHALLENGE_DATA* p_NetMessage);
+
 /**
  *  Set the data for a given TO_MRH_SRV_MSG_AUTH_CHALLENGE net message with a given buffer.
  *
@@ -67,6 +87,26 @@ extern void TO_MRH_SRV_MSG_AUTH_CHALLENGE(MRH_SRV_MSG_AUTH_CHALLENGE_DATA* p_Net
 
 extern size_t FROM_MRH_SRV_MSG_AUTH_PROOF(uint8_t* p_Buffer, const MRH_SRV_MSG_AUTH_PROOF_DATA* p_NetMessage);
 
+/**
+ *  Set the data for a given MRH_SRV_MSG_AUTH_PROOF net message with a given buffer.
+ *
+ *  \param p_NetMessage The net message to set.
+ *  \param p_Buffer The buffer to use.
+ */
+
+extern void TO_MRH_SRV_MSG_AUTH_PROOF(MRH_SRV_MSG_AUTH_PROOF_DATA* p_NetMessage, const uint8_t* p_Buffer);
+
+/**
+ *  Set the message buffer for a given MRH_SRV_MSG_AUTH_RESULT net message.
+ *
+ *  \param p_Buffer The buffer to set.
+ *  \param p_NetMessage The net message to use.
+ *
+ *  \return The message buffer size in bytes.
+ */
+
+extern size_t FROM_MRH_SRV_MSG_AUTH_RESULT(uint8_t* p_Buffer, const MRH_SRV_MSG_AUTH_RESULT_DATA* p_NetMessage);
+
 /**
  *  Set the data for a given TO_MRH_SRV_MSG_AUTH_RESULT net message with a given buffer.
  *
@@ -122,6 +162,15 @@ extern size_t FROM_MRH_SRV_MSG_LOCATION(uint8_t* p_Buffer, const MRH_SRV_MSG_LOC
 
 extern size_t FROM_MRH_SRV_MSG_NOTIFICATION(uint8_t* p_Buffer, const MRH_SRV_MSG_NOTIFICATION_DATA* p_NetMessage);
 
+/**
+ *  Set the data for a given MRH_SRV_MSG_NOTIFICATION net message with a given buffer.
+ *
+ *  \param p_NetMessage The net message to set.
+ *  \param p_Buffer The buffer to use.
+ */
+
+extern void TO_MRH_SRV_MSG_NOTIFICATION(MRH_SRV_MSG_NOTIFICATION_DATA* p_NetMessage, const uint8_t* p_Buffer);
+
 /**
  *  Set the data for a given MRH_SRV_MSG_LOCATION net message with a given buffer.
  *
@@ -33,8 +33,8 @@
 // Error Data
 //*************************************************************************************
 
-// Last error
-static MRH_Server_Error_Type e_LastError = MRH_SERVER_ERROR_NONE;
+// Last error, kept per thread
+static _Thread_local MRH_Server_Error_Type e_LastError = MRH_SERVER_ERROR_NONE;
 
 //*************************************************************************************
 // Reset
@@ -111,6 +111,40 @@ const char* MRH_ERR_GetServerErrorString(void)
             return "Failed to start stream to send";
         case MRH_SERVER_ERROR_SEND_STREAM_SEND:
             return "Failed to send quic stream data";
+        case MRH_SERVER_ERROR_SEND_DATAGRAM:
+            return "Failed to send quic datagram";
+            
+        // Stream
+        case MRH_SERVER_ERROR_STREAM_OPEN:
+            return "Failed to open transfer stream";
+        case MRH_SERVER_ERROR_STREAM_CLOSED:
+            return "The transfer stream was closed";
+            
+        // MsQuic
+        case MRH_SERVER_ERROR_MSQUIC_EXECUTION:
+            return "MsQuic execution config setup failed";
+            
+        // Listen
+        case MRH_SERVER_ERROR_LISTEN_START:
+            return "Failed to start listening";
+            
+        // Auth
+        case MRH_SERVER_ERROR_AUTH_POOL_START:
+            return "Failed to start the auth workers";
+        case MRH_SERVER_ERROR_AUTH_POOL_FULL:
+            return "Auth queue is full";
+            
+        // Ticket
+        case MRH_SERVER_ERROR_TICKET_SAVE:
+            return "Failed to save resumption tickets";
+            
+        // Encryption
+        case MRH_SERVER_ERROR_ENCRYPTION_REPLAY:
+            return "Message counter was already recieved or is too old";
+            
+        // Stream
+        case MRH_SERVER_ERROR_STREAM_TIMEOUT:
+            return "Timed out waiting to send on the transfer stream";
             
         default:
             return NULL;
@@ -24,11 +24,13 @@
 // C
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 // External
 #include <sodium.h>
 
 // Project
+#include "../../include/libmrhsrv/libmrhsrv/MRH_Server.h"
 #include "../../include/libmrhsrv/libmrhsrv/Communication/MRH_ServerCommunication.h"
 #include "./Error/MRH_ServerErrorInternal.h"
 #include "./MRH_ServerTypesInternal.h"
@@ -40,20 +42,75 @@
 #ifndef MRH_SRV_ALPN_NAME
     #define MRH_SRV_ALPN_NAME "mrh_srv_alpn"
 #endif
+#define MRH_SRV_SESSION_KEY_CONTEXT "mrh_sess" // crypto_kdf_CONTEXTBYTES
 
 
 //*************************************************************************************
 // Context
 //*************************************************************************************
 
+void MRH_SRV_GetDefaultInitOptions(MRH_Srv_InitOptions* p_Options, MRH_Srv_Actor e_Client, int i_MaxServerCount, int i_TimeoutMS)
+{
+    if (p_Options == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return;
+    }
+    
+    p_Options->e_Client = e_Client;
+    p_Options->i_MaxServerCount = i_MaxServerCount;
+    p_Options->i_TimeoutMS = i_TimeoutMS;
+    
+    p_Options->p_RegistrationName = MRH_SRV_REGISTRATION_NAME;
+    p_Options->p_Alpn = MRH_SRV_ALPN_NAME;
+    p_Options->e_Profile = MRH_SRV_PROFILE_LOW_LATENCY;
+    
+    p_Options->p_CertificateFile = NULL;
+    p_Options->p_PrivateKeyFile = NULL;
+    
+    p_Options->e_Congestion = MRH_SRV_CONGESTION_CUBIC;
+    p_Options->u32_StreamRecvWindow = 0;
+    p_Options->u32_ConnFlowControlWindow = 0;
+    p_Options->i_SendBuffering = 0;
+    p_Options->i_Pacing = 0;
+    p_Options->u32_KeepAliveIntervalMS = 0;
+    p_Options->u32_HandshakeIdleTimeoutMS = 0;
+    
+    p_Options->p_ProcessorList = NULL;
+    p_Options->u32_ProcessorCount = 0;
+    p_Options->e_Partition = MRH_SRV_PARTITION_AUTO;
+}
+
 MRH_Srv_Context* MRH_SRV_Init(MRH_Srv_Actor e_Client, int i_MaxServerCount, int i_TimeoutMS)
 {
-    if (e_Client != MRH_SRV_CLIENT_APP && e_Client != MRH_SRV_CLIENT_PLATFORM)
+    MRH_Srv_InitOptions c_Options;
+    
+    MRH_SRV_GetDefaultInitOptions(&c_Options, e_Client, i_MaxServerCount, i_TimeoutMS);
+    
+    return MRH_SRV_InitEx(&c_Options);
+}
+
+MRH_Srv_Context* MRH_SRV_InitEx(const MRH_Srv_InitOptions* p_Options)
+{
+    if (p_Options == NULL ||
+        p_Options->e_Client > MRH_SRV_ACTOR_MAX ||
+        (p_Options->e_Client == MRH_SRV_SERVER && (p_Options->p_CertificateFile == NULL || p_Options->p_PrivateKeyFile == NULL)) ||
+        p_Options->p_RegistrationName == NULL ||
+        p_Options->p_Alpn == NULL ||
+        p_Options->e_Profile > MRH_SRV_PROFILE_MAX ||
+        p_Options->e_Congestion > MRH_SRV_CONGESTION_MAX ||
+        p_Options->e_Partition > MRH_SRV_PARTITION_MAX ||
+        (p_Options->p_ProcessorList == NULL && p_Options->u32_ProcessorCount > 0) ||
+        p_Options->u32_ProcessorCount > UINT16_MAX)
     {
         MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
         return NULL;
     }
     
+    MRH_Srv_Actor e_Client = p_Options->e_Client;
+    int i_MaxServerCount = p_Options->i_MaxServerCount;
+    int i_TimeoutMS = p_Options->i_TimeoutMS;
+    
     // Sodium
     if (sodium_init() != 0)
     {
@@ -71,20 +128,35 @@ MRH_Srv_Context* MRH_SRV_Init(MRH_Srv_Actor e_Client, int i_MaxServerCount, int
     
     QUIC_STATUS ui_Status;
     
+    QUIC_EXECUTION_PROFILE p_Profile[MRH_SRV_PROFILE_COUNT] =
+    {
+        QUIC_EXECUTION_PROFILE_LOW_LATENCY,
+        QUIC_EXECUTION_PROFILE_TYPE_MAX_THROUGHPUT,
+        QUIC_EXECUTION_PROFILE_TYPE_SCAVENGER,
+        QUIC_EXECUTION_PROFILE_TYPE_REAL_TIME
+    };
+    
+    QUIC_CONGESTION_CONTROL_ALGORITHM p_Congestion[MRH_SRV_CONGESTION_COUNT] =
+    {
+        QUIC_CONGESTION_CONTROL_ALGORITHM_CUBIC,
+        QUIC_CONGESTION_CONTROL_ALGORITHM_BBR
+    };
+    
     QUIC_REGISTRATION_CONFIG c_RegistrationConfig =
     {
-        MRH_SRV_REGISTRATION_NAME, // @TODO: Config
-        QUIC_EXECUTION_PROFILE_LOW_LATENCY
+        p_Options->p_RegistrationName,
+        p_Profile[p_Options->e_Profile]
     };
     
     QUIC_BUFFER c_Alpn =
     {
-        sizeof(MRH_SRV_ALPN_NAME) - 1,
-        (uint8_t*)MRH_SRV_ALPN_NAME
+        (uint32_t)strlen(p_Options->p_Alpn),
+        (uint8_t*)p_Options->p_Alpn
     };
     
     QUIC_SETTINGS c_Settings = { 0 };
     QUIC_CREDENTIAL_CONFIG c_CredConfig;
+    QUIC_CERTIFICATE_FILE c_CertFile;
     
     // Setup MsQuic api info
     if (QUIC_FAILED(ui_Status = MsQuicOpen(&p_MsQuicAPI)))
@@ -93,6 +165,47 @@ MRH_Srv_Context* MRH_SRV_Init(MRH_Srv_Actor e_Client, int i_MaxServerCount, int
         return NULL;
     }
     
+    // Pin the workers before the registration starts them, one partition per core
+    int i_PartitionCount = (int)p_Options->u32_ProcessorCount;
+    
+    if (p_Options->u32_ProcessorCount > 0)
+    {
+        uint32_t u32_ConfigSize = QUIC_EXECUTION_CONFIG_MIN_SIZE + (p_Options->u32_ProcessorCount * sizeof(uint16_t));
+        QUIC_EXECUTION_CONFIG* p_ExecutionConfig = (QUIC_EXECUTION_CONFIG*)malloc(u32_ConfigSize);
+        
+        if (p_ExecutionConfig == NULL)
+        {
+            MsQuicClose(p_MsQuicAPI);
+            MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_MALLOC);
+            return NULL;
+        }
+        
+        memset(p_ExecutionConfig, 0, u32_ConfigSize);
+        p_ExecutionConfig->Flags = QUIC_EXECUTION_CONFIG_FLAG_NONE;
+        p_ExecutionConfig->ProcessorCount = p_Options->u32_ProcessorCount;
+        memcpy(p_ExecutionConfig->ProcessorList, p_Options->p_ProcessorList, p_Options->u32_ProcessorCount * sizeof(uint16_t));
+        
+        // @NOTE: Global, fails if MsQuic workers were already started by another registration
+        ui_Status = p_MsQuicAPI->SetParam(NULL,
+                                          QUIC_PARAM_GLOBAL_EXECUTION_CONFIG,
+                                          u32_ConfigSize,
+                                          p_ExecutionConfig);
+        free(p_ExecutionConfig);
+        
+        if (QUIC_FAILED(ui_Status))
+        {
+            MsQuicClose(p_MsQuicAPI);
+            MRH_ERR_SetServerError(MRH_SERVER_ERROR_MSQUIC_EXECUTION);
+            return NULL;
+        }
+    }
+    else
+    {
+        // MsQuic creates a partition for each online core
+        long l_Cores = sysconf(_SC_NPROCESSORS_ONLN);
+        i_PartitionCount = (l_Cores > 0 && l_Cores <= UINT16_MAX) ? (int)l_Cores : 1;
+    }
+    
     // Now start the registration
     if (QUIC_FAILED(ui_Status = p_MsQuicAPI->RegistrationOpen(&c_RegistrationConfig,
                                                               &p_MsQuicRegistration)))
@@ -105,14 +218,72 @@ MRH_Srv_Context* MRH_SRV_Init(MRH_Srv_Actor e_Client, int i_MaxServerCount, int
     // Got registration, setup configuration
     memset(&c_CredConfig, 0, sizeof(c_CredConfig));
     
-    c_Settings.PeerUnidiStreamCount = i_MaxServerCount * (MRH_SRV_MESSAGE_BUFFER_COUNT * 2); // Send + Recieve
+    // @NOTE: Servers limit each accepted client connection
+    if (e_Client == MRH_SRV_SERVER)
+    {
+        c_Settings.PeerUnidiStreamCount = MRH_SRV_MESSAGE_BUFFER_COUNT * 2; // Send + Recieve
+        c_Settings.ServerResumptionLevel = QUIC_SERVER_RESUME_AND_ZERORTT; // Clients resume with stored tickets
+        c_Settings.IsSet.ServerResumptionLevel = TRUE;
+    }
+    else
+    {
+        c_Settings.PeerUnidiStreamCount = i_MaxServerCount * (MRH_SRV_MESSAGE_BUFFER_COUNT * 2); // Send + Recieve
+    }
+    
     c_Settings.IsSet.PeerUnidiStreamCount = TRUE;
     c_Settings.IdleTimeoutMs = i_TimeoutMS;
     c_Settings.IsSet.IdleTimeoutMs = TRUE;
+    c_Settings.DatagramReceiveEnabled = TRUE; // Only used if datagrams are enabled by the server
+    c_Settings.IsSet.DatagramReceiveEnabled = TRUE;
+    c_Settings.CongestionControlAlgorithm = (uint16_t)p_Congestion[p_Options->e_Congestion];
+    c_Settings.IsSet.CongestionControlAlgorithm = TRUE;
+    c_Settings.SendBufferingEnabled = (p_Options->i_SendBuffering == 0) ? TRUE : FALSE;
+    c_Settings.IsSet.SendBufferingEnabled = TRUE;
+    c_Settings.PacingEnabled = (p_Options->i_Pacing == 0) ? TRUE : FALSE;
+    c_Settings.IsSet.PacingEnabled = TRUE;
+    
+    // Zero keeps the MsQuic default
+    if (p_Options->u32_StreamRecvWindow > 0)
+    {
+        c_Settings.StreamRecvWindowDefault = p_Options->u32_StreamRecvWindow;
+        c_Settings.IsSet.StreamRecvWindowDefault = TRUE;
+        c_Settings.StreamRecvWindowUnidiDefault = p_Options->u32_StreamRecvWindow; // Messages use unidirectional streams
+        c_Settings.IsSet.StreamRecvWindowUnidiDefault = TRUE;
+    }
+    
+    if (p_Options->u32_ConnFlowControlWindow > 0)
+    {
+        c_Settings.ConnFlowControlWindow = p_Options->u32_ConnFlowControlWindow;
+        c_Settings.IsSet.ConnFlowControlWindow = TRUE;
+    }
+    
+    if (p_Options->u32_KeepAliveIntervalMS > 0)
+    {
+        c_Settings.KeepAliveIntervalMs = p_Options->u32_KeepAliveIntervalMS;
+        c_Settings.IsSet.KeepAliveIntervalMs = TRUE;
+    }
+    
+    if (p_Options->u32_HandshakeIdleTimeoutMS > 0)
+    {
+        c_Settings.HandshakeIdleTimeoutMs = p_Options->u32_HandshakeIdleTimeoutMS;
+        c_Settings.IsSet.HandshakeIdleTimeoutMs = TRUE;
+    }
 
-    c_CredConfig.Type = QUIC_CREDENTIAL_TYPE_NONE;
-    c_CredConfig.Flags = QUIC_CREDENTIAL_FLAG_CLIENT;
-    c_CredConfig.Flags |= QUIC_CREDENTIAL_FLAG_NO_CERTIFICATE_VALIDATION;
+    if (e_Client == MRH_SRV_SERVER)
+    {
+        c_CertFile.CertificateFile = p_Options->p_CertificateFile;
+        c_CertFile.PrivateKeyFile = p_Options->p_PrivateKeyFile;
+        
+        c_CredConfig.Type = QUIC_CREDENTIAL_TYPE_CERTIFICATE_FILE;
+        c_CredConfig.Flags = QUIC_CREDENTIAL_FLAG_NONE;
+        c_CredConfig.CertificateFile = &c_CertFile;
+    }
+    else
+    {
+        c_CredConfig.Type = QUIC_CREDENTIAL_TYPE_NONE;
+        c_CredConfig.Flags = QUIC_CREDENTIAL_FLAG_CLIENT;
+        c_CredConfig.Flags |= QUIC_CREDENTIAL_FLAG_NO_CERTIFICATE_VALIDATION;
+    }
 
     if (QUIC_FAILED(ui_Status = p_MsQuicAPI->ConfigurationOpen(p_MsQuicRegistration,
                                                                &c_Alpn,
@@ -152,18 +323,46 @@ MRH_Srv_Context* MRH_SRV_Init(MRH_Srv_Actor e_Client, int i_MaxServerCount, int
         MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_MALLOC);
         return NULL;
     }
+    else if ((p_Context->c_MsQuicAlpn.Buffer = (uint8_t*)malloc(c_Alpn.Length)) == NULL)
+    {
+        free(p_Context);
+        p_MsQuicAPI->ConfigurationClose(p_MsQuicConfiguration);
+        p_MsQuicAPI->RegistrationClose(p_MsQuicRegistration);
+        MsQuicClose(p_MsQuicAPI);
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_MALLOC);
+        return NULL;
+    }
+    else if ((p_Context->p_MsQuicTickets = MRH_MsQuicCreateTicketCache()) == NULL)
+    {
+        free(p_Context->c_MsQuicAlpn.Buffer);
+        free(p_Context);
+        p_MsQuicAPI->ConfigurationClose(p_MsQuicConfiguration);
+        p_MsQuicAPI->RegistrationClose(p_MsQuicRegistration);
+        MsQuicClose(p_MsQuicAPI);
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_MALLOC);
+        return NULL;
+    }
     
     // Set MsQuic
     p_Context->p_MsQuicAPI = p_MsQuicAPI;
     p_Context->p_MsQuicRegistration = p_MsQuicRegistration;
     p_Context->p_MsQuicConfiguration = p_MsQuicConfiguration;
     
+    memcpy(p_Context->c_MsQuicAlpn.Buffer, c_Alpn.Buffer, c_Alpn.Length);
+    p_Context->c_MsQuicAlpn.Length = c_Alpn.Length;
+    
     // Set connection info
     p_Context->i_ServerMax = i_MaxServerCount;
-    p_Context->i_ServerCur = 0;
+    atomic_init(&(p_Context->i_ServerCur), 0);
     p_Context->u8_DeviceType = (uint8_t)e_Client;
     p_Context->i_TimeoutMS = i_TimeoutMS;
     
+    // Set execution info
+    p_Context->p_KeyCache = NULL;
+    p_Context->i_PartitionCount = i_PartitionCount;
+    p_Context->e_Partition = p_Options->e_Partition;
+    atomic_init(&(p_Context->ui_PartitionNext), 0);
+    
     // All done, now usable!
     return p_Context;
 }
@@ -191,44 +390,174 @@ MRH_Srv_Context* MRH_SRV_Destroy(MRH_Srv_Context* p_Context)
         MsQuicClose(p_Context->p_MsQuicAPI);
     }
     
+    if (p_Context->p_MsQuicTickets != NULL)
+    {
+        MRH_MsQuicDestroyTicketCache(p_Context->p_MsQuicTickets);
+    }
+    
+    if (p_Context->c_MsQuicAlpn.Buffer != NULL)
+    {
+        free(p_Context->c_MsQuicAlpn.Buffer);
+    }
+    
+    if (p_Context->p_KeyCache != NULL)
+    {
+        MRH_SRV_DestroyKeyCache(p_Context->p_KeyCache);
+    }
+    
     free(p_Context);
     
     return NULL;
 }
 
+int MRH_SRV_SetTicketStore(MRH_Srv_Context* p_Context, const char* p_FilePath)
+{
+    if (p_Context == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    else if (MRH_MsQuicSetTicketStore(p_Context->p_MsQuicTickets, p_FilePath) != 0)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_MALLOC);
+        return -1;
+    }
+    
+    return 0;
+}
+
+int MRH_SRV_SaveTickets(MRH_Srv_Context* p_Context)
+{
+    if (p_Context == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    else if (MRH_MsQuicSaveTickets(p_Context->p_MsQuicTickets) != 0)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_TICKET_SAVE);
+        return -1;
+    }
+    
+    return 0;
+}
+
+int MRH_SRV_SetKeyCache(MRH_Srv_Context* p_Context, size_t us_Count, uint32_t u32_ExpireS)
+{
+    if (p_Context == NULL || (us_Count > 0 && u32_ExpireS == 0))
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    
+    // Old keys are wiped, even if the new cache can't be created
+    if (p_Context->p_KeyCache != NULL)
+    {
+        p_Context->p_KeyCache = MRH_SRV_DestroyKeyCache(p_Context->p_KeyCache);
+    }
+    
+    if (us_Count > 0 && (p_Context->p_KeyCache = MRH_SRV_CreateKeyCache(us_Count, u32_ExpireS)) == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_MALLOC);
+        return -1;
+    }
+    
+    return 0;
+}
+
+void MRH_SRV_ClearKeyCache(MRH_Srv_Context* p_Context)
+{
+    if (p_Context == NULL || p_Context->p_KeyCache == NULL)
+    {
+        return;
+    }
+    
+    MRH_SRV_WipeKeyCache(p_Context->p_KeyCache);
+}
+
 //*************************************************************************************
 // Server
 //*************************************************************************************
 
-MRH_Srv_Server* MRH_SRV_CreateServer(MRH_Srv_Context* p_Context)
+static MRH_Srv_Server* MRH_SRV_NewServer(MRH_Srv_Context* p_Context, MRH_MsQuicConnection* p_MsQuic)
 {
-    if (p_Context == NULL || p_Context->i_ServerCur == p_Context->i_ServerMax)
+    // Reserve the server first, other threads might create servers too
+    int i_ServerCur = p_Context->i_ServerCur;
+    
+    do
     {
-        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
-        return NULL;
+        if (i_ServerCur >= p_Context->i_ServerMax)
+        {
+            MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+            return NULL;
+        }
     }
+    while (atomic_compare_exchange_weak(&(p_Context->i_ServerCur), &i_ServerCur, i_ServerCur + 1) == false);
     
     MRH_Srv_Server* p_Server = (MRH_Srv_Server*)malloc(sizeof(MRH_Srv_Server));
     
     if (p_Server == NULL)
     {
+        atomic_fetch_sub(&(p_Context->i_ServerCur), 1);
         MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_MALLOC);
         return NULL;
     }
-    else if ((p_Server->p_MsQuic = MRH_MsQuicCreateConnection(p_Context->p_MsQuicAPI)) == NULL)
+    else if (p_MsQuic == NULL && (p_MsQuic = MRH_MsQuicCreateConnection(p_Context->p_MsQuicAPI)) == NULL)
     {
         free(p_Server);
+        atomic_fetch_sub(&(p_Context->i_ServerCur), 1);
         MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_MALLOC);
         return NULL;
     }
     
     memset(p_Server->p_Address, '\0', MRH_SRV_SIZE_SERVER_ADDRESS);
     
+    p_Server->p_Context = p_Context;
+    p_Server->p_MsQuic = p_MsQuic;
     p_Server->i_Port = MRH_SRV_PORT_INVALID;
+    p_Server->p_ConnectCallback = NULL;
+    p_Server->p_ConnectUser = NULL;
+    p_Server->p_WritableCallback = NULL;
+    p_Server->p_WritableUser = NULL;
+    p_Server->p_ReconnectContext = NULL;
+    atomic_init(&(p_Server->i_ReconnectRun), -1);
     p_Server->u8_DeviceType = p_Context->u8_DeviceType;
     p_Server->i_TimeoutMS = p_Context->i_TimeoutMS;
+    p_Server->p_SessionKey = NULL;
+    p_Server->e_Cipher = MRH_SRV_CIPHER_SECRETBOX;
+    randombytes_buf(p_Server->p_SendPrefix, MRH_SRV_SIZE_CIPHER_PREFIX);
+    memset(p_Server->p_RecievePrefix, '\0', MRH_SRV_SIZE_CIPHER_PREFIX);
+    p_Server->i_RecievePrefix = -1;
+    atomic_init(&(p_Server->u64_SendCounter), 0);
+    p_Server->u64_RecieveCounter = 0;
+    memset(p_Server->p_RecieveWindow, 0, sizeof(p_Server->p_RecieveWindow));
+    p_Server->i_RecieveCounter = -1;
+    p_Server->i_Partition = -1;
+    
+    return p_Server;
+}
+
+MRH_Srv_Server* MRH_SRV_CreateServer(MRH_Srv_Context* p_Context)
+{
+    if (p_Context == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return NULL;
+    }
+    
+    MRH_Srv_Server* p_Server = MRH_SRV_NewServer(p_Context, NULL);
+    
+    if (p_Server == NULL)
+    {
+        return NULL;
+    }
     
-    p_Context->i_ServerCur += 1;
+    // Keep each server on one worker, recieved data stays in the cache of that core
+    if (p_Context->e_Partition == MRH_SRV_PARTITION_ROUND_ROBIN)
+    {
+        unsigned int ui_Next = atomic_fetch_add(&(p_Context->ui_PartitionNext), 1);
+        p_Server->i_Partition = (int)(ui_Next % (unsigned int)p_Context->i_PartitionCount);
+    }
     
     return p_Server;
 }
@@ -241,18 +570,338 @@ MRH_Srv_Server* MRH_SRV_DestroyServer(MRH_Srv_Context* p_Context, MRH_Srv_Server
         return NULL;
     }
     
-    // Disconnect first
+    // Stop reconnecting and disconnect first, fails in the reconnect callback
+    if (MRH_SRV_SetReconnect(p_Context, p_Server, NULL) != 0)
+    {
+        return p_Server;
+    }
+    
     MRH_SRV_Disconnect(p_Server, -1);
     
     // Clean up
     MRH_MsQuicDestroyConnection(p_Server->p_MsQuic);
+    
+    if (p_Server->p_SessionKey != NULL)
+    {
+        sodium_free(p_Server->p_SessionKey);
+    }
+    
     free(p_Server);
     
     // Reduce server count
-    if (p_Context->i_ServerCur > 0)
+    int i_ServerCur = p_Context->i_ServerCur;
+    
+    while (i_ServerCur > 0 &&
+           atomic_compare_exchange_weak(&(p_Context->i_ServerCur), &i_ServerCur, i_ServerCur - 1) == false)
     {
-        p_Context->i_ServerCur -= 1;
+        // Retry with the updated count
     }
     
     return NULL;
 }
+
+int MRH_SRV_SetSessionKey(MRH_Srv_Server* p_Server, const uint8_t* p_Key)
+{
+    if (p_Server == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    
+    // @NOTE: sodium_free wipes the old key
+    if (p_Server->p_SessionKey != NULL)
+    {
+        sodium_free(p_Server->p_SessionKey);
+        p_Server->p_SessionKey = NULL;
+    }
+    
+    if (p_Key == NULL)
+    {
+        return 0;
+    }
+    else if ((p_Server->p_SessionKey = (uint8_t*)sodium_malloc(MRH_SRV_SIZE_DEVICE_PASSWORD)) == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_MALLOC);
+        return -1;
+    }
+    
+    memcpy(p_Server->p_SessionKey, p_Key, MRH_SRV_SIZE_DEVICE_PASSWORD);
+    sodium_mprotect_readonly(p_Server->p_SessionKey);
+    
+    return 0;
+}
+
+int MRH_SRV_DeriveSessionKey(MRH_Srv_Server* p_Server, const char* p_Password, uint64_t u64_Nonce)
+{
+    if (p_Server == NULL || p_Password == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    
+    uint8_t p_Key[MRH_SRV_SIZE_DEVICE_PASSWORD];
+    
+    // @NOTE: SIZE_DEVICE_PASSWORD == crypto_kdf_KEYBYTES (32)
+    if (crypto_kdf_derive_from_key(p_Key,
+                                   MRH_SRV_SIZE_DEVICE_PASSWORD,
+                                   u64_Nonce,
+                                   MRH_SRV_SESSION_KEY_CONTEXT,
+                                   (const unsigned char*)p_Password) != 0)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_ENCRYPTION_FAILED);
+        return -1;
+    }
+    
+    int i_Result = MRH_SRV_SetSessionKey(p_Server, p_Key);
+    sodium_memzero(p_Key, MRH_SRV_SIZE_DEVICE_PASSWORD);
+    
+    return i_Result;
+}
+
+int MRH_SRV_SetCipher(MRH_Srv_Server* p_Server, MRH_Srv_Cipher e_Cipher, const uint8_t* p_RecievePrefix)
+{
+    if (p_Server == NULL || e_Cipher < MRH_SRV_CIPHER_SECRETBOX || e_Cipher > MRH_SRV_CIPHER_MAX ||
+        (e_Cipher == MRH_SRV_CIPHER_XCHACHA20_SHORT && p_RecievePrefix == NULL))
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    
+    // A new prefix starts counting again
+    if (p_RecievePrefix != NULL)
+    {
+        memcpy(p_Server->p_RecievePrefix, p_RecievePrefix, MRH_SRV_SIZE_CIPHER_PREFIX);
+        p_Server->i_RecievePrefix = 0;
+        p_Server->u64_RecieveCounter = 0;
+        memset(p_Server->p_RecieveWindow, 0, sizeof(p_Server->p_RecieveWindow));
+        p_Server->i_RecieveCounter = -1;
+    }
+    
+    p_Server->e_Cipher = e_Cipher;
+    
+    return 0;
+}
+
+int MRH_SRV_GetCipherPrefix(MRH_Srv_Server* p_Server, uint8_t* p_Prefix)
+{
+    if (p_Server == NULL || p_Prefix == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    
+    memcpy(p_Prefix, p_Server->p_SendPrefix, MRH_SRV_SIZE_CIPHER_PREFIX);
+    
+    return 0;
+}
+
+int MRH_SRV_SetPartition(MRH_Srv_Context* p_Context, MRH_Srv_Server* p_Server, int i_Partition)
+{
+    if (p_Context == NULL || p_Server == NULL || i_Partition < -1 || i_Partition >= p_Context->i_PartitionCount)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    
+    // @NOTE: Used by the next connect, an active connection keeps its partition
+    p_Server->i_Partition = i_Partition;
+    
+    return 0;
+}
+
+int MRH_SRV_GetPartitionCount(MRH_Srv_Context* p_Context)
+{
+    if (p_Context == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    
+    return p_Context->i_PartitionCount;
+}
+
+int MRH_SRV_SetTransport(MRH_Srv_Server* p_Server, MRH_Srv_Transport e_Transport)
+{
+    if (p_Server == NULL || e_Transport > MRH_SRV_TRANSPORT_MAX)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    
+    switch (e_Transport)
+    {
+        case MRH_SRV_TRANSPORT_FRAMED:
+            p_Server->p_MsQuic->i_Transport = MRH_MSQ_TRANSPORT_FRAMED;
+            break;
+            
+        default:
+            p_Server->p_MsQuic->i_Transport = MRH_MSQ_TRANSPORT_STREAM_PER_MESSAGE;
+            break;
+    }
+    
+    return 0;
+}
+
+int MRH_SRV_SetDatagram(MRH_Srv_Server* p_Server, MRH_Srv_NetMessage e_Message, int i_Enabled)
+{
+    // Only messages which can be lost are allowed
+    if (p_Server == NULL || (e_Message != MRH_SRV_MSG_LOCATION && e_Message != MRH_SRV_MSG_CUSTOM))
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    
+    if (i_Enabled == 0)
+    {
+        atomic_fetch_or(&(p_Server->p_MsQuic->u32_DatagramMessages), (uint32_t)1 << e_Message);
+    }
+    else
+    {
+        atomic_fetch_and(&(p_Server->p_MsQuic->u32_DatagramMessages), ~((uint32_t)1 << e_Message));
+    }
+    
+    return 0;
+}
+
+int MRH_SRV_SetMessagePriority(MRH_Srv_Server* p_Server, MRH_Srv_NetMessage e_Message, uint16_t u16_Priority)
+{
+    if (p_Server == NULL || e_Message < MRH_SRV_MSG_UNK || e_Message > MRH_SRV_NET_MESSAGE_MAX)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    
+    p_Server->p_MsQuic->p_Priority[e_Message] = u16_Priority;
+    
+    return 0;
+}
+
+int MRH_SRV_SetZeroCopyRecieve(MRH_Srv_Server* p_Server, int i_Enabled)
+{
+    if (p_Server == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    
+    p_Server->p_MsQuic->i_RecieveBorrow = (i_Enabled == 0) ? 0 : -1;
+    
+    return 0;
+}
+
+int MRH_SRV_SetSequence(MRH_Srv_Server* p_Server, int i_Enabled)
+{
+    if (p_Server == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    
+    p_Server->p_MsQuic->i_SendSequence = (i_Enabled == 0) ? 0 : -1;
+    
+    return 0;
+}
+
+int MRH_SRV_SetRecieveOrder(MRH_Srv_Server* p_Server, int i_Enabled, int i_GapTimeoutMS)
+{
+    if (p_Server == NULL || i_GapTimeoutMS < 0)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    
+    p_Server->p_MsQuic->i_RecieveGapMS = i_GapTimeoutMS;
+    p_Server->p_MsQuic->i_RecieveOrder = (i_Enabled == 0) ? 0 : -1;
+    
+    return 0;
+}
+
+int MRH_SRV_SetSendLimit(MRH_Srv_Server* p_Server, size_t us_Count)
+{
+    if (p_Server == NULL || us_Count == 0 || us_Count > MRH_SRV_SIZE_SEND_MESSAGE_MAX)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return -1;
+    }
+    
+    MRH_MsQuicSetSendLimit(p_Server->p_MsQuic, us_Count);
+    
+    return 0;
+}
+
+//*************************************************************************************
+// Listener
+//*************************************************************************************
+
+MRH_Srv_Listener* MRH_SRV_Listen(MRH_Srv_Context* p_Context, const char* p_Address, int i_Port, size_t us_Backlog)
+{
+    if (p_Context == NULL || p_Context->u8_DeviceType != MRH_SRV_SERVER || i_Port <= 0 || i_Port > UINT16_MAX || us_Backlog == 0)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return NULL;
+    }
+    
+    MRH_Srv_Listener* p_Listener = (MRH_Srv_Listener*)malloc(sizeof(MRH_Srv_Listener));
+    
+    if (p_Listener == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_MALLOC);
+        return NULL;
+    }
+    else if ((p_Listener->p_MsQuic = MRH_MsQuicCreateListener(p_Context->p_MsQuicAPI,
+                                                              p_Context->p_MsQuicRegistration,
+                                                              p_Context->p_MsQuicConfiguration,
+                                                              &(p_Context->c_MsQuicAlpn),
+                                                              p_Address,
+                                                              i_Port,
+                                                              us_Backlog)) == NULL)
+    {
+        free(p_Listener);
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_LISTEN_START);
+        return NULL;
+    }
+    
+    return p_Listener;
+}
+
+MRH_Srv_Server* MRH_SRV_Accept(MRH_Srv_Context* p_Context, MRH_Srv_Listener* p_Listener, int i_TimeoutMS)
+{
+    if (p_Context == NULL || p_Listener == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return NULL;
+    }
+    
+    MRH_MsQuicConnection* p_MsQuic = MRH_MsQuicTakeConnection(p_Listener->p_MsQuic, i_TimeoutMS);
+    
+    if (p_MsQuic == NULL)
+    {
+        return NULL;
+    }
+    
+    MRH_Srv_Server* p_Server = MRH_SRV_NewServer(p_Context, p_MsQuic);
+    
+    if (p_Server == NULL)
+    {
+        // No server left for the client, close the connection
+        MRH_MsQuicDestroyConnection(p_MsQuic);
+        return NULL;
+    }
+    
+    // @NOTE: Accepted servers have no address, they can't connect or reconnect
+    return p_Server;
+}
+
+MRH_Srv_Listener* MRH_SRV_StopListen(MRH_Srv_Listener* p_Listener)
+{
+    if (p_Listener == NULL)
+    {
+        MRH_ERR_SetServerError(MRH_SERVER_ERROR_GENERAL_INVALID_PARAM);
+        return NULL;
+    }
+    
+    MRH_MsQuicDestroyListener(p_Listener->p_MsQuic);
+    free(p_Listener);
+    
+    return NULL;
+}
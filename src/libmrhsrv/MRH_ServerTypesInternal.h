@@ -29,14 +29,22 @@
 // External
 
 // Project
+#include "../../include/libmrhsrv/libmrhsrv/Communication/MRH_ServerCommunication.h"
 #include "../../include/libmrhsrv/libmrhsrv/MRH_ServerTypes.h"
 #include "../../include/libmrhsrv/libmrhsrv/MRH_ServerSizes.h"
 #include "./Communication/MsQuic/MRH_MsQuicContext.h"
+#include "./Communication/MsQuic/MRH_MsQuicListener.h"
+#include "./Communication/MRH_ServerKeyCache.h"
 
 // Pre-defined
 #define MRH_SRV_CONNECTION_SERVER_POS 0
 #define MRH_SRV_PORT_INVALID -1
 
+// Counters below the highest recieved one which are still accepted, covers
+// every message in flight even if streams complete out of order
+#define MRH_SRV_CIPHER_REPLAY_WINDOW (MRH_SRV_SIZE_SEND_MESSAGE_MAX * 2)
+#define MRH_SRV_CIPHER_REPLAY_WORDS (MRH_SRV_CIPHER_REPLAY_WINDOW / 64)
+
 
 #ifdef __cplusplus
 extern "C"
@@ -56,14 +64,57 @@ extern "C"
         // Client
         uint8_t u8_DeviceType;
         
+        // Context
+        MRH_Srv_Context* p_Context; // The context the server was created with
+        
         // Connection context
         MRH_MsQuicConnection* p_MsQuic;
         
+        // Async connect
+        MRH_Srv_ConnectCallback p_ConnectCallback;
+        void* p_ConnectUser;
+        
+        // Send flow control, guarded by the connection state mutex
+        MRH_Srv_WritableCallback p_WritableCallback;
+        void* p_WritableUser;
+        
+        // Reconnect
+        MRH_Srv_Context* p_ReconnectContext;
+        MRH_Srv_ReconnectPolicy c_Reconnect;
+        pthread_t p_ReconnectThread;
+        _Atomic(int) i_ReconnectRun; // 0 while the reconnect thread runs
+        
+        // Encryption
+        uint8_t* p_SessionKey; // Guarded and read only, NULL if not set
+        MRH_Srv_Cipher e_Cipher;
+        uint8_t p_SendPrefix[MRH_SRV_SIZE_CIPHER_PREFIX]; // Random, has to be known by the other side for short nonces
+        uint8_t p_RecievePrefix[MRH_SRV_SIZE_CIPHER_PREFIX]; // The prefix of the other side
+        int i_RecievePrefix; // 0 if the prefix of the other side is known
+        _Atomic(uint64_t) u64_SendCounter; // Never reset, nonces stay unique for the send prefix
+        
+        // Replay protection for counter nonces, only used by the reading thread
+        uint64_t u64_RecieveCounter; // Highest counter recieved
+        uint64_t p_RecieveWindow[MRH_SRV_CIPHER_REPLAY_WORDS]; // Bit per counter modulo the window, set if recieved
+        int i_RecieveCounter; // 0 once a counter was recieved
+        
+        // Execution
+        int i_Partition; // The MsQuic partition to connect on, -1 to let MsQuic choose
+        
         // Timings
         int i_TimeoutMS;
         
     }MRH_Srv_Server;
     
+    //*************************************************************************************
+    // Listener
+    //*************************************************************************************
+    
+    struct MRH_Srv_Listener_t
+    {
+        // Connection context
+        MRH_MsQuicListener* p_MsQuic;
+    };
+    
     //*************************************************************************************
     // Connection
     //*************************************************************************************
@@ -74,14 +125,24 @@ extern "C"
         const QUIC_API_TABLE* p_MsQuicAPI;
         HQUIC p_MsQuicRegistration;
         HQUIC p_MsQuicConfiguration;
+        MRH_MsQuicTicketCache* p_MsQuicTickets;
+        QUIC_BUFFER c_MsQuicAlpn; // Owned copy, used by listeners
         
         // Server
         int i_ServerMax;
-        int i_ServerCur;
+        _Atomic(int) i_ServerCur; // Servers are created and destroyed from any thread
         
         // Client
         uint8_t u8_DeviceType;
         
+        // Auth
+        MRH_Srv_KeyCache* p_KeyCache; // NULL if derived keys are not cached
+        
+        // Execution
+        int i_PartitionCount;
+        MRH_Srv_Partition e_Partition;
+        _Atomic(unsigned int) ui_PartitionNext; // Next partition for round robin mapping
+        
         // Timings
         int i_TimeoutMS;
     };